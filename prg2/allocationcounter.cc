@@ -0,0 +1,156 @@
+// Allocationcounter.cc
+
+#include "allocationcounter.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace
+{
+
+std::atomic<std::uint64_t> allocations{0};
+std::atomic<std::uint64_t> allocated_bytes{0};
+std::atomic<std::uint64_t> live_bytes{0};
+std::atomic<std::uint64_t> peak_live_bytes{0};
+
+void raise_peak(std::uint64_t value)
+{
+  std::uint64_t peak = peak_live_bytes.load(std::memory_order_relaxed);
+  while (value > peak && !peak_live_bytes.compare_exchange_weak(peak, value, std::memory_order_relaxed)) {}
+}
+
+} // namespace
+
+AllocationCounts allocation_counts()
+{
+  return {allocations.load(std::memory_order_relaxed), allocated_bytes.load(std::memory_order_relaxed),
+          peak_live_bytes.load(std::memory_order_relaxed)};
+}
+
+std::uint64_t begin_peak_interval()
+{
+  return peak_live_bytes.exchange(live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void end_peak_interval(std::uint64_t saved_peak)
+{
+  raise_peak(saved_peak);
+}
+
+#ifdef USE_ALLOC_COUNT
+
+namespace
+{
+
+// The size is stored just before the returned pointer, in a header that keeps the
+// requested alignment
+std::size_t header_size(std::size_t alignment)
+{
+  return std::max(alignment, alignof(std::max_align_t));
+}
+
+void *counted_allocate(std::size_t size, std::size_t alignment) noexcept
+{
+  std::size_t header = header_size(alignment);
+  void *block = nullptr;
+  if (alignment > alignof(std::max_align_t))
+  {
+    // aligned_alloc wants the size to be a multiple of the alignment
+    block = std::aligned_alloc(alignment, (header + size + alignment - 1) / alignment * alignment);
+  }
+  else
+  {
+    block = std::malloc(header + size);
+  }
+  if (block == nullptr)
+  {
+    return nullptr;
+  }
+
+  char *user = static_cast<char *>(block) + header;
+  std::memcpy(user - sizeof(std::size_t), &size, sizeof(std::size_t));
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  raise_peak(live_bytes.fetch_add(size, std::memory_order_relaxed) + size);
+  return user;
+}
+
+void *allocate_or_throw(std::size_t size, std::size_t alignment)
+{
+  while (true)
+  {
+    if (void *user = counted_allocate(size, alignment))
+    {
+      return user;
+    }
+    std::new_handler handler = std::get_new_handler();
+    if (handler == nullptr)
+    {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+}
+
+void counted_free(void *pointer, std::size_t alignment) noexcept
+{
+  if (pointer == nullptr)
+  {
+    return;
+  }
+  char *user = static_cast<char *>(pointer);
+  std::size_t size;
+  std::memcpy(&size, user - sizeof(std::size_t), sizeof(std::size_t));
+  live_bytes.fetch_sub(size, std::memory_order_relaxed);
+  std::free(user - header_size(alignment));
+}
+
+std::size_t const DEFAULT_ALIGNMENT = alignof(std::max_align_t);
+
+} // namespace
+
+void *operator new(std::size_t size) { return allocate_or_throw(size, DEFAULT_ALIGNMENT); }
+void *operator new[](std::size_t size) { return allocate_or_throw(size, DEFAULT_ALIGNMENT); }
+void *operator new(std::size_t size, std::nothrow_t const &) noexcept { return counted_allocate(size, DEFAULT_ALIGNMENT); }
+void *operator new[](std::size_t size, std::nothrow_t const &) noexcept { return counted_allocate(size, DEFAULT_ALIGNMENT); }
+void *operator new(std::size_t size, std::align_val_t alignment) { return allocate_or_throw(size, static_cast<std::size_t>(alignment)); }
+void *operator new[](std::size_t size, std::align_val_t alignment) { return allocate_or_throw(size, static_cast<std::size_t>(alignment)); }
+void *operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const &) noexcept
+{
+  return counted_allocate(size, static_cast<std::size_t>(alignment));
+}
+void *operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const &) noexcept
+{
+  return counted_allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *pointer) noexcept { counted_free(pointer, DEFAULT_ALIGNMENT); }
+void operator delete[](void *pointer) noexcept { counted_free(pointer, DEFAULT_ALIGNMENT); }
+void operator delete(void *pointer, std::size_t) noexcept { counted_free(pointer, DEFAULT_ALIGNMENT); }
+void operator delete[](void *pointer, std::size_t) noexcept { counted_free(pointer, DEFAULT_ALIGNMENT); }
+void operator delete(void *pointer, std::nothrow_t const &) noexcept { counted_free(pointer, DEFAULT_ALIGNMENT); }
+void operator delete[](void *pointer, std::nothrow_t const &) noexcept { counted_free(pointer, DEFAULT_ALIGNMENT); }
+void operator delete(void *pointer, std::align_val_t alignment) noexcept { counted_free(pointer, static_cast<std::size_t>(alignment)); }
+void operator delete[](void *pointer, std::align_val_t alignment) noexcept { counted_free(pointer, static_cast<std::size_t>(alignment)); }
+void operator delete(void *pointer, std::size_t, std::align_val_t alignment) noexcept
+{
+  counted_free(pointer, static_cast<std::size_t>(alignment));
+}
+void operator delete[](void *pointer, std::size_t, std::align_val_t alignment) noexcept
+{
+  counted_free(pointer, static_cast<std::size_t>(alignment));
+}
+void operator delete(void *pointer, std::align_val_t alignment, std::nothrow_t const &) noexcept
+{
+  counted_free(pointer, static_cast<std::size_t>(alignment));
+}
+void operator delete[](void *pointer, std::align_val_t alignment, std::nothrow_t const &) noexcept
+{
+  counted_free(pointer, static_cast<std::size_t>(alignment));
+}
+
+#endif // USE_ALLOC_COUNT
@@ -0,0 +1,33 @@
+// Allocationcounter.hh
+//
+// Heap accounting for the whole program. When compiled with USE_ALLOC_COUNT,
+// the global operator new and delete are replaced with versions that count the
+// allocations, the bytes allocated and the bytes still live (each block keeps
+// its size in a small header in front of it). Without USE_ALLOC_COUNT nothing
+// is replaced and all counts stay zero.
+//
+// The peak of live bytes is kept as a mark that can be lowered to the current
+// live bytes for an interval and restored afterwards, so that intervals can be
+// nested (e.g. a perftest inside a command timed with the stopwatch).
+
+#ifndef ALLOCATIONCOUNTER_HH
+#define ALLOCATIONCOUNTER_HH
+
+#include <cstdint>
+
+struct AllocationCounts
+{
+  std::uint64_t allocations = 0;
+  std::uint64_t bytes = 0;           // Bytes requested by the allocations
+  std::uint64_t peak_live_bytes = 0; // Highest number of bytes allocated and not yet freed
+};
+
+// Allocations and bytes since the program started; the peak is the current peak mark
+AllocationCounts allocation_counts();
+
+// Lowers the peak mark to the current live bytes, returns the mark before that
+std::uint64_t begin_peak_interval();
+// Restores the mark returned by begin_peak_interval (unless the peak is now higher)
+void end_peak_interval(std::uint64_t saved_peak);
+
+#endif // ALLOCATIONCOUNTER_HH
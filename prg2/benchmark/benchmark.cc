@@ -0,0 +1,464 @@
+// Benchmark.cc
+//
+// Console benchmarks of Datastructures, built without Qt (see benchmark.pro,
+// or compile directly in this directory with
+//   g++ -std=c++17 -O2 -pthread *.cc ../datastructures.cc ../nearest.cc ../snapshot.cc ../mappedsnapshot.cc -o benchmark
+// ). Every benchmark runs on N random affiliations and N random publications
+// (1-3 affiliations each, most referencing an earlier one), generated once per
+// N from a fixed seed so that runs are comparable. Run with --help for options.
+
+#include "harness.hh"
+#include "../datastructures.hh"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+
+std::uint32_t const SEED = 20231106;
+int const MAX_COORD = 10000;
+
+struct Dataset
+{
+  std::vector<AffiliationID> affiliations;
+  std::vector<Name> names;
+  std::vector<Coord> coords; // Distinct
+  std::vector<PublicationData> publications;
+  std::vector<std::pair<PublicationID, PublicationID>> references; // Publication, the one it references
+};
+
+Name random_name(std::mt19937 &rng)
+{
+  std::uniform_int_distribution<int> length(5, 10);
+  std::uniform_int_distribution<int> letter('a', 'z');
+  Name name(length(rng), ' ');
+  for (char &c : name) { c = static_cast<char>(letter(rng)); }
+  return name;
+}
+
+Dataset make_dataset(unsigned int n)
+{
+  std::mt19937 rng(SEED + n);
+  Dataset data;
+  std::uniform_int_distribution<int> coord(0, MAX_COORD);
+  std::unordered_set<Coord, CoordHash> used;
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    Coord xy;
+    do { xy = {coord(rng), coord(rng)}; } while (!used.insert(xy).second);
+    data.affiliations.push_back("A" + std::to_string(i));
+    data.names.push_back(random_name(rng));
+    data.coords.push_back(xy);
+  }
+
+  std::uniform_int_distribution<unsigned int> affiliation(0, n - 1);
+  std::uniform_int_distribution<unsigned int> affiliation_count(1, 3);
+  std::uniform_int_distribution<int> year(1950, 2023);
+  std::bernoulli_distribution has_reference(0.8);
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    PublicationData pub{i + 1, random_name(rng), static_cast<Year>(year(rng)), {}};
+    for (unsigned int j = affiliation_count(rng); j > 0; --j)
+    {
+      AffiliationID const &id = data.affiliations[affiliation(rng)];
+      if (std::find(pub.affiliations.begin(), pub.affiliations.end(), id) == pub.affiliations.end())
+      {
+        pub.affiliations.push_back(id);
+      }
+    }
+    if (i > 0 && has_reference(rng))
+    {
+      data.references.emplace_back(pub.id, data.publications[std::uniform_int_distribution<unsigned int>(0, i - 1)(rng)].id);
+    }
+    data.publications.push_back(std::move(pub));
+  }
+  return data;
+}
+
+Dataset const &dataset(unsigned int n)
+{
+  static std::map<unsigned int, Dataset> datasets;
+  auto it = datasets.find(n);
+  if (it == datasets.end())
+  {
+    it = datasets.emplace(n, make_dataset(n)).first;
+  }
+  return it->second;
+}
+
+void add_affiliations(Datastructures &ds, Dataset const &data)
+{
+  for (std::size_t i = 0; i < data.affiliations.size(); ++i)
+  {
+    ds.add_affiliation(data.affiliations[i], data.names[i], data.coords[i]);
+  }
+}
+
+void add_publications(Datastructures &ds, Dataset const &data)
+{
+  ds.add_publications(data.publications);
+  for (auto const &[id, parent] : data.references)
+  {
+    ds.add_reference(id, parent);
+  }
+}
+
+void fill(Datastructures &ds, Dataset const &data)
+{
+  ds.clear_all();
+  add_affiliations(ds, data);
+  add_publications(ds, data);
+}
+
+// 0..n-1 in a random (but repeatable) order, to spread the queries over the data
+std::vector<std::size_t> query_order(std::size_t n)
+{
+  std::vector<std::size_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937(SEED));
+  return order;
+}
+
+// Keeps the compiler from dropping a result that is otherwise unused
+void const *volatile sink = nullptr;
+template <typename Type>
+void consume(Type const &value)
+{
+  sink = &value;
+}
+
+// Queries taking one argument from the data, cycling through it in random order
+template <typename Argument, typename Query>
+void run_queries(BenchmarkState &state, std::vector<Argument> const &arguments, Query query)
+{
+  Datastructures ds;
+  fill(ds, dataset(state.n()));
+  std::vector<std::size_t> order = query_order(arguments.size());
+  std::size_t next = 0;
+  while (state.keep_running())
+  {
+    consume(query(ds, arguments[order[next]]));
+    if (++next == order.size()) { next = 0; }
+  }
+}
+
+// Path queries between random pairs of affiliations
+template <typename Query>
+void run_path_queries(BenchmarkState &state, Query query)
+{
+  Dataset const &data = dataset(state.n());
+  Datastructures ds;
+  fill(ds, data);
+  std::vector<std::size_t> order = query_order(data.affiliations.size());
+  std::size_t next = 0;
+  while (state.keep_running())
+  {
+    std::size_t source = order[next];
+    std::size_t target = order[order.size() - 1 - next];
+    consume(query(ds, data.affiliations[source], data.affiliations[target]));
+    if (++next == order.size()) { next = 0; }
+  }
+}
+
+std::vector<PublicationID> publication_ids(Dataset const &data)
+{
+  std::vector<PublicationID> ids;
+  for (PublicationData const &pub : data.publications) { ids.push_back(pub.id); }
+  return ids;
+}
+
+// Micro-benchmarks: one operation per iteration
+
+void bm_add_affiliation(BenchmarkState &state)
+{
+  Dataset const &data = dataset(state.n());
+  Datastructures ds;
+  std::size_t next = 0;
+  while (state.keep_running())
+  {
+    if (next == data.affiliations.size())
+    {
+      state.pause_timing();
+      ds.clear_all();
+      next = 0;
+      state.resume_timing();
+    }
+    ds.add_affiliation(data.affiliations[next], data.names[next], data.coords[next]);
+    ++next;
+  }
+}
+
+void bm_add_publication(BenchmarkState &state)
+{
+  Dataset const &data = dataset(state.n());
+  Datastructures ds;
+  std::size_t next = data.publications.size();
+  while (state.keep_running())
+  {
+    if (next == data.publications.size())
+    {
+      state.pause_timing();
+      ds.clear_all();
+      add_affiliations(ds, data);
+      next = 0;
+      state.resume_timing();
+    }
+    PublicationData const &pub = data.publications[next];
+    ds.add_publication(pub.id, pub.name, pub.year, pub.affiliations);
+    ++next;
+  }
+}
+
+// One iteration adds all the publications of the dataset as one batch
+void bm_add_publications_batch(BenchmarkState &state)
+{
+  Dataset const &data = dataset(state.n());
+  Datastructures ds;
+  while (state.keep_running())
+  {
+    state.pause_timing();
+    ds.clear_all();
+    add_affiliations(ds, data);
+    state.resume_timing();
+    ds.add_publications(data.publications);
+  }
+}
+
+void bm_get_affiliation_name(BenchmarkState &state)
+{
+  run_queries(state, dataset(state.n()).affiliations,
+              [](Datastructures &ds, AffiliationID const &id) { return ds.get_affiliation_name(id); });
+}
+
+void bm_get_affiliation_coord(BenchmarkState &state)
+{
+  run_queries(state, dataset(state.n()).affiliations,
+              [](Datastructures &ds, AffiliationID const &id) { return ds.get_affiliation_coord(id); });
+}
+
+void bm_find_affiliation_with_coord(BenchmarkState &state)
+{
+  run_queries(state, dataset(state.n()).coords, [](Datastructures &ds, Coord xy) { return ds.find_affiliation_with_coord(xy); });
+}
+
+void bm_get_affiliations_closest_to(BenchmarkState &state)
+{
+  run_queries(state, dataset(state.n()).coords, [](Datastructures &ds, Coord xy) { return ds.get_affiliations_closest_to(xy); });
+}
+
+void bm_get_publications(BenchmarkState &state)
+{
+  run_queries(state, dataset(state.n()).affiliations,
+              [](Datastructures &ds, AffiliationID const &id) { return ds.get_publications(id); });
+}
+
+void bm_get_affiliations(BenchmarkState &state)
+{
+  run_queries(state, publication_ids(dataset(state.n())), [](Datastructures &ds, PublicationID id) { return ds.get_affiliations(id); });
+}
+
+void bm_get_referenced_by_chain(BenchmarkState &state)
+{
+  run_queries(state, publication_ids(dataset(state.n())),
+              [](Datastructures &ds, PublicationID id) { return ds.get_referenced_by_chain(id); });
+}
+
+void bm_get_all_references(BenchmarkState &state)
+{
+  run_queries(state, publication_ids(dataset(state.n())), [](Datastructures &ds, PublicationID id) { return ds.get_all_references(id); });
+}
+
+void bm_get_connected_affiliations(BenchmarkState &state)
+{
+  run_queries(state, dataset(state.n()).affiliations,
+              [](Datastructures &ds, AffiliationID const &id) { return ds.get_connected_affiliations(id); });
+}
+
+void bm_get_any_path(BenchmarkState &state)
+{
+  run_path_queries(state, [](Datastructures &ds, AffiliationID const &source, AffiliationID const &target) {
+    return ds.get_any_path(source, target);
+  });
+}
+
+void bm_get_path_with_least_affiliations(BenchmarkState &state)
+{
+  run_path_queries(state, [](Datastructures &ds, AffiliationID const &source, AffiliationID const &target) {
+    return ds.get_path_with_least_affiliations(source, target);
+  });
+}
+
+void bm_get_path_of_least_friction(BenchmarkState &state)
+{
+  run_path_queries(state, [](Datastructures &ds, AffiliationID const &source, AffiliationID const &target) {
+    return ds.get_path_of_least_friction(source, target);
+  });
+}
+
+void bm_get_shortest_path(BenchmarkState &state)
+{
+  run_path_queries(state, [](Datastructures &ds, AffiliationID const &source, AffiliationID const &target) {
+    return ds.get_shortest_path(source, target);
+  });
+}
+
+void bm_remove_affiliation(BenchmarkState &state)
+{
+  Dataset const &data = dataset(state.n());
+  Datastructures ds;
+  std::vector<std::size_t> order = query_order(data.affiliations.size());
+  std::size_t next = order.size();
+  while (state.keep_running())
+  {
+    if (next == order.size())
+    {
+      state.pause_timing();
+      fill(ds, data);
+      next = 0;
+      state.resume_timing();
+    }
+    ds.remove_affiliation(data.affiliations[order[next]]);
+    ++next;
+  }
+}
+
+void bm_remove_publication(BenchmarkState &state)
+{
+  Dataset const &data = dataset(state.n());
+  Datastructures ds;
+  std::vector<std::size_t> order = query_order(data.publications.size());
+  std::size_t next = order.size();
+  while (state.keep_running())
+  {
+    if (next == order.size())
+    {
+      state.pause_timing();
+      fill(ds, data);
+      next = 0;
+      state.resume_timing();
+    }
+    ds.remove_publication(data.publications[order[next]].id);
+    ++next;
+  }
+}
+
+// Macro-benchmarks: one iteration covers all N items
+
+void bm_build_all(BenchmarkState &state)
+{
+  Dataset const &data = dataset(state.n());
+  Datastructures ds;
+  while (state.keep_running())
+  {
+    fill(ds, data);
+  }
+}
+
+void bm_get_affiliations_alphabetically(BenchmarkState &state)
+{
+  Datastructures ds;
+  fill(ds, dataset(state.n()));
+  while (state.keep_running())
+  {
+    consume(ds.get_affiliations_alphabetically());
+  }
+}
+
+void bm_get_affiliations_distance_increasing(BenchmarkState &state)
+{
+  Datastructures ds;
+  fill(ds, dataset(state.n()));
+  while (state.keep_running())
+  {
+    consume(ds.get_affiliations_distance_increasing());
+  }
+}
+
+void bm_get_all_connections(BenchmarkState &state)
+{
+  Datastructures ds;
+  fill(ds, dataset(state.n()));
+  while (state.keep_running())
+  {
+    consume(ds.get_all_connections());
+  }
+}
+
+// A change followed by the sorted queries, which then rebuild their caches
+void bm_change_coord_then_sorted(BenchmarkState &state)
+{
+  Dataset const &data = dataset(state.n());
+  Datastructures ds;
+  fill(ds, data);
+  std::vector<std::size_t> order = query_order(data.affiliations.size());
+  std::size_t next = 0;
+  while (state.keep_running())
+  {
+    std::size_t i = order[next];
+    Coord xy = data.coords[i];
+    ds.change_affiliation_coord(data.affiliations[i], {xy.x, MAX_COORD + 1 + xy.y}); // Away from the data, so still distinct
+    consume(ds.get_affiliations_alphabetically());
+    consume(ds.get_affiliations_distance_increasing());
+    ds.change_affiliation_coord(data.affiliations[i], xy);
+    if (++next == order.size()) { next = 0; }
+  }
+}
+
+std::vector<Benchmark> const BENCHMARKS = {
+  {"add_affiliation", &bm_add_affiliation},
+  {"add_publication", &bm_add_publication},
+  {"add_publications_batch", &bm_add_publications_batch},
+  {"get_affiliation_name", &bm_get_affiliation_name},
+  {"get_affiliation_coord", &bm_get_affiliation_coord},
+  {"find_affiliation_with_coord", &bm_find_affiliation_with_coord},
+  {"get_affiliations_closest_to", &bm_get_affiliations_closest_to},
+  {"get_publications", &bm_get_publications},
+  {"get_affiliations", &bm_get_affiliations},
+  {"get_referenced_by_chain", &bm_get_referenced_by_chain},
+  {"get_all_references", &bm_get_all_references},
+  {"get_connected_affiliations", &bm_get_connected_affiliations},
+  {"get_any_path", &bm_get_any_path},
+  {"get_path_with_least_affiliations", &bm_get_path_with_least_affiliations},
+  {"get_path_of_least_friction", &bm_get_path_of_least_friction},
+  {"get_shortest_path", &bm_get_shortest_path},
+  {"remove_affiliation", &bm_remove_affiliation},
+  {"remove_publication", &bm_remove_publication},
+  {"build_all", &bm_build_all},
+  {"get_affiliations_alphabetically", &bm_get_affiliations_alphabetically},
+  {"get_affiliations_distance_increasing", &bm_get_affiliations_distance_increasing},
+  {"get_all_connections", &bm_get_all_connections},
+  {"change_coord_then_sorted", &bm_change_coord_then_sorted},
+};
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  if (argc == 2 && (std::string(argv[1]) == "--help" || std::string(argv[1]) == "-h"))
+  {
+    std::cout << "Usage: " << argv[0] << " [--n N,N,...] [--repetitions R] [--min-time SEC] [--filter TEXT] [--csv] [--list]" << std::endl
+              << "Runs every benchmark whose name contains TEXT for each N (default 1000,10000): iterations are" << std::endl
+              << "added until a run takes SEC seconds (default 0.1), then R runs (default 5) are timed." << std::endl;
+    return EXIT_SUCCESS;
+  }
+
+  BenchmarkOptions options;
+  if (!parse_benchmark_options(argc, argv, options, std::cerr))
+  {
+    return EXIT_FAILURE;
+  }
+  unsigned int rows = run_benchmarks(BENCHMARKS, options, std::cout);
+  if (rows == 0 && !options.list)
+  {
+    std::cerr << "No benchmark matches '" << options.filter << "'" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,27 @@
+# Console benchmarks of Datastructures, without Qt. Build this project separately from prg2.pro
+# (e.g. "qmake benchmark.pro && make" in this directory) and run "./benchmark --help".
+# NOTE: Always build the benchmarks in release mode, debug builds measure mostly the debug checks.
+
+TEMPLATE = app
+CONFIG += console c++17 warn_on thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+TARGET = benchmark
+
+SOURCES += \
+    benchmark.cc \
+    harness.cc \
+    ../datastructures.cc \
+    ../nearest.cc \
+    ../snapshot.cc \
+    ../mappedsnapshot.cc
+
+HEADERS += \
+    harness.hh \
+    ../datastructures.hh \
+    ../nearest.hh \
+    ../slotmap.hh \
+    ../snapshot.hh \
+    ../mappedsnapshot.hh \
+    ../pathsearch.hh
@@ -0,0 +1,222 @@
+// Harness.cc
+
+#include "harness.hh"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iterator>
+#include <ostream>
+#include <sstream>
+#include <string_view>
+
+namespace
+{
+
+std::uint64_t const MAX_ITERATIONS = 1000000000;
+
+struct Statistics
+{
+  double mean = 0;
+  double median = 0;
+  double stddev = 0;
+};
+
+Statistics statistics(std::vector<double> values)
+{
+  Statistics stats;
+  if (values.empty())
+  {
+    return stats;
+  }
+  for (double value : values) { stats.mean += value; }
+  stats.mean /= static_cast<double>(values.size());
+
+  std::sort(values.begin(), values.end());
+  std::size_t middle = values.size() / 2;
+  stats.median = values.size() % 2 == 1 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+
+  if (values.size() > 1)
+  {
+    double sum_squares = 0;
+    for (double value : values) { sum_squares += (value - stats.mean) * (value - stats.mean); }
+    stats.stddev = std::sqrt(sum_squares / static_cast<double>(values.size() - 1));
+  }
+  return stats;
+}
+
+// Seconds taken by one run of function with the given iterations
+double run_once(BenchmarkFunction function, unsigned int n, std::uint64_t iterations)
+{
+  BenchmarkState state(n, iterations);
+  function(state);
+  return state.elapsed_seconds();
+}
+
+// The iteration count for the repetitions: grown until one run takes at least min_time
+std::uint64_t calibrate(BenchmarkFunction function, unsigned int n, double min_time)
+{
+  std::uint64_t iterations = 1;
+  while (true)
+  {
+    double seconds = run_once(function, n, iterations);
+    if (seconds >= min_time || iterations >= MAX_ITERATIONS)
+    {
+      return iterations;
+    }
+    // Aim a bit over min_time once the run is long enough to predict from, otherwise grow 10x
+    double multiplier = seconds > min_time / 10 ? min_time * 1.4 / seconds : 10.0;
+    auto next = static_cast<std::uint64_t>(std::ceil(static_cast<double>(iterations) * multiplier));
+    iterations = std::min(std::max(next, iterations + 1), MAX_ITERATIONS);
+  }
+}
+
+template <typename Number>
+bool parse_number(std::string_view text, Number &value)
+{
+  auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+  return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+bool parse_ns(std::string_view text, std::vector<unsigned int> &ns)
+{
+  ns.clear();
+  std::size_t pos = 0;
+  while (pos <= text.size())
+  {
+    std::size_t end = std::min(text.find(',', pos), text.size());
+    unsigned int n = 0;
+    if (!parse_number(text.substr(pos, end - pos), n) || n == 0)
+    {
+      return false;
+    }
+    ns.push_back(n);
+    pos = end + 1;
+  }
+  return !ns.empty();
+}
+
+} // namespace
+
+bool BenchmarkState::keep_running()
+{
+  if (!started_)
+  {
+    started_ = true;
+    resume_timing();
+  }
+  if (remaining_ > 0)
+  {
+    --remaining_;
+    return true;
+  }
+  pause_timing();
+  return false;
+}
+
+void BenchmarkState::pause_timing()
+{
+  if (timing_)
+  {
+    elapsed_ += Clock::now() - start_;
+    timing_ = false;
+  }
+}
+
+void BenchmarkState::resume_timing()
+{
+  timing_ = true;
+  start_ = Clock::now();
+}
+
+bool parse_benchmark_options(int argc, char *argv[], BenchmarkOptions &options, std::ostream &errors)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string_view option = argv[i];
+    bool has_value = i + 1 < argc;
+    std::string_view value = has_value ? argv[i + 1] : "";
+    if (option == "--csv") { options.csv = true; continue; }
+    if (option == "--list") { options.list = true; continue; }
+
+    bool ok = has_value;
+    if (option == "--n") { ok = ok && parse_ns(value, options.ns); }
+    else if (option == "--repetitions") { ok = ok && parse_number(value, options.repetitions) && options.repetitions > 0; }
+    else if (option == "--min-time") { ok = ok && (std::istringstream(std::string(value)) >> options.min_time) && options.min_time >= 0; }
+    else if (option == "--filter") { options.filter = std::string(value); }
+    else
+    {
+      errors << "Unknown option '" << option << "'" << std::endl;
+      return false;
+    }
+    if (!ok)
+    {
+      errors << "Bad or missing value for " << option << std::endl;
+      return false;
+    }
+    ++i;
+  }
+  return true;
+}
+
+unsigned int run_benchmarks(std::vector<Benchmark> const &benchmarks, BenchmarkOptions const &options, std::ostream &output)
+{
+  std::vector<Benchmark> selected;
+  std::copy_if(benchmarks.begin(), benchmarks.end(), std::back_inserter(selected), [&options](Benchmark const &benchmark) {
+    return std::strstr(benchmark.name, options.filter.c_str()) != nullptr;
+  });
+
+  if (options.list)
+  {
+    for (Benchmark const &benchmark : selected) { output << benchmark.name << std::endl; }
+    return 0;
+  }
+
+  int const name_width = 48;
+  if (options.csv)
+  {
+    output << "name,n,iterations,repetitions,mean_ns,median_ns,stddev_ns,cv" << std::endl;
+  }
+  else
+  {
+    output << "Running " << selected.size() << " benchmarks, " << options.repetitions << " repetitions of at least "
+           << options.min_time << " sec each" << std::endl;
+    output << std::left << std::setw(name_width) << "Benchmark" << std::right << std::setw(12) << "Iterations" << std::setw(14)
+           << "Mean (ns)" << std::setw(14) << "Median (ns)" << std::setw(14) << "Stddev (ns)" << std::setw(8) << "CV" << std::endl;
+    output << std::string(name_width + 12 + 3 * 14 + 8, '-') << std::endl;
+  }
+
+  unsigned int rows = 0;
+  for (unsigned int n : options.ns)
+  {
+    for (Benchmark const &benchmark : selected)
+    {
+      std::uint64_t iterations = calibrate(benchmark.function, n, options.min_time);
+      std::vector<double> ns_per_iteration;
+      for (unsigned int repetition = 0; repetition < options.repetitions; ++repetition)
+      {
+        double seconds = run_once(benchmark.function, n, iterations);
+        ns_per_iteration.push_back(seconds * 1e9 / static_cast<double>(iterations));
+      }
+      Statistics stats = statistics(ns_per_iteration);
+      double cv = stats.mean > 0 ? stats.stddev / stats.mean : 0;
+
+      std::string name = std::string(benchmark.name) + "/" + std::to_string(n);
+      if (options.csv)
+      {
+        output << name << ',' << n << ',' << iterations << ',' << options.repetitions << ',' << stats.mean << ','
+               << stats.median << ',' << stats.stddev << ',' << cv << std::endl;
+      }
+      else
+      {
+        output << std::left << std::setw(name_width) << name << std::right << std::setw(12) << iterations << std::fixed
+               << std::setprecision(1) << std::setw(14) << stats.mean << std::setw(14) << stats.median << std::setw(14)
+               << stats.stddev << std::setw(7) << cv * 100 << '%' << std::defaultfloat << std::setprecision(6) << std::endl;
+      }
+      ++rows;
+    }
+  }
+  return rows;
+}
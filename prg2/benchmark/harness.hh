@@ -0,0 +1,77 @@
+// Harness.hh
+//
+// A small benchmark harness in the style of Google Benchmark. A benchmark is a
+// function taking a BenchmarkState: it does its setup and then times the loop
+// while (state.keep_running()) { ... }, one operation per iteration.
+//
+// Each benchmark is run for every N. First it is run with growing iteration
+// counts until one run takes at least the minimum time (this is also its
+// warmup), then the given number of repetitions are run with that iteration
+// count. The time per iteration over the repetitions is reported as mean,
+// median, standard deviation and coefficient of variation.
+
+#ifndef HARNESS_HH
+#define HARNESS_HH
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+class BenchmarkState
+{
+public:
+  BenchmarkState(unsigned int n, std::uint64_t iterations) : n_(n), iterations_(iterations), remaining_(iterations) {}
+
+  unsigned int n() const { return n_; }
+  std::uint64_t iterations() const { return iterations_; }
+
+  // Starts the timer on the first call, stops it when the iterations run out
+  bool keep_running();
+
+  // For setup work inside the loop (e.g. refilling the data when it runs out)
+  void pause_timing();
+  void resume_timing();
+
+  double elapsed_seconds() const { return std::chrono::duration<double>(elapsed_).count(); }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  unsigned int n_;
+  std::uint64_t iterations_;
+  std::uint64_t remaining_;
+  bool started_ = false;
+  bool timing_ = false;
+  Clock::time_point start_;
+  Clock::duration elapsed_ = Clock::duration::zero();
+};
+
+using BenchmarkFunction = void (*)(BenchmarkState &state);
+
+struct Benchmark
+{
+  char const *name;
+  BenchmarkFunction function;
+};
+
+struct BenchmarkOptions
+{
+  std::vector<unsigned int> ns = {1000, 10000};
+  unsigned int repetitions = 5;
+  double min_time = 0.1; // Seconds, for one repetition
+  std::string filter;    // Only the benchmarks whose name contains this
+  bool csv = false;
+  bool list = false;     // Only list the benchmarks
+};
+
+// Reads "--n 1000,10000 --repetitions 5 --min-time 0.1 --filter name --csv --list";
+// writes a message and returns false for anything else
+bool parse_benchmark_options(int argc, char *argv[], BenchmarkOptions &options, std::ostream &errors);
+
+// Runs the selected benchmarks for every N, writing a row per benchmark and N.
+// Returns the number of rows written.
+unsigned int run_benchmarks(std::vector<Benchmark> const &benchmarks, BenchmarkOptions const &options, std::ostream &output);
+
+#endif // HARNESS_HH
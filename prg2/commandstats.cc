@@ -0,0 +1,87 @@
+// Commandstats.cc
+
+#include "commandstats.hh"
+
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+
+using Counters = std::unordered_map<std::string, CommandCounter>;
+
+void add(Counters &counters, std::string const &stack, CommandCounter const &counter)
+{
+  CommandCounter &sum = counters[stack];
+  sum.calls += counter.calls;
+  sum.total_ns += counter.total_ns;
+  sum.self_ns += counter.self_ns;
+}
+
+struct ThreadCounters;
+
+// The buffers of the running threads, and the counts of the threads that have exited
+std::mutex registry_mutex;
+std::unordered_set<ThreadCounters *> live_threads;
+Counters exited_threads;
+
+struct ThreadCounters
+{
+  std::mutex mutex;
+  Counters counters;
+
+  ThreadCounters()
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    live_threads.insert(this);
+  }
+
+  ~ThreadCounters()
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    live_threads.erase(this);
+    for (auto const &[stack, counter] : counters) { add(exited_threads, stack, counter); }
+  }
+};
+
+ThreadCounters &this_thread_counters()
+{
+  thread_local ThreadCounters counters;
+  return counters;
+}
+
+} // namespace
+
+void record_command(std::string const &stack, std::uint64_t total_ns, std::uint64_t self_ns)
+{
+  ThreadCounters &thread = this_thread_counters();
+  std::lock_guard<std::mutex> lock(thread.mutex);
+  CommandCounter &counter = thread.counters[stack];
+  ++counter.calls;
+  counter.total_ns += total_ns;
+  counter.self_ns += self_ns;
+}
+
+std::map<std::string, CommandCounter> command_counters()
+{
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  Counters merged = exited_threads;
+  for (ThreadCounters *thread : live_threads)
+  {
+    std::lock_guard<std::mutex> thread_lock(thread->mutex);
+    for (auto const &[stack, counter] : thread->counters) { add(merged, stack, counter); }
+  }
+  return {merged.begin(), merged.end()};
+}
+
+void clear_command_counters()
+{
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  exited_threads.clear();
+  for (ThreadCounters *thread : live_threads)
+  {
+    std::lock_guard<std::mutex> thread_lock(thread->mutex);
+    thread->counters.clear();
+  }
+}
@@ -0,0 +1,34 @@
+// Commandstats.hh
+//
+// Always-on command profile: the number of calls and the cumulative time of
+// each command, kept by call stack (the commands run by read, replay etc. are
+// below them, e.g. "read;get_any_path"). Each thread counts into its own
+// buffer behind its own (uncontended) mutex, so recording is a hash lookup and
+// an add, also from the worker threads of parallel read.
+//
+// The self time of a stack (its time minus the time of the commands it ran) is
+// what flamegraph tools expect as the value of a folded stack line.
+
+#ifndef COMMANDSTATS_HH
+#define COMMANDSTATS_HH
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+struct CommandCounter
+{
+  std::uint64_t calls = 0;
+  std::uint64_t total_ns = 0;
+  std::uint64_t self_ns = 0;
+};
+
+// Adds a call of the command at the end of stack (command names separated by ';')
+void record_command(std::string const &stack, std::uint64_t total_ns, std::uint64_t self_ns);
+
+// The counters of all threads merged, by stack
+std::map<std::string, CommandCounter> command_counters();
+
+void clear_command_counters();
+
+#endif // COMMANDSTATS_HH
@@ -0,0 +1,197 @@
+// Complexityfit.cc
+
+#include "complexityfit.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <istream>
+
+namespace
+{
+
+Complexity const ALL_COMPLEXITIES[] = {Complexity::CONSTANT, Complexity::LOGARITHMIC, Complexity::LINEAR,
+                                       Complexity::LINEARITHMIC, Complexity::QUADRATIC, Complexity::CUBIC};
+
+double growth(Complexity complexity, double n)
+{
+  double log_n = std::log2(std::max(n, 2.0));
+  switch (complexity)
+  {
+    case Complexity::CONSTANT: return 1;
+    case Complexity::LOGARITHMIC: return log_n;
+    case Complexity::LINEAR: return n;
+    case Complexity::LINEARITHMIC: return n * log_n;
+    case Complexity::QUADRATIC: return n * n;
+    case Complexity::CUBIC: return n * n * n;
+  }
+  return 1;
+}
+
+bool is_identifier_char(char c)
+{
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// One term of a sum, e.g. "n log n", "k^2" or "1": the power of the variables, and a log
+Complexity term_complexity(std::string_view term)
+{
+  unsigned int power = 0;
+  bool has_log = false;
+  bool log_argument = false; // The next variable is the argument of a log
+  std::size_t pos = 0;
+  while (pos < term.size())
+  {
+    if (!std::isalpha(static_cast<unsigned char>(term[pos])))
+    {
+      ++pos;
+      continue;
+    }
+    std::size_t end = pos;
+    while (end < term.size() && is_identifier_char(term[end])) { ++end; }
+    std::string_view name = term.substr(pos, end - pos);
+    pos = end;
+    if (name == "log" || name == "lg" || name == "ln")
+    {
+      has_log = true;
+      log_argument = true;
+      continue;
+    }
+    if (log_argument)
+    {
+      log_argument = false;
+      continue;
+    }
+    unsigned int exponent = 1;
+    if (pos + 1 < term.size() && term[pos] == '^' && std::isdigit(static_cast<unsigned char>(term[pos + 1])))
+    {
+      exponent = static_cast<unsigned int>(term[pos + 1] - '0');
+      pos += 2;
+    }
+    power += exponent;
+  }
+
+  switch (power)
+  {
+    case 0: return has_log ? Complexity::LOGARITHMIC : Complexity::CONSTANT;
+    case 1: return has_log ? Complexity::LINEARITHMIC : Complexity::LINEAR;
+    case 2: return Complexity::QUADRATIC;
+    default: return Complexity::CUBIC;
+  }
+}
+
+} // namespace
+
+char const *complexity_name(Complexity complexity)
+{
+  switch (complexity)
+  {
+    case Complexity::CONSTANT: return "O(1)";
+    case Complexity::LOGARITHMIC: return "O(log n)";
+    case Complexity::LINEAR: return "O(n)";
+    case Complexity::LINEARITHMIC: return "O(n log n)";
+    case Complexity::QUADRATIC: return "O(n^2)";
+    case Complexity::CUBIC: return "O(n^3)";
+  }
+  return "O(?)";
+}
+
+std::vector<ComplexityFit> fit_complexities(const std::vector<double> &ns, const std::vector<double> &times)
+{
+  std::vector<ComplexityFit> fits;
+  for (Complexity complexity : ALL_COMPLEXITIES)
+  {
+    // Minimizes sum((1 - c * f(n) / t)^2), the relative errors of t = c * f(n)
+    double sum_w = 0;
+    double sum_w2 = 0;
+    std::size_t points = 0;
+    for (std::size_t i = 0; i < ns.size() && i < times.size(); ++i)
+    {
+      if (times[i] <= 0) { continue; }
+      double w = growth(complexity, ns[i]) / times[i];
+      sum_w += w;
+      sum_w2 += w * w;
+      ++points;
+    }
+    if (points == 0 || sum_w2 == 0) { continue; }
+    double coefficient = sum_w / sum_w2;
+    double sum_error2 = 0;
+    for (std::size_t i = 0; i < ns.size() && i < times.size(); ++i)
+    {
+      if (times[i] <= 0) { continue; }
+      double error = 1.0 - coefficient * growth(complexity, ns[i]) / times[i];
+      sum_error2 += error * error;
+    }
+    fits.push_back({complexity, coefficient, std::sqrt(sum_error2 / static_cast<double>(points))});
+  }
+  std::stable_sort(fits.begin(), fits.end(), [](const ComplexityFit &fit1, const ComplexityFit &fit2) {
+    return fit1.error < fit2.error;
+  });
+  return fits;
+}
+
+bool parse_complexity(std::string_view estimate, Complexity &complexity)
+{
+  // Only what is inside O(...), if there is one
+  std::size_t open = estimate.find("O(");
+  if (open != std::string_view::npos)
+  {
+    std::size_t close = estimate.rfind(')');
+    if (close == std::string_view::npos || close < open + 2) { return false; }
+    estimate = estimate.substr(open + 2, close - open - 2);
+  }
+
+  bool found = false;
+  std::size_t pos = 0;
+  while (pos <= estimate.size())
+  {
+    std::size_t end = std::min(estimate.find('+', pos), estimate.size());
+    std::string_view term = estimate.substr(pos, end - pos);
+    if (std::any_of(term.begin(), term.end(), [](char c) { return std::isalnum(static_cast<unsigned char>(c)); }))
+    {
+      Complexity term_class = term_complexity(term);
+      complexity = found ? std::max(complexity, term_class) : term_class;
+      found = true;
+    }
+    pos = end + 1;
+  }
+  return found;
+}
+
+std::map<std::string, Complexity> read_declared_complexities(std::istream &header)
+{
+  std::string const marker = "Estimate of performance:";
+  std::map<std::string, Complexity> declared;
+  bool pending = false;
+  Complexity complexity = Complexity::CONSTANT;
+  std::string line;
+  while (std::getline(header, line))
+  {
+    std::size_t first = line.find_first_not_of(" \t");
+    if (first == std::string::npos) { continue; }
+    if (line.compare(first, 2, "//") == 0)
+    {
+      std::size_t at = line.find(marker);
+      if (at != std::string::npos)
+      {
+        pending = parse_complexity(std::string_view(line).substr(at + marker.size()), complexity);
+      }
+      continue;
+    }
+    // The declaration following the comments: the name is the identifier before the first (
+    std::size_t paren = line.find('(');
+    if (pending && paren != std::string::npos)
+    {
+      std::size_t end = paren;
+      while (end > 0 && line[end - 1] == ' ') { --end; }
+      std::size_t start = end;
+      while (start > 0 && is_identifier_char(line[start - 1])) { --start; }
+      if (start < end)
+      {
+        declared[line.substr(start, end - start)] = complexity;
+      }
+    }
+    pending = false;
+  }
+  return declared;
+}
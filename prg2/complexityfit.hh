@@ -0,0 +1,41 @@
+// Complexityfit.hh
+//
+// Fits measured times against the usual complexity classes, and reads the
+// classes declared in the "Estimate of performance:" comments of a header.
+// Each class is fitted as time = coefficient * f(n) by least squares on the
+// relative error, so that the small and the large N weigh the same.
+
+#ifndef COMPLEXITYFIT_HH
+#define COMPLEXITYFIT_HH
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// In increasing order of growth
+enum class Complexity { CONSTANT, LOGARITHMIC, LINEAR, LINEARITHMIC, QUADRATIC, CUBIC };
+
+char const *complexity_name(Complexity complexity); // "O(1)", "O(log n)", ...
+
+struct ComplexityFit
+{
+  Complexity complexity = Complexity::CONSTANT;
+  double coefficient = 0; // Time per unit of f(n)
+  double error = 0;       // Root mean square of the relative errors
+};
+
+// Fits times[i] measured at ns[i] (at least two distinct n) against every class,
+// returns the fits best first
+std::vector<ComplexityFit> fit_complexities(std::vector<double> const &ns, std::vector<double> const &times);
+
+// The fastest growing term of an estimate such as "O(n log n + e)". Every variable is
+// taken to grow with n. Returns false if no term is recognized.
+bool parse_complexity(std::string_view estimate, Complexity &complexity);
+
+// The estimates declared in a header with "// Estimate of performance: O(...)" before a
+// function declaration, by function name
+std::map<std::string, Complexity> read_declared_complexities(std::istream &header);
+
+#endif // COMPLEXITYFIT_HH
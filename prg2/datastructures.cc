@@ -5,11 +5,21 @@
 // Student number:
 
 #include "datastructures.hh"
+#include "nearest.hh"
+#include "snapshot.hh"
+#include "mappedsnapshot.hh"
+#include "pathsearch.hh"
 
 #include <random>
+#include <algorithm>
 
 #include <cmath>
 #include <climits>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <numeric>
+#include <type_traits>
 
 std::minstd_rand rand_engine; // Reasonably quick pseudo-random generator
 
@@ -24,6 +34,54 @@ Type random_in_range(Type start, Type end)
   return static_cast<Type>(start + num);
 }
 
+// Collects one list per element of range (as returned by list_of) into CSR form:
+// offsets[i]..offsets[i + 1] are the items of element i
+template <typename Item, typename Range, typename ListOf>
+void write_snapshot_lists(SnapshotWriter &writer, SnapshotSection offsets_section, SnapshotSection items_section,
+                          Range const &range, ListOf list_of)
+{
+  std::vector<std::uint64_t> offsets(1, 0);
+  std::vector<Item> items;
+  for (const auto &element : range)
+  {
+    const auto &list = list_of(element);
+    items.insert(items.end(), list.begin(), list.end());
+    offsets.push_back(items.size());
+  }
+  writer.section(offsets_section, offsets);
+  writer.section(items_section, items);
+}
+
+// Estimated heap bytes of containers, for memory_usage. Strings short enough for the
+// small string buffer own nothing; unordered containers have a pointer per bucket and
+// a node (value, next link, cached hash) per element; trees have a node (value, colour
+// and three links) per element.
+std::size_t const SHORT_STRING_CAPACITY = std::string().capacity();
+
+template <typename String>
+std::size_t string_memory(String const &str)
+{
+  return str.capacity() > SHORT_STRING_CAPACITY ? str.capacity() + 1 : 0;
+}
+
+template <typename Vector>
+std::size_t vector_memory(Vector const &vector)
+{
+  return vector.capacity() * sizeof(typename Vector::value_type);
+}
+
+template <typename Hash>
+std::size_t hash_memory(Hash const &hash)
+{
+  return hash.bucket_count() * sizeof(void *) + hash.size() * (sizeof(typename Hash::value_type) + 2 * sizeof(void *));
+}
+
+template <typename Tree>
+std::size_t tree_memory(Tree const &tree)
+{
+  return tree.size() * (sizeof(typename Tree::value_type) + 4 * sizeof(void *));
+}
+
 // Modify the code below to implement the functionality of the class.
 // Also remove comments from the parameter names when you implement
 // an operation (Commenting out parameter name prevents compiler from
@@ -39,53 +97,265 @@ Datastructures::~Datastructures()
   // Write any cleanup you need here
 }
 
-unsigned int Datastructures::get_affiliation_count()
+bool Datastructures::map_snapshot(const std::string &filename)
+{
+  std::unique_lock<std::shared_mutex> lock(state_mutex);
+  std::unique_ptr<MappedSnapshot> snapshot = MappedSnapshot::open(filename);
+  if (!snapshot)
+  {
+    return false;
+  }
+  clear_state();
+  mapped = std::move(snapshot);
+  return true;
+}
+
+void Datastructures::detach_snapshot()
+{
+  if (mapped)
+  {
+    // clear_state (called by load_snapshot) releases the mapping, so keep it alive until loaded
+    std::unique_ptr<MappedSnapshot> snapshot = std::move(mapped);
+    load_snapshot(snapshot->reader());
+  }
+}
+
+bool Datastructures::publish_epoch()
+{
+  // Publishers take turns, so that an older epoch is never stored over a newer one
+  std::lock_guard<std::mutex> publish_lock(publish_mutex);
+  std::shared_ptr<MappedSnapshot const> next;
+  {
+    // Serializing only reads the state, so the other queries keep running meanwhile.
+    // Only a mapped snapshot needs the exclusive lock, to be loaded into memory first.
+    std::shared_lock<std::shared_mutex> lock(state_mutex);
+    while (mapped)
+    {
+      lock.unlock();
+      {
+        std::unique_lock<std::shared_mutex> unique_lock(state_mutex);
+        detach_snapshot();
+      }
+      lock.lock();
+    }
+    // Only what changed since the current epoch is built again, the rest is copied from it
+    std::shared_ptr<MappedSnapshot const> previous = std::atomic_load(&epoch);
+    std::ostringstream output(std::ios::binary);
+    if (!write_snapshot(output, true, previous ? &previous->reader() : nullptr, epoch_changes))
+    {
+      return false;
+    }
+    std::string bytes = output.str();
+    std::vector<std::uint64_t> buffer((bytes.size() + 7) / 8);
+    std::memcpy(buffer.data(), bytes.data(), bytes.size());
+    next = MappedSnapshot::from_buffer(std::move(buffer), bytes.size(), false);
+    if (!next)
+    {
+      return false;
+    }
+    // Modifying operations wait for the shared lock, and other publishers for publish_mutex
+    epoch_changes = 0;
+  }
+  // Queries still using the previous epoch keep it alive until they return
+  std::atomic_store(&epoch, std::move(next));
+  return true;
+}
+
+void Datastructures::drop_epoch()
+{
+  std::atomic_store(&epoch, std::shared_ptr<MappedSnapshot const>());
+}
+
+std::vector<std::pair<std::string, std::size_t>> Datastructures::memory_usage() const
+{
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  std::vector<std::pair<std::string, std::size_t>> usage;
+
+  usage.emplace_back("affiliation coordinates and degrees",
+                     vector_memory(affiliations_x) + vector_memory(affiliations_y) + vector_memory(affiliations_degree));
+
+  std::size_t cold = vector_memory(affiliations_cold);
+  std::size_t incident = 0;
+  for (const AffiliationCold &aff : affiliations_cold)
+  {
+    cold += string_memory(aff.id) + string_memory(aff.name) + vector_memory(aff.publications);
+    incident += vector_memory(aff.incident_edges);
+  }
+  usage.emplace_back("affiliations", cold);
+
+  std::size_t handles = hash_memory(affiliation_handles);
+  for (const auto &entry : affiliation_handles)
+  {
+    handles += string_memory(entry.first);
+  }
+  usage.emplace_back("affiliation ids", handles);
+
+  std::size_t pubs = publications.memory_bytes();
+  for (SlotIndex slot = 0; slot < publications.slot_count(); ++slot)
+  {
+    const Publication &pub = publications[slot];
+    pubs += string_memory(pub.name) + vector_memory(pub.affiliations) + vector_memory(pub.children);
+    for (const std::pmr::string &aff : pub.affiliations)
+    {
+      pubs += string_memory(aff);
+    }
+  }
+  usage.emplace_back("publications", pubs);
+  usage.emplace_back("publication ids", hash_memory(publication_handles));
+
+  usage.emplace_back("connections", vector_memory(edges) + incident);
+
+  std::size_t by_name = tree_memory(affiliations_map_sorted_name);
+  for (const auto &entry : affiliations_map_sorted_name)
+  {
+    by_name += string_memory(entry.first) + tree_memory(entry.second);
+    for (const std::pmr::string &id : entry.second)
+    {
+      by_name += string_memory(id);
+    }
+  }
+  usage.emplace_back("affiliations sorted by name", by_name);
+
+  std::size_t by_coord = tree_memory(affiliations_map_sorted_coord);
+  for (const auto &entry : affiliations_map_sorted_coord)
+  {
+    by_coord += string_memory(entry.second);
+  }
+  usage.emplace_back("affiliations sorted by coordinates", by_coord);
+
+  std::size_t caches = 0;
+  {
+    std::lock_guard<std::mutex> cache_lock(sorted_cache_mutex);
+    for (const std::vector<AffiliationID> *cache : {&affiliations_id_sorted_name, &affiliations_id_sorted_coord})
+    {
+      caches += vector_memory(*cache);
+      for (const AffiliationID &id : *cache)
+      {
+        caches += string_memory(id);
+      }
+    }
+  }
+  usage.emplace_back("sorted result caches", caches);
+
+  std::size_t years = vector_memory(publications_by_year) + vector_memory(year_bucket_unsorted) + vector_memory(publications_year_tree);
+  for (const auto &bucket : publications_by_year)
+  {
+    years += vector_memory(bucket);
+  }
+  usage.emplace_back("year index", years);
+
+  if (mapped)
+  {
+    usage.emplace_back(mapped->is_mapped() ? "mapped snapshot (file mapping)" : "mapped snapshot", mapped->size());
+  }
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    usage.emplace_back("published epoch", published->size());
+  }
+  return usage;
+}
+
+unsigned int Datastructures::get_affiliation_count() const
+{
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_affiliation_count();
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_affiliation_count();
+  }
+
+  return affiliations_cold.size();
+}
+
+// Re-creates an arena-backed container as empty without destroying the old one first.
+// Only valid right after the arena has been released: all memory of the old
+// container (and of its elements) was in the arena, so there is nothing left to free.
+template <typename Container>
+void reset_in_arena(Container &container, std::pmr::memory_resource *arena)
 {
-  return affiliations_map.size();
+  new (&container) Container(arena);
 }
 
 void Datastructures::clear_all()
 {
-  affiliations_map.clear();
-  publications_map.clear();
+  std::unique_lock<std::shared_mutex> lock(state_mutex);
+  clear_state();
+}
+
+void Datastructures::clear_state()
+{
+  mapped.reset();
+  epoch_changes = EPOCH_ALL;
+  arena.release();
+
+  reset_in_arena(affiliations_x, &arena);
+  reset_in_arena(affiliations_y, &arena);
+  reset_in_arena(affiliations_degree, &arena);
+  reset_in_arena(affiliations_cold, &arena);
+  reset_in_arena(affiliation_handles, &arena);
+  affiliations_outside_simd_range = 0;
 
-  affiliations_id.clear();
+  reset_in_arena(publications, &arena);
+  reset_in_arena(publication_handles, &arena);
 
-  affiliations_map_sorted_name.clear();
+  reset_in_arena(affiliations_map_sorted_name, &arena);
   affiliations_id_sorted_name.clear();
   affiliations_id_sorted_name.shrink_to_fit();
 
-  affiliations_map_sorted_coord.clear();
+  reset_in_arena(affiliations_map_sorted_coord, &arena);
   affiliations_id_sorted_coord.clear();
   affiliations_id_sorted_coord.shrink_to_fit();
 
-  all_connections.clear();
+  reset_in_arena(edges, &arena);
+
+  reset_in_arena(publications_by_year, &arena);
+  reset_in_arena(year_bucket_unsorted, &arena);
+  year_buckets_unsorted = 0;
+  reset_in_arena(publications_year_tree, &arena);
 }
 
-std::vector<AffiliationID> Datastructures::get_all_affiliations()
+std::vector<AffiliationID> Datastructures::get_all_affiliations() const
 {
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_all_affiliations();
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_all_affiliations();
+  }
+
+  std::vector<AffiliationID> affiliations_id;
+  affiliations_id.reserve(affiliations_cold.size());
+  for (const auto &aff : affiliations_cold)
+  {
+    affiliations_id.emplace_back(aff.id);
+  }
   return affiliations_id;
 }
 
 bool Datastructures::add_affiliation(AffiliationID id, const Name &name, Coord xy)
 {
-  auto it = affiliations_map.find(id);
-
-  if (it == affiliations_map.end())
+  std::unique_lock<std::shared_mutex> lock(state_mutex);
+  detach_snapshot();
+  epoch_changes |= EPOCH_AFFILIATIONS | EPOCH_LINKS | EPOCH_EDGES;
+  if (find_affiliation(id) == NO_HANDLE)
   {
-    affiliations_map.insert({id, {id, name, xy, {}, {}}});
-    affiliations_id.push_back(id);
-    all_connections.insert({id, {}});
-    auto it_name = affiliations_map_sorted_name.find(name);
-    if (it_name != affiliations_map_sorted_name.end())
-    {
-      it_name->second.insert(id);
-    }
-    else
-    {
-      affiliations_map_sorted_name.insert({name, {id}});
-    }
-    affiliations_map_sorted_coord.insert({xy, id});
+    affiliation_handles.emplace(id, static_cast<AffHandle>(affiliations_cold.size()));
+    affiliations_x.push_back(xy.x);
+    affiliations_y.push_back(xy.y);
+    affiliations_degree.push_back(0);
+    AffiliationCold &cold = affiliations_cold.emplace_back();
+    cold.id = id;
+    cold.name = name;
+    if (!nearest_simd_coord_ok(xy.x, xy.y))
+      affiliations_outside_simd_range++;
+    affiliations_map_sorted_name[arena_string(name)].emplace(id);
+    affiliations_map_sorted_coord.emplace(xy, id);
     affiliations_name_sorted = false;
     affiliations_coord_sorted = false;
     return true;
@@ -93,164 +363,293 @@ bool Datastructures::add_affiliation(AffiliationID id, const Name &name, Coord x
   return false;
 }
 
-Name Datastructures::get_affiliation_name(AffiliationID id)
+Name Datastructures::get_affiliation_name(AffiliationID id) const
 {
-  auto it = affiliations_map.find(id);
-  return (it != affiliations_map.end()) ? it->second.name : NO_NAME;
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_affiliation_name(id);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_affiliation_name(id);
+  }
+
+  AffHandle aff = find_affiliation(id);
+  return (aff != NO_HANDLE) ? Name(affiliations_cold[aff].name) : NO_NAME;
 }
 
-Coord Datastructures::get_affiliation_coord(AffiliationID id)
+Coord Datastructures::get_affiliation_coord(AffiliationID id) const
 {
-  auto it = affiliations_map.find(id);
-  return (it != affiliations_map.end()) ? it->second.xy : NO_COORD;
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_affiliation_coord(id);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_affiliation_coord(id);
+  }
+
+  AffHandle aff = find_affiliation(id);
+  return (aff != NO_HANDLE) ? affiliation_coord(aff) : NO_COORD;
 }
 
-std::vector<AffiliationID> Datastructures::get_affiliations_alphabetically()
+std::vector<AffiliationID> Datastructures::get_affiliations_alphabetically() const
 {
-  if (!affiliations_name_sorted)
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_affiliations_alphabetically();
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
   {
-    affiliations_id_sorted_name.clear();
-    affiliations_id_sorted_name.reserve(affiliations_map.size());
-    for (const auto &aff : affiliations_map_sorted_name)
+    return mapped->get_affiliations_alphabetically();
+  }
+
+  if (!affiliations_name_sorted.load(std::memory_order_acquire))
+  {
+    std::lock_guard<std::mutex> cache_lock(sorted_cache_mutex);
+    if (!affiliations_name_sorted.load(std::memory_order_relaxed))
     {
-      for (const auto &id : aff.second)
+      affiliations_id_sorted_name.clear();
+      affiliations_id_sorted_name.reserve(affiliations_cold.size());
+      for (const auto &aff : affiliations_map_sorted_name)
       {
-        affiliations_id_sorted_name.push_back(id);
+        for (const auto &id : aff.second)
+        {
+          affiliations_id_sorted_name.emplace_back(id);
+        }
       }
+      affiliations_name_sorted.store(true, std::memory_order_release);
     }
-    affiliations_name_sorted = true;
   }
 
   return affiliations_id_sorted_name;
 }
 
-std::vector<AffiliationID> Datastructures::get_affiliations_distance_increasing()
+std::vector<AffiliationID> Datastructures::get_affiliations_distance_increasing() const
 {
-  if (!affiliations_coord_sorted)
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_affiliations_distance_increasing();
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_affiliations_distance_increasing();
+  }
+
+  if (!affiliations_coord_sorted.load(std::memory_order_acquire))
   {
-    affiliations_id_sorted_coord.clear();
-    affiliations_id_sorted_coord.reserve(affiliations_map.size());
-    for (const auto &aff : affiliations_map_sorted_coord)
+    std::lock_guard<std::mutex> cache_lock(sorted_cache_mutex);
+    if (!affiliations_coord_sorted.load(std::memory_order_relaxed))
     {
-      affiliations_id_sorted_coord.push_back(aff.second);
+      affiliations_id_sorted_coord.clear();
+      affiliations_id_sorted_coord.reserve(affiliations_cold.size());
+      for (const auto &aff : affiliations_map_sorted_coord)
+      {
+        affiliations_id_sorted_coord.emplace_back(aff.second);
+      }
+      affiliations_coord_sorted.store(true, std::memory_order_release);
     }
-    affiliations_coord_sorted = true;
   }
 
   return affiliations_id_sorted_coord;
 }
 
-AffiliationID Datastructures::find_affiliation_with_coord(Coord xy)
+AffiliationID Datastructures::find_affiliation_with_coord(Coord xy) const
 {
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->find_affiliation_with_coord(xy);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->find_affiliation_with_coord(xy);
+  }
+
   auto it = affiliations_map_sorted_coord.find(xy);
-  return it != affiliations_map_sorted_coord.end() ? it->second : NO_AFFILIATION;
+  return it != affiliations_map_sorted_coord.end() ? AffiliationID(it->second) : NO_AFFILIATION;
 }
 
 bool Datastructures::change_affiliation_coord(AffiliationID id, Coord newcoord)
 {
-  auto it = affiliations_map.find(id);
-  if (it == affiliations_map.end())
+  std::unique_lock<std::shared_mutex> lock(state_mutex);
+  detach_snapshot();
+  epoch_changes |= EPOCH_AFFILIATIONS;
+  AffHandle aff = find_affiliation(id);
+  if (aff == NO_HANDLE)
   {
     return false;
   }
 
-  affiliations_map_sorted_coord.erase(it->second.xy);
-  affiliations_map_sorted_coord[newcoord] = id;
+  affiliations_map_sorted_coord.erase(affiliation_coord(aff));
+  affiliations_map_sorted_coord[newcoord] = arena_string(id);
   affiliations_coord_sorted = false;
 
-  it->second.xy = newcoord;
+  if (!nearest_simd_coord_ok(affiliations_x[aff], affiliations_y[aff]))
+    affiliations_outside_simd_range--;
+  if (!nearest_simd_coord_ok(newcoord.x, newcoord.y))
+    affiliations_outside_simd_range++;
+  affiliations_x[aff] = newcoord.x;
+  affiliations_y[aff] = newcoord.y;
 
   return true;
 }
 
 bool Datastructures::add_publication(PublicationID id, const Name &name, Year year, const std::vector<AffiliationID> &affiliations)
 {
-  auto it = publications_map.find(id);
-  AffiliationID id_smaller;
-  AffiliationID id_bigger;
+  std::unique_lock<std::shared_mutex> lock(state_mutex);
+  detach_snapshot();
+  epoch_changes |= EPOCH_PUBLICATIONS | EPOCH_EDGES;
+  if (!insert_publication(id, name, year, affiliations))
+  {
+    return false;
+  }
 
-  if (it == publications_map.end())
+  // Resolve each affiliation once instead of once per pair
+  std::vector<AffHandle> handles;
+  handles.reserve(affiliations.size());
+  for (const auto &aff_id : affiliations)
   {
-    publications_map.insert({id, {id, name, year, affiliations, NO_PUBLICATION, {}}});
-    if (affiliations.size() >= 2)
+    handles.push_back(find_affiliation(aff_id));
+  }
+  for (std::size_t i = 0; i < handles.size(); ++i)
+  {
+    for (std::size_t j = i + 1; j < handles.size(); ++j)
+    {
+      connect_affiliations(handles[i], handles[j]);
+    }
+  }
+  return true;
+}
+
+unsigned int Datastructures::add_publications(const std::vector<PublicationData> &batch)
+{
+  std::unique_lock<std::shared_mutex> lock(state_mutex);
+  detach_snapshot();
+  epoch_changes |= EPOCH_PUBLICATIONS | EPOCH_EDGES;
+  publication_handles.reserve(publication_handles.size() + batch.size());
+
+  // Every co-authorship of the batch as a (smaller handle, bigger handle) pair
+  std::vector<std::pair<AffHandle, AffHandle>> pairs;
+  std::vector<AffHandle> handles;
+  unsigned int added = 0;
+  for (const auto &data : batch)
+  {
+    if (!insert_publication(data.id, data.name, data.year, data.affiliations))
+    {
+      continue;
+    }
+    ++added;
+
+    handles.clear();
+    for (const auto &aff_id : data.affiliations)
+    {
+      AffHandle aff = find_affiliation(aff_id);
+      if (aff != NO_HANDLE)
+      {
+        handles.push_back(aff);
+      }
+    }
+    for (std::size_t i = 0; i < handles.size(); ++i)
     {
-      for (auto id1 = affiliations.begin(); id1 != affiliations.end(); ++id1)
+      for (std::size_t j = i + 1; j < handles.size(); ++j)
       {
-        auto it_aff1 = affiliations_map.find(*id1);
-        for (auto id2 = std::next(id1); id2 != affiliations.end(); ++id2)
+        if (handles[i] != handles[j])
         {
-          auto it_aff2 = affiliations_map.find(*id2);
-          auto it_aff1_connected = it_aff1->second.connected_affiliations.find(*id2);
-          auto it_aff2_connected = it_aff2->second.connected_affiliations.find(*id1);
-          if (*id1 < *id2)
-          {
-            id_smaller = *id1;
-            id_bigger = *id2;
-          }
-          else
-          {
-            id_smaller = *id2;
-            id_bigger = *id1;
-          }
-          auto it_all_connected = all_connections.find(id_smaller);
-          if (it_aff1_connected != it_aff1->second.connected_affiliations.end())
-          {
-            it_aff1_connected->second++;
-            it_aff2_connected->second++;
-            auto it_bigger_connected = it_all_connected->second.find(id_bigger);
-            if (it_bigger_connected != it_all_connected->second.end())
-            {
-              it_bigger_connected->second++;
-            }
-            else
-            {
-              it_all_connected->second.insert({id_bigger, 1});
-            }
-          }
-          else
-          {
-            it_aff1->second.connected_affiliations.insert({*id2, 1});
-            it_aff2->second.connected_affiliations.insert({*id1, 1});
-            it_all_connected->second.insert({id_bigger, 1});
-          }
+          pairs.push_back(std::minmax(handles[i], handles[j]));
         }
       }
     }
-    return true;
   }
-  return false;
+
+  // Equal pairs end up next to each other, so each edge is updated once with the total weight
+  std::sort(pairs.begin(), pairs.end());
+  for (auto run = pairs.begin(); run != pairs.end();)
+  {
+    auto run_end = std::find_if(run, pairs.end(), [&run](const auto &pair) { return pair != *run; });
+    connect_affiliations(run->first, run->second, static_cast<Weight>(run_end - run));
+    run = run_end;
+  }
+  return added;
 }
 
-std::vector<PublicationID> Datastructures::all_publications()
+std::vector<PublicationID> Datastructures::all_publications() const
 {
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->all_publications();
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->all_publications();
+  }
+
   std::vector<PublicationID> publication_ids;
-  publication_ids.reserve(publications_map.size());
-  for (const auto &publication : publications_map)
+  publication_ids.reserve(publications.size());
+  for (SlotIndex slot = 0; slot < publications.slot_count(); ++slot)
   {
-    publication_ids.push_back(publication.first);
+    if (publications.is_live(slot))
+    {
+      publication_ids.push_back(publications[slot].id);
+    }
   }
   return publication_ids;
 }
 
-Name Datastructures::get_publication_name(PublicationID id)
+Name Datastructures::get_publication_name(PublicationID id) const
 {
-  auto it = publications_map.find(id);
-  return (it != publications_map.end()) ? it->second.name : NO_NAME;
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_publication_name(id);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_publication_name(id);
+  }
+
+  const Publication *pub = find_publication(id);
+  return pub ? Name(pub->name) : NO_NAME;
 }
 
-Year Datastructures::get_publication_year(PublicationID id)
+Year Datastructures::get_publication_year(PublicationID id) const
 {
-  auto it = publications_map.find(id);
-  return (it != publications_map.end()) ? it->second.year : NO_YEAR;
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_publication_year(id);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_publication_year(id);
+  }
+
+  const Publication *pub = find_publication(id);
+  return pub ? pub->year : NO_YEAR;
 }
 
-std::vector<AffiliationID> Datastructures::get_affiliations(PublicationID id)
+std::vector<AffiliationID> Datastructures::get_affiliations(PublicationID id) const
 {
-  auto it = publications_map.find(id);
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_affiliations(id);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_affiliations(id);
+  }
+
+  const Publication *pub = find_publication(id);
 
-  if (it != publications_map.end())
+  if (pub)
   {
-    return it->second.affiliations;
+    return std::vector<AffiliationID>(pub->affiliations.begin(), pub->affiliations.end());
   }
   else
   {
@@ -261,25 +660,44 @@ std::vector<AffiliationID> Datastructures::get_affiliations(PublicationID id)
 
 bool Datastructures::add_reference(PublicationID id, PublicationID parentid)
 {
-  auto it1 = publications_map.find(id);
-  auto it2 = publications_map.find(parentid);
+  std::unique_lock<std::shared_mutex> lock(state_mutex);
+  detach_snapshot();
+  epoch_changes |= EPOCH_PUBLICATIONS;
+  auto it1 = publication_handles.find(id);
+  auto it2 = publication_handles.find(parentid);
 
-  if (it1 != publications_map.end() && it2 != publications_map.end())
+  if (it1 != publication_handles.end() && it2 != publication_handles.end())
   {
-    it1->second.parent_id = parentid;
-    it2->second.children_ids.push_back(id);
+    publications[it1->second.slot].parent = it2->second.slot;
+    publications[it2->second.slot].children.push_back(it1->second.slot);
     return true;
   }
   return false;
 }
 
-std::vector<PublicationID> Datastructures::get_direct_references(PublicationID id)
+std::vector<PublicationID> Datastructures::get_direct_references(PublicationID id) const
 {
-  auto it = publications_map.find(id);
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_direct_references(id);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_direct_references(id);
+  }
 
-  if (it != publications_map.end())
+  const Publication *pub = find_publication(id);
+
+  if (pub)
   {
-    return it->second.children_ids;
+    std::vector<PublicationID> children_ids;
+    children_ids.reserve(pub->children.size());
+    for (SlotIndex child : pub->children)
+    {
+      children_ids.push_back(publications[child].id);
+    }
+    return children_ids;
   }
   else
   {
@@ -290,65 +708,43 @@ std::vector<PublicationID> Datastructures::get_direct_references(PublicationID i
 
 bool Datastructures::add_affiliation_to_publication(AffiliationID affiliationid, PublicationID publicationid)
 {
-  auto it1 = publications_map.find(publicationid);
-  auto it2 = affiliations_map.find(affiliationid);
-  AffiliationID id_smaller;
-  AffiliationID id_bigger;
+  std::unique_lock<std::shared_mutex> lock(state_mutex);
+  detach_snapshot();
+  epoch_changes |= EPOCH_PUBLICATIONS | EPOCH_LINKS | EPOCH_EDGES;
+  Publication *pub = find_publication(publicationid);
+  AffHandle aff = find_affiliation(affiliationid);
 
-  if (it1 != publications_map.end() && it2 != affiliations_map.end())
+  if (pub && aff != NO_HANDLE)
   {
-    for (const auto &aff : it1->second.affiliations)
+    for (const auto &other : pub->affiliations)
     {
-      auto it_aff = affiliations_map.find(aff);
-      auto it_aff1_connected = it2->second.connected_affiliations.find(aff);
-      auto it_aff2_connected = it_aff->second.connected_affiliations.find(affiliationid);
-
-      if (aff < affiliationid)
-      {
-        id_smaller = aff;
-        id_bigger = affiliationid;
-      }
-      else
-      {
-        id_smaller = affiliationid;
-        id_bigger = aff;
-      }
-      auto it_all_connected = all_connections.find(id_smaller);
-      if (it_aff1_connected != it2->second.connected_affiliations.end())
-      {
-        it_aff1_connected->second++;
-        it_aff2_connected->second++;
-        auto it_bigger_connected = it_all_connected->second.find(id_bigger);
-        if (it_bigger_connected != it_all_connected->second.end())
-        {
-          it_bigger_connected->second++;
-        }
-        else
-        {
-          it_all_connected->second.insert({id_bigger, 1});
-        }
-      }
-      else
-      {
-        it2->second.connected_affiliations.insert({aff, 1});
-        it_aff->second.connected_affiliations.insert({affiliationid, 1});
-        it_all_connected->second.insert({id_bigger, 1});
-      }
+      connect_affiliations(aff, find_affiliation(AffiliationID(other)));
     }
-    it1->second.affiliations.push_back(affiliationid);
-    it2->second.publications.push_back(publicationid);
+    pub->affiliations.emplace_back(affiliationid);
+    affiliations_cold[aff].publications.push_back(publicationid);
 
     return true;
   }
   return false;
 }
 
-std::vector<PublicationID> Datastructures::get_publications(AffiliationID id)
+std::vector<PublicationID> Datastructures::get_publications(AffiliationID id) const
 {
-  auto it = affiliations_map.find(id);
-  if (it != affiliations_map.end())
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_publications(id);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_publications(id);
+  }
+
+  AffHandle aff = find_affiliation(id);
+  if (aff != NO_HANDLE)
   {
-    return it->second.publications;
+    const auto &aff_publications = affiliations_cold[aff].publications;
+    return std::vector<PublicationID>(aff_publications.begin(), aff_publications.end());
   }
   else
   {
@@ -357,22 +753,42 @@ std::vector<PublicationID> Datastructures::get_publications(AffiliationID id)
   }
 }
 
-PublicationID Datastructures::get_parent(PublicationID id)
+PublicationID Datastructures::get_parent(PublicationID id) const
 {
-  auto it = publications_map.find(id);
-  return it != publications_map.end() ? it->second.parent_id : NO_PUBLICATION;
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_parent(id);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_parent(id);
+  }
+
+  const Publication *pub = find_publication(id);
+  return (pub && pub->parent != NO_SLOT) ? publications[pub->parent].id : NO_PUBLICATION;
 }
 
-std::vector<std::pair<Year, PublicationID>> Datastructures::get_publications_after(AffiliationID affiliationid, Year year)
+std::vector<std::pair<Year, PublicationID>> Datastructures::get_publications_after(AffiliationID affiliationid, Year year) const
 {
-  auto it = affiliations_map.find(affiliationid);
-  if (it != affiliations_map.end())
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_publications_after(affiliationid, year);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_publications_after(affiliationid, year);
+  }
+
+  AffHandle aff = find_affiliation(affiliationid);
+  if (aff != NO_HANDLE)
   {
+    const auto &aff_publications = affiliations_cold[aff].publications;
     std::map<Year, std::set<PublicationID>> publications_map_sorted_year;
-    for (const auto &pub_id : it->second.publications)
+    for (const auto &pub_id : aff_publications)
     {
-      auto it_pub = publications_map.find(pub_id);
-      Year year_after = it_pub->second.year;
+      Year year_after = find_publication(pub_id)->year;
       if (year_after >= year)
       {
         auto it_year = publications_map_sorted_year.find(year_after);
@@ -387,7 +803,7 @@ std::vector<std::pair<Year, PublicationID>> Datastructures::get_publications_aft
       }
     }
     std::vector<std::pair<Year, PublicationID>> years;
-    years.reserve(it->second.publications.size());
+    years.reserve(aff_publications.size());
     for (const auto &pair : publications_map_sorted_year)
     {
       for (const PublicationID &id : pair.second)
@@ -401,472 +817,961 @@ std::vector<std::pair<Year, PublicationID>> Datastructures::get_publications_aft
   return {{NO_YEAR, NO_PUBLICATION}};
 }
 
-std::vector<PublicationID> Datastructures::get_referenced_by_chain(PublicationID id)
+std::vector<PublicationID> Datastructures::get_referenced_by_chain(PublicationID id) const
 {
-  auto it = publications_map.find(id);
-  if (it != publications_map.end())
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_referenced_by_chain(id);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_referenced_by_chain(id);
+  }
+
+  const Publication *pub = find_publication(id);
+  if (pub)
   {
     std::vector<PublicationID> parents_chain;
-    parents_chain.reserve(publications_map.size());
-    while (it->second.parent_id != NO_PUBLICATION)
+    for (SlotIndex parent = pub->parent; parent != NO_SLOT; parent = publications[parent].parent)
     {
-      PublicationID parent_id = it->second.parent_id;
-      parents_chain.push_back(parent_id);
-      it = publications_map.find(parent_id);
+      parents_chain.push_back(publications[parent].id);
     }
-    parents_chain.shrink_to_fit();
     return parents_chain;
   }
   return {NO_PUBLICATION};
 }
 
-std::vector<PublicationID> Datastructures::get_all_references(PublicationID id)
+std::vector<PublicationID> Datastructures::get_all_references(PublicationID id) const
 {
-  auto it = publications_map.find(id);
-  if (it == publications_map.end())
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_all_references(id);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_all_references(id);
+  }
+
+  auto it = publication_handles.find(id);
+  if (it == publication_handles.end())
   {
     return {NO_PUBLICATION};
   }
   std::vector<PublicationID> store;
-  store.reserve(publications_map.size());
-  postorder_traversal(id, store, true);
-  store.shrink_to_fit();
+  postorder_traversal(it->second.slot, store, true);
   return store;
 }
 
-void Datastructures::postorder_traversal(PublicationID root_id, std::vector<PublicationID> &store, bool isOriginalRoot)
+void Datastructures::postorder_traversal(SlotIndex root, std::vector<PublicationID> &store, bool isOriginalRoot) const
 {
-  auto it = publications_map.find(root_id);
-  for (const PublicationID &id : it->second.children_ids)
+  for (SlotIndex child : publications[root].children)
   {
-    postorder_traversal(id, store, false);
+    postorder_traversal(child, store, false);
   }
   if (!isOriginalRoot)
-    store.push_back(root_id);
+    store.push_back(publications[root].id);
 }
 
-std::vector<AffiliationID> Datastructures::get_affiliations_closest_to(Coord xy)
+std::vector<AffiliationID> Datastructures::get_affiliations_closest_to(Coord xy) const
 {
-  std::pair<AffiliationID, int> min_1 = {NO_AFFILIATION, INT_MAX};
-  std::pair<AffiliationID, int> min_2 = {NO_AFFILIATION, INT_MAX};
-  std::pair<AffiliationID, int> min_3 = {NO_AFFILIATION, INT_MAX};
-
-  for (const auto &it2 : affiliations_map)
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_affiliations_closest_to(xy);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
   {
-    Coord xy2 = it2.second.xy;
-    int dist_x = xy.x - xy2.x;
-    int dist_y = xy.y - xy2.y;
-    int dist = dist_x * dist_x + dist_y * dist_y;
+    return mapped->get_affiliations_closest_to(xy);
+  }
 
-    if (dist < min_1.second)
-    {
-      min_3 = min_2;
-      min_2 = min_1;
-      min_1 = {it2.first, dist};
-    }
-    else if (dist < min_2.second)
-    {
-      min_3 = min_2;
-      min_2 = {it2.first, dist};
-    }
-    else if (dist < min_3.second)
-    {
-      min_3 = {it2.first, dist};
-    }
+  // The SIMD kernels are exact only when all coordinates are within their range
+  NearestKernel kernel = nearest_best_kernel().kernel;
+  if (affiliations_outside_simd_range > 0 || !nearest_simd_coord_ok(xy.x, xy.y))
+  {
+    kernel = &nearest_scalar;
   }
 
+  NearestResult best[3];
+  std::size_t found = kernel(affiliations_x.data(), affiliations_y.data(), affiliations_x.size(), xy.x, xy.y, best, 3);
+
   std::vector<AffiliationID> closest_affs;
-  closest_affs.reserve(3);
-  if (min_1.first != NO_AFFILIATION)
-    closest_affs.push_back(min_1.first);
-  if (min_2.first != NO_AFFILIATION)
-    closest_affs.push_back(min_2.first);
-  if (min_3.first != NO_AFFILIATION)
-    closest_affs.push_back(min_3.first);
-  closest_affs.shrink_to_fit();
+  closest_affs.reserve(found);
+  for (std::size_t i = 0; i < found; ++i)
+  {
+    closest_affs.emplace_back(affiliations_cold[best[i].index].id);
+  }
 
   return closest_affs;
 }
 
 bool Datastructures::remove_affiliation(AffiliationID id)
 {
-  auto it = affiliations_map.find(id);
-  if (it == affiliations_map.end())
+  std::unique_lock<std::shared_mutex> lock(state_mutex);
+  detach_snapshot();
+  epoch_changes |= EPOCH_ALL;
+  AffHandle aff = find_affiliation(id);
+  if (aff == NO_HANDLE)
     return false;
 
-  Name name_to_delete = it->second.name;
-  auto it_name = affiliations_map_sorted_name.find(name_to_delete);
-  it_name->second.erase(id);
+  AffiliationCold &cold = affiliations_cold[aff];
+  auto it_name = affiliations_map_sorted_name.find(cold.name);
+  it_name->second.erase(it_name->second.find(std::string_view(id)));
   if (it_name->second.size() == 0)
     affiliations_map_sorted_name.erase(it_name);
 
-  affiliations_id.erase(std::remove(affiliations_id.begin(), affiliations_id.end(), id), affiliations_id.end());
+  affiliations_map_sorted_coord.erase(affiliation_coord(aff));
+  if (!nearest_simd_coord_ok(affiliations_x[aff], affiliations_y[aff]))
+    affiliations_outside_simd_range--;
 
-  Coord coord_to_delete = it->second.xy;
-  auto it_coord = affiliations_map_sorted_coord.find(coord_to_delete);
-  affiliations_map_sorted_coord.erase(it_coord);
+  for (const PublicationID &id_pub : cold.publications)
+  {
+    auto &affiliations_vect = find_publication(id_pub)->affiliations;
+    affiliations_vect.erase(std::find(affiliations_vect.begin(), affiliations_vect.end(), std::string_view(id)));
+  }
 
-  std::vector<PublicationID> publication_to_deattach = it->second.publications;
-  for (const PublicationID &id_pub : publication_to_deattach)
+  disconnect_affiliation(aff);
+
+  // Move the last affiliation into the freed handle so that the arrays stay dense
+  AffHandle last = static_cast<AffHandle>(affiliations_cold.size() - 1);
+  if (aff != last)
   {
-    auto it_pub = publications_map.find(id_pub);
-    std::vector<AffiliationID> affiliations_vect = it_pub->second.affiliations;
-    auto it_aff_to_del = std::find(affiliations_vect.begin(), affiliations_vect.end(), id);
-    affiliations_vect.erase(it_aff_to_del);
-    affiliations_vect.shrink_to_fit();
-    it_pub->second.affiliations.clear();
-    it_pub->second.affiliations = affiliations_vect;
-    it_pub->second.affiliations.shrink_to_fit();
+    affiliations_x[aff] = affiliations_x[last];
+    affiliations_y[aff] = affiliations_y[last];
+    affiliations_degree[aff] = affiliations_degree[last];
+    affiliations_cold[aff] = std::move(affiliations_cold[last]);
+    affiliation_handles.find(affiliations_cold[aff].id)->second = aff;
+    for (EdgeIndex edge : affiliations_cold[aff].incident_edges)
+    {
+      Edge &moved = edges[edge];
+      (moved.aff1 == last ? moved.aff1 : moved.aff2) = aff;
+    }
   }
+  affiliations_x.pop_back();
+  affiliations_y.pop_back();
+  affiliations_degree.pop_back();
+  affiliations_cold.pop_back();
+  affiliation_handles.erase(affiliation_handles.find(std::pmr::string(id)));
 
   affiliations_name_sorted = false;
   affiliations_coord_sorted = false;
-  affiliations_map.erase(it);
 
   return true;
 }
 
-PublicationID Datastructures::get_closest_common_parent(PublicationID id1, PublicationID id2)
+PublicationID Datastructures::get_closest_common_parent(PublicationID id1, PublicationID id2) const
 {
-  auto it1 = publications_map.find(id1);
-  auto it2 = publications_map.find(id2);
-  if (it1 != publications_map.end() && it2 != publications_map.end())
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
   {
-    std::unordered_set<PublicationID> parents_chain_id1;
-    while (it1->second.parent_id != NO_PUBLICATION)
-    {
-      PublicationID parent_id1 = it1->second.parent_id;
-      parents_chain_id1.insert(parent_id1);
-      it1 = publications_map.find(parent_id1);
-    }
-    while (it2->second.parent_id != NO_PUBLICATION)
-    {
-      PublicationID parent_id2 = it2->second.parent_id;
-      auto it_parent = parents_chain_id1.find(parent_id2);
-      if (it_parent != parents_chain_id1.end())
+    return published->get_closest_common_parent(id1, id2);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_closest_common_parent(id1, id2);
+  }
+
+  const Publication *pub1 = find_publication(id1);
+  const Publication *pub2 = find_publication(id2);
+  if (pub1 && pub2)
+  {
+    std::unordered_set<SlotIndex> parents_chain_id1;
+    for (SlotIndex parent = pub1->parent; parent != NO_SLOT; parent = publications[parent].parent)
+    {
+      parents_chain_id1.insert(parent);
+    }
+    for (SlotIndex parent = pub2->parent; parent != NO_SLOT; parent = publications[parent].parent)
+    {
+      if (parents_chain_id1.find(parent) != parents_chain_id1.end())
       {
-        return *it_parent;
+        return publications[parent].id;
       }
-      it2 = publications_map.find(parent_id2);
     }
-    parents_chain_id1.clear();
   }
   return NO_PUBLICATION;
 }
 
 bool Datastructures::remove_publication(PublicationID publicationid)
 {
-  auto it = publications_map.find(publicationid);
-  if (it == publications_map.end())
+  std::unique_lock<std::shared_mutex> lock(state_mutex);
+  detach_snapshot();
+  epoch_changes |= EPOCH_PUBLICATIONS | EPOCH_LINKS;
+  auto it = publication_handles.find(publicationid);
+  if (it == publication_handles.end())
     return false;
 
-  PublicationID parent_id = it->second.parent_id;
-  if (parent_id != NO_PUBLICATION)
+  SlotIndex slot = it->second.slot;
+  Publication &pub = publications[slot];
+  if (pub.parent != NO_SLOT)
   {
-    auto it_parent = publications_map.find(parent_id);
-    std::vector<PublicationID> children_vect = it_parent->second.children_ids;
-    auto it_pub_to_del = std::find(children_vect.begin(), children_vect.end(), publicationid);
-    children_vect.erase(it_pub_to_del);
-    children_vect.shrink_to_fit();
-    it_parent->second.children_ids.clear();
-    it_parent->second.children_ids = children_vect;
-    it_parent->second.children_ids.shrink_to_fit();
+    auto &siblings = publications[pub.parent].children;
+    siblings.erase(std::find(siblings.begin(), siblings.end(), slot));
   }
 
-  std::vector<PublicationID> children = it->second.children_ids;
-  for (const PublicationID &child_id : children)
+  for (SlotIndex child : pub.children)
   {
-    auto it_child = publications_map.find(child_id);
-    it_child->second.parent_id = NO_PUBLICATION;
+    publications[child].parent = NO_SLOT;
   }
 
-  std::vector<AffiliationID> aff_to_deattach = it->second.affiliations;
-  for (const AffiliationID &id_aff : aff_to_deattach)
+  for (const auto &id_aff : pub.affiliations)
   {
-    auto it_aff = affiliations_map.find(id_aff);
-    std::vector<PublicationID> publications_vect = it_aff->second.publications;
-    auto it_pub_to_del = std::find(publications_vect.begin(), publications_vect.end(), publicationid);
-    publications_vect.erase(it_pub_to_del);
-    publications_vect.shrink_to_fit();
-    it_aff->second.publications.clear();
-    it_aff->second.publications = publications_vect;
-    it_aff->second.publications.shrink_to_fit();
+    AffHandle aff = find_affiliation(AffiliationID(id_aff));
+    if (aff == NO_HANDLE)
+      continue;
+    auto &publications_vect = affiliations_cold[aff].publications;
+    // Publications added with an affiliation list are not listed in the affiliation itself
+    auto it_pub = std::find(publications_vect.begin(), publications_vect.end(), publicationid);
+    if (it_pub != publications_vect.end())
+      publications_vect.erase(it_pub);
   }
 
-  publications_map.erase(it);
+  year_index_erase(pub.year, publicationid);
+  publications.erase(it->second);
+  publication_handles.erase(it);
+
+  return true;
+}
+
+Datastructures::Publication *Datastructures::find_publication(PublicationID id)
+{
+  auto it = publication_handles.find(id);
+  return it != publication_handles.end() ? publications.get(it->second) : nullptr;
+}
+
+Datastructures::Publication const *Datastructures::find_publication(PublicationID id) const
+{
+  auto it = publication_handles.find(id);
+  return it != publication_handles.end() ? publications.get(it->second) : nullptr;
+}
+
+bool Datastructures::insert_publication(PublicationID id, const Name &name, Year year, const std::vector<AffiliationID> &affiliations)
+{
+  if (publication_handles.find(id) != publication_handles.end())
+  {
+    return false;
+  }
 
+  Publication pub(&arena);
+  pub.id = id;
+  pub.name = name;
+  pub.year = year;
+  pub.affiliations.assign(affiliations.begin(), affiliations.end());
+  publication_handles.emplace(id, publications.insert(std::move(pub)));
+  year_index_insert(year, id);
   return true;
 }
 
-std::vector<Connection> Datastructures::get_connected_affiliations(AffiliationID id)
+std::vector<Connection> Datastructures::get_connected_affiliations(AffiliationID id) const
 {
-  auto it = affiliations_map.find(id);
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_connected_affiliations(id);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_connected_affiliations(id);
+  }
+
+  AffHandle aff = find_affiliation(id);
   std::vector<Connection> connections;
-  if (it != affiliations_map.end())
+  if (aff != NO_HANDLE)
   {
-    connections.reserve(it->second.connected_affiliations.size());
-    for (const auto &aff : it->second.connected_affiliations)
+    connections.reserve(affiliations_degree[aff]);
+    for (EdgeIndex edge : affiliations_cold[aff].incident_edges)
     {
-      connections.push_back({id, aff.first, aff.second});
+      connections.push_back({id, AffiliationID(affiliations_cold[edges[edge].other_end(aff)].id), edges[edge].weight});
     }
     return connections;
   }
   return {};
 }
 
-std::vector<Connection> Datastructures::get_all_connections()
+std::vector<Connection> Datastructures::get_all_connections() const
 {
   std::vector<Connection> connections;
-  for (const auto &aff : all_connections)
+  auto collect = [&connections](std::string_view aff1, std::string_view aff2, Weight weight) {
+    connections.push_back({AffiliationID(aff1), AffiliationID(aff2), weight});
+  };
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
   {
-    std::unordered_map<AffiliationID, Weight> connected_affs = aff.second;
-    for (const auto &aff2 : connected_affs)
-    {
-      connections.push_back({aff.first, aff2.first, aff2.second});
-    }
+    published->visit_all_connections(collect);
+    return connections;
   }
+
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  connections.reserve(edges.size());
+  visit_connections(collect);
   return connections;
 }
 
-Path Datastructures::get_any_path(AffiliationID source, AffiliationID target)
+void Datastructures::visit_all_connections(const ConnectionVisitor &visitor) const
+{
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->visit_all_connections(visitor);
+  }
+
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  visit_connections(visitor);
+}
+
+void Datastructures::visit_connections(const ConnectionVisitor &visitor) const
 {
-  std::vector<AffiliationID> path_nodes;
-  std::unordered_set<AffiliationID> path_nodes_set;
-  std::vector<AffiliationID> path_vector = dfs(source, target, path_nodes, path_nodes_set);
-  Path path;
-  path.reserve(path_vector.size());
+  if (mapped)
+  {
+    return mapped->visit_all_connections(visitor);
+  }
 
-  if (path_vector.size() > 1)
+  for (const Edge &edge : edges)
   {
-    for (auto it = path_vector.begin(); it + 1 != path_vector.end(); ++it)
+    std::string_view id1 = affiliations_cold[edge.aff1].id;
+    std::string_view id2 = affiliations_cold[edge.aff2].id;
+    if (id1 < id2)
     {
-      AffiliationID first = *it;
-      AffiliationID second = *(it + 1);
-      auto it_aff = affiliations_map.find(first);
-      auto it_connection = it_aff->second.connected_affiliations.find(second);
-      path.push_back({first, second, it_connection->second});
+      visitor(id1, id2, edge.weight);
+    }
+    else
+    {
+      visitor(id2, id1, edge.weight);
     }
-    return path;
   }
+}
 
-  return {};
+// The in-memory graph as seen by the path searches
+struct Datastructures::GraphView
+{
+  const Datastructures &ds;
+
+  std::size_t node_count() const { return ds.affiliations_cold.size(); }
+  const std::pmr::vector<EdgeIndex> &incident_edges(AffHandle aff) const { return ds.affiliations_cold[aff].incident_edges; }
+  AffHandle other_end(EdgeIndex edge, AffHandle aff) const { return ds.edges[edge].other_end(aff); }
+  Weight weight(EdgeIndex edge) const { return ds.edges[edge].weight; }
+  Coord coord(AffHandle aff) const { return ds.affiliation_coord(aff); }
+  std::string_view id(AffHandle aff) const { return ds.affiliations_cold[aff].id; }
+};
+
+Path Datastructures::get_any_path(AffiliationID source, AffiliationID target) const
+{
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_any_path(source, target);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_any_path(source, target);
+  }
+
+  AffHandle source_aff = find_affiliation(source);
+  AffHandle target_aff = find_affiliation(target);
+  if (source_aff == NO_HANDLE || target_aff == NO_HANDLE)
+  {
+    return {};
+  }
+  return pathsearch::any_path(GraphView{*this}, source_aff, target_aff);
 }
 
-std::vector<AffiliationID> Datastructures::dfs(AffiliationID source, AffiliationID target, std::vector<AffiliationID> &path_nodes, std::unordered_set<AffiliationID> &path_nodes_set)
+Path Datastructures::get_path_with_least_affiliations(AffiliationID source, AffiliationID target) const
 {
-  path_nodes.push_back(source);
-  path_nodes_set.insert(source);
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_path_with_least_affiliations(source, target);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_path_with_least_affiliations(source, target);
+  }
+
+  AffHandle source_aff = find_affiliation(source);
+  AffHandle target_aff = find_affiliation(target);
+  if (source_aff == NO_HANDLE || target_aff == NO_HANDLE)
+  {
+    return {};
+  }
+  return pathsearch::path_with_least_nodes(GraphView{*this}, source_aff, target_aff);
+}
+
+Path Datastructures::get_path_of_least_friction(AffiliationID source, AffiliationID target) const
+{
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_path_of_least_friction(source, target);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_path_of_least_friction(source, target);
+  }
 
-  if (source == target)
+  AffHandle source_aff = find_affiliation(source);
+  AffHandle target_aff = find_affiliation(target);
+  if (source_aff == NO_HANDLE || target_aff == NO_HANDLE)
   {
-    return path_nodes;
+    return {};
   }
+  return pathsearch::path_of_least_friction(GraphView{*this}, source_aff, target_aff);
+}
 
-  auto it = affiliations_map.find(source);
-  auto it_target = affiliations_map.find(target);
-  if (it == affiliations_map.end() || it_target == affiliations_map.end())
+PathWithDist Datastructures::get_shortest_path(AffiliationID source, AffiliationID target) const
+{
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_shortest_path(source, target);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_shortest_path(source, target);
+  }
+
+  AffHandle source_aff = find_affiliation(source);
+  AffHandle target_aff = find_affiliation(target);
+  if (source_aff == NO_HANDLE || target_aff == NO_HANDLE)
   {
     return {};
   }
+  return pathsearch::shortest_path(GraphView{*this}, source_aff, target_aff);
+}
+
+Datastructures::AffHandle Datastructures::find_affiliation(AffiliationID const &id) const
+{
+  // Lookup keys are short-lived, so they are built outside the arena
+  auto it = affiliation_handles.find(std::pmr::string(id));
+  return it != affiliation_handles.end() ? it->second : NO_HANDLE;
+}
 
-  for (const auto &aff : it->second.connected_affiliations)
+void Datastructures::connect_affiliations(AffHandle aff1, AffHandle aff2, Weight increment)
+{
+  if (aff1 == NO_HANDLE || aff2 == NO_HANDLE || aff1 == aff2)
   {
-    auto it_aff = path_nodes_set.find(aff.first);
-    if (it_aff == path_nodes_set.end())
-    {
-      std::vector<AffiliationID> new_path_nodes = dfs(aff.first, target, path_nodes, path_nodes_set);
-      if (new_path_nodes.size() > 0)
-        return new_path_nodes;
-    }
+    return;
   }
 
-  path_nodes.pop_back();
+  EdgeIndex edge = find_edge(aff1, aff2);
+  if (edge != NO_EDGE)
+  {
+    edges[edge].weight += increment;
+    return;
+  }
 
-  return {};
+  edge = static_cast<EdgeIndex>(edges.size());
+  edges.push_back({aff1, aff2, increment});
+  affiliations_cold[aff1].incident_edges.push_back(edge);
+  affiliations_cold[aff2].incident_edges.push_back(edge);
+  affiliations_degree[aff1]++;
+  affiliations_degree[aff2]++;
 }
 
-Path Datastructures::get_path_with_least_affiliations(AffiliationID source, AffiliationID target)
+void Datastructures::disconnect_affiliation(AffHandle aff)
 {
-  Path path;
-  std::unordered_map<AffiliationID, AffiliationID> visited;
-  std::queue<AffiliationID> queue;
-  std::deque<AffiliationID> path_deque;
+  while (!affiliations_cold[aff].incident_edges.empty())
+  {
+    remove_edge(affiliations_cold[aff].incident_edges.back());
+  }
+}
 
-  auto it_source = affiliations_map.find(source);
-  if (it_source != affiliations_map.end())
+Datastructures::EdgeIndex Datastructures::find_edge(AffHandle aff1, AffHandle aff2) const
+{
+  // Scan the shorter of the two incident lists
+  if (affiliations_degree[aff2] < affiliations_degree[aff1])
   {
-    visited.insert({source, NO_AFFILIATION});
-    queue.push(source);
-    while (!queue.empty())
+    std::swap(aff1, aff2);
+  }
+  for (EdgeIndex edge : affiliations_cold[aff1].incident_edges)
+  {
+    if (edges[edge].other_end(aff1) == aff2)
     {
-      AffiliationID queue_front = queue.front();
-      queue.pop();
-      auto it_queue_front = affiliations_map.find(queue_front);
-      for (const auto &aff : it_queue_front->second.connected_affiliations)
-      {
-        if (visited.find(aff.first) == visited.end())
-        {
-          queue.push(aff.first);
-          visited.insert({aff.first, queue_front});
-        }
-      }
+      return edge;
     }
-    auto it_target = visited.find(target);
-    if (it_target == visited.end())
+  }
+  return NO_EDGE;
+}
+
+void Datastructures::remove_edge(EdgeIndex edge)
+{
+  auto unlink = [this](AffHandle aff, EdgeIndex old_index, EdgeIndex new_index) {
+    auto &incident = affiliations_cold[aff].incident_edges;
+    auto it = std::find(incident.begin(), incident.end(), old_index);
+    if (new_index == NO_EDGE)
     {
-      return {};
+      *it = incident.back();
+      incident.pop_back();
+      affiliations_degree[aff]--;
     }
-    path_deque.push_front(target);
-    AffiliationID prenode = it_target->second;
-    while (prenode != NO_AFFILIATION)
+    else
     {
-      path_deque.push_front(prenode);
-      auto it_prenode = visited.find(prenode);
-      prenode = it_prenode->second;
+      *it = new_index;
     }
-    if (path_deque.size() > 1)
+  };
+
+  unlink(edges[edge].aff1, edge, NO_EDGE);
+  unlink(edges[edge].aff2, edge, NO_EDGE);
+
+  // Move the last edge into the hole and repoint its endpoints
+  EdgeIndex last = static_cast<EdgeIndex>(edges.size() - 1);
+  if (edge != last)
+  {
+    edges[edge] = edges[last];
+    unlink(edges[edge].aff1, last, edge);
+    unlink(edges[edge].aff2, last, edge);
+  }
+  edges.pop_back();
+}
+
+unsigned int Datastructures::count_publications_in_years(Year from, Year to) const
+{
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->count_publications_in_years(from, to);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->count_publications_in_years(from, to);
+  }
+
+  if (from > to || publications_year_tree.empty())
+  {
+    return 0;
+  }
+  return year_index_prefix(std::size_t(to) + 1) - year_index_prefix(from);
+}
+
+std::vector<std::pair<Year, PublicationID>> Datastructures::get_publications_in_years(Year from, Year to) const
+{
+  if (std::shared_ptr<MappedSnapshot const> published = current_epoch())
+  {
+    return published->get_publications_in_years(from, to);
+  }
+  std::shared_lock<std::shared_mutex> lock(state_mutex);
+  if (mapped)
+  {
+    return mapped->get_publications_in_years(from, to);
+  }
+
+  std::vector<std::pair<Year, PublicationID>> publications;
+  if (from > to || from >= publications_by_year.size())
+  {
+    return publications;
+  }
+  std::size_t last = std::min<std::size_t>(to, publications_by_year.size() - 1);
+  year_index_sort(from, last + 1);
+  publications.reserve(year_index_prefix(last + 1) - year_index_prefix(from));
+  for (std::size_t year = from; year <= last; ++year)
+  {
+    for (const PublicationID &id : publications_by_year[year])
     {
-      for (auto it = path_deque.begin(); it + 1 != path_deque.end(); ++it)
-      {
-        AffiliationID first = *it;
-        AffiliationID second = *(it + 1);
-        auto it_aff = affiliations_map.find(first);
-        auto it_connection = it_aff->second.connected_affiliations.find(second);
-        path.push_back({first, second, it_connection->second});
-      }
-      return path;
+      publications.push_back({static_cast<Year>(year), id});
     }
   }
-  return {};
+  return publications;
 }
 
-Path Datastructures::get_path_of_least_friction(AffiliationID source, AffiliationID target)
+void Datastructures::year_index_insert(Year year, PublicationID id)
 {
-  Path path;
-  std::unordered_map<AffiliationID, std::pair<AffiliationID, int>> visited;
-  std::queue<AffiliationID> queue;
-  std::deque<AffiliationID> path_deque;
+  if (year >= publications_by_year.size())
+  {
+    publications_by_year.resize(std::size_t(year) + 1);
+    year_bucket_unsorted.resize(std::size_t(year) + 1, 0);
+  }
+  if (std::size_t(year) + 1 >= publications_year_tree.size())
+  {
+    std::size_t const year_limit = std::size_t(std::numeric_limits<Year>::max()) + 1;
+    year_index_build_tree(std::min(std::max(2 * publications_year_tree.size(), std::size_t(year) + 2), year_limit + 1));
+  }
 
-  auto it_source = affiliations_map.find(source);
-  if (it_source != affiliations_map.end())
+  auto &bucket = publications_by_year[year];
+  bucket.push_back(id);
+  if (!year_bucket_unsorted[year] && bucket.size() > 1 && bucket[bucket.size() - 2] > id)
   {
-    queue.push(source);
-    visited.insert({source, {NO_AFFILIATION, INT_MAX}});
-    while (!queue.empty())
+    year_bucket_unsorted[year] = 1;
+    ++year_buckets_unsorted;
+  }
+  for (std::size_t i = std::size_t(year) + 1; i < publications_year_tree.size(); i += i & -i)
+  {
+    publications_year_tree[i]++;
+  }
+}
+
+void Datastructures::year_index_erase(Year year, PublicationID id)
+{
+  // Erasing keeps the order, so a sorted bucket stays sorted
+  auto &bucket = publications_by_year[year];
+  auto it = std::find(bucket.begin(), bucket.end(), id);
+  if (it == bucket.end())
+  {
+    return;
+  }
+  bucket.erase(it);
+
+  for (std::size_t i = std::size_t(year) + 1; i < publications_year_tree.size(); i += i & -i)
+  {
+    publications_year_tree[i]--;
+  }
+}
+
+void Datastructures::year_index_build_tree(std::size_t size)
+{
+  // Bucket sizes in place, then each node adds its sum to the next node covering it
+  publications_year_tree.assign(size, 0);
+  for (std::size_t year = 0; year < publications_by_year.size() && year + 1 < size; ++year)
+  {
+    publications_year_tree[year + 1] = static_cast<unsigned int>(publications_by_year[year].size());
+  }
+  for (std::size_t i = 1; i < size; ++i)
+  {
+    std::size_t next = i + (i & -i);
+    if (next < size)
     {
-      AffiliationID queue_front = queue.front();
-      queue.pop();
-      auto it_queue_front = affiliations_map.find(queue_front);
-      int weight_from_origin = visited.find(queue_front)->second.second;
-      for (const auto &aff : it_queue_front->second.connected_affiliations)
-      {
-        int min_weight = weight_from_origin > aff.second ? aff.second : weight_from_origin;
-        auto it_adj = visited.find(aff.first);
-        if (it_adj == visited.end())
-        {
-          queue.push(aff.first);
-          visited.insert({aff.first, {queue_front, min_weight}});
-        }
-        else if (it_adj->second.second < min_weight)
-        {
-          it_adj->second.first = queue_front;
-          it_adj->second.second = min_weight;
-        }
-      }
+      publications_year_tree[next] += publications_year_tree[i];
     }
-    auto it_target = visited.find(target);
-    if (it_target == visited.end())
+  }
+}
+
+void Datastructures::year_index_sort(std::size_t first, std::size_t last) const
+{
+  if (year_buckets_unsorted.load(std::memory_order_acquire) == 0)
+  {
+    return;
+  }
+  std::lock_guard<std::mutex> cache_lock(sorted_cache_mutex);
+  for (std::size_t year = first; year < last; ++year)
+  {
+    if (year_bucket_unsorted[year])
     {
-      return {};
+      std::sort(publications_by_year[year].begin(), publications_by_year[year].end());
+      year_bucket_unsorted[year] = 0;
+      year_buckets_unsorted.fetch_sub(1, std::memory_order_release);
     }
-    path_deque.push_front(target);
-    AffiliationID prenode = it_target->second.first;
-    while (prenode != NO_AFFILIATION)
+  }
+}
+
+unsigned int Datastructures::year_index_prefix(std::size_t end) const
+{
+  // Number of indexed publications with year < end
+  unsigned int count = 0;
+  if (publications_year_tree.empty())
+  {
+    return count;
+  }
+  for (std::size_t i = std::min(end, publications_year_tree.size() - 1); i > 0; i -= i & -i)
+  {
+    count += publications_year_tree[i];
+  }
+  return count;
+}
+
+bool Datastructures::save_snapshot(const std::string &filename, bool with_year_index)
+{
+  std::unique_lock<std::shared_mutex> lock(state_mutex);
+  detach_snapshot();
+  std::ofstream file(filename, std::ios::binary);
+  if (!file)
+  {
+    return false;
+  }
+  return write_snapshot(file, with_year_index);
+}
+
+bool Datastructures::write_snapshot(std::ostream &output, bool with_year_index, SnapshotReader const *unchanged,
+                                    unsigned int changes) const
+{
+  SnapshotWriter writer(output);
+  if (!unchanged)
+  {
+    changes = EPOCH_ALL;
+  }
+  auto copy = [&writer, unchanged](SnapshotSection section) {
+    writer.write_section(section, unchanged->section_bytes(section), unchanged->header().section_size[section]);
+  };
+
+  // Affiliations
+  std::size_t aff_count = affiliations_cold.size();
+  if (changes & EPOCH_AFFILIATIONS)
+  {
+    writer.write_section(SNAPSHOT_AFF_X, affiliations_x.data(), aff_count * sizeof(std::int32_t));
+    writer.write_section(SNAPSHOT_AFF_Y, affiliations_y.data(), aff_count * sizeof(std::int32_t));
+    write_snapshot_lists<char>(writer, SNAPSHOT_AFF_ID_OFFSETS, SNAPSHOT_AFF_ID_CHARS, affiliations_cold,
+                               [](const AffiliationCold &aff) -> const auto & { return aff.id; });
+    write_snapshot_lists<char>(writer, SNAPSHOT_AFF_NAME_OFFSETS, SNAPSHOT_AFF_NAME_CHARS, affiliations_cold,
+                               [](const AffiliationCold &aff) -> const auto & { return aff.name; });
+  }
+  else
+  {
+    for (SnapshotSection section : {SNAPSHOT_AFF_X, SNAPSHOT_AFF_Y, SNAPSHOT_AFF_ID_OFFSETS, SNAPSHOT_AFF_ID_CHARS,
+                                    SNAPSHOT_AFF_NAME_OFFSETS, SNAPSHOT_AFF_NAME_CHARS})
     {
-      path_deque.push_front(prenode);
-      auto it_prenode = visited.find(prenode);
-      prenode = it_prenode->second.first;
+      copy(section);
     }
-    if (path_deque.size() > 1)
+  }
+  if (changes & EPOCH_LINKS)
+  {
+    write_snapshot_lists<std::uint64_t>(writer, SNAPSHOT_AFF_PUB_OFFSETS, SNAPSHOT_AFF_PUBS, affiliations_cold,
+                                        [](const AffiliationCold &aff) -> const auto & { return aff.publications; });
+  }
+  else
+  {
+    copy(SNAPSHOT_AFF_PUB_OFFSETS);
+    copy(SNAPSHOT_AFF_PUBS);
+  }
+  if (changes & EPOCH_EDGES)
+  {
+    write_snapshot_lists<std::uint32_t>(writer, SNAPSHOT_AFF_EDGE_OFFSETS, SNAPSHOT_AFF_EDGES, affiliations_cold,
+                                        [](const AffiliationCold &aff) -> const auto & { return aff.incident_edges; });
+    writer.write_section(SNAPSHOT_EDGES, edges.data(), edges.size() * sizeof(SnapshotEdge));
+  }
+  else
+  {
+    copy(SNAPSHOT_AFF_EDGE_OFFSETS);
+    copy(SNAPSHOT_AFF_EDGES);
+    copy(SNAPSHOT_EDGES);
+  }
+
+  std::vector<std::uint32_t> order;
+  if (changes & EPOCH_AFFILIATIONS)
+  {
+    order.reserve(aff_count);
+    for (const auto &name : affiliations_map_sorted_name)
     {
-      for (auto it = path_deque.begin(); it + 1 != path_deque.end(); ++it)
+      for (const auto &id : name.second)
       {
-        AffiliationID first = *it;
-        AffiliationID second = *(it + 1);
-        auto it_aff = affiliations_map.find(first);
-        auto it_connection = it_aff->second.connected_affiliations.find(second);
-        path.push_back({first, second, it_connection->second});
+        order.push_back(affiliation_handles.find(id)->second);
       }
-      return path;
     }
+    writer.section(SNAPSHOT_AFF_BY_NAME, order);
+    order.clear();
+    for (const auto &coord : affiliations_map_sorted_coord)
+    {
+      order.push_back(affiliation_handles.find(coord.second)->second);
+    }
+    writer.section(SNAPSHOT_AFF_BY_COORD, order);
+    order.resize(aff_count);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](std::uint32_t aff1, std::uint32_t aff2) {
+      return affiliations_cold[aff1].id < affiliations_cold[aff2].id;
+    });
+    writer.section(SNAPSHOT_AFF_BY_ID, order);
+  }
+  else
+  {
+    copy(SNAPSHOT_AFF_BY_NAME);
+    copy(SNAPSHOT_AFF_BY_COORD);
+    copy(SNAPSHOT_AFF_BY_ID);
   }
-  return {};
-}
 
-PathWithDist Datastructures::get_shortest_path(AffiliationID source, AffiliationID target)
-{
-  PathWithDist pathWithDist;
-  std::unordered_map<AffiliationID, std::pair<AffiliationID, int>> visited;
-  std::queue<AffiliationID> queue;
-  std::deque<AffiliationID> path_deque;
+  std::uint32_t flags = with_year_index ? SNAPSHOT_HAS_YEAR_INDEX : 0;
+  std::size_t pub_count = publications.size();
+  if (!(changes & EPOCH_PUBLICATIONS) && (unchanged->header().flags & SNAPSHOT_HAS_YEAR_INDEX) == flags)
+  {
+    for (std::uint32_t section = SNAPSHOT_PUB_IDS; section < SNAPSHOT_SECTION_COUNT; ++section)
+    {
+      copy(static_cast<SnapshotSection>(section));
+    }
+    return writer.finish(flags, aff_count, pub_count, edges.size());
+  }
 
-  auto it_source = affiliations_map.find(source);
-  if (it_source != affiliations_map.end())
+  // Publications, numbered by their order in the slot map so that holes are dropped
+  std::vector<SlotIndex> live_slots;
+  std::vector<std::uint32_t> index_of_slot(publications.slot_count(), SNAPSHOT_NONE);
+  live_slots.reserve(publications.size());
+  for (SlotIndex slot = 0; slot < publications.slot_count(); ++slot)
   {
-    queue.push(source);
-    visited.insert({source, {NO_AFFILIATION, 0}});
-    while (!queue.empty())
+    if (publications.is_live(slot))
     {
-      AffiliationID queue_front = queue.front();
-      queue.pop();
-      int dist_from_origin = visited.find(queue_front)->second.second;
-      auto it_queue_front = affiliations_map.find(queue_front);
-      for (const auto &aff : it_queue_front->second.connected_affiliations)
-      {
-        Affiliation start_node = it_queue_front->second;
-        Affiliation end_node = affiliations_map.find(aff.first)->second;
-        int distance = dist_from_origin + floor(sqrt(pow((start_node.xy.x - end_node.xy.x), 2) + pow((start_node.xy.y - end_node.xy.y), 2)));
-        auto it_adj = visited.find(aff.first);
-        if (it_adj == visited.end())
-        {
-          queue.push(aff.first);
-          visited.insert({aff.first, {queue_front, distance}});
-        }
-        else if (it_adj->second.second > distance)
-        {
-          it_adj->second.first = queue_front;
-          it_adj->second.second = distance;
-        }
-      }
+      index_of_slot[slot] = static_cast<std::uint32_t>(live_slots.size());
+      live_slots.push_back(slot);
     }
-    auto it_target = visited.find(target);
-    if (it_target == visited.end())
+  }
+
+  std::vector<std::uint64_t> pub_ids(pub_count);
+  std::vector<std::uint16_t> pub_years(pub_count);
+  std::vector<std::uint32_t> pub_parents(pub_count);
+  std::vector<std::uint64_t> pub_aff_offsets(1, 0);
+  std::vector<std::uint64_t> pub_aff_id_offsets(1, 0);
+  std::vector<char> pub_aff_id_chars;
+  for (std::size_t i = 0; i < pub_count; ++i)
+  {
+    const Publication &pub = publications[live_slots[i]];
+    pub_ids[i] = pub.id;
+    pub_years[i] = pub.year;
+    pub_parents[i] = pub.parent != NO_SLOT ? index_of_slot[pub.parent] : SNAPSHOT_NONE;
+    for (const auto &aff_id : pub.affiliations)
     {
-      return {};
+      pub_aff_id_chars.insert(pub_aff_id_chars.end(), aff_id.begin(), aff_id.end());
+      pub_aff_id_offsets.push_back(pub_aff_id_chars.size());
     }
-    path_deque.push_front(target);
-    AffiliationID prenode = it_target->second.first;
-    while (prenode != NO_AFFILIATION)
+    pub_aff_offsets.push_back(pub_aff_id_offsets.size() - 1);
+  }
+  writer.section(SNAPSHOT_PUB_IDS, pub_ids);
+  writer.section(SNAPSHOT_PUB_YEARS, pub_years);
+  writer.section(SNAPSHOT_PUB_PARENTS, pub_parents);
+  write_snapshot_lists<char>(writer, SNAPSHOT_PUB_NAME_OFFSETS, SNAPSHOT_PUB_NAME_CHARS, live_slots,
+                             [this](SlotIndex slot) -> const auto & { return publications[slot].name; });
+  writer.section(SNAPSHOT_PUB_AFF_OFFSETS, pub_aff_offsets);
+  writer.section(SNAPSHOT_PUB_AFF_ID_OFFSETS, pub_aff_id_offsets);
+  writer.section(SNAPSHOT_PUB_AFF_ID_CHARS, pub_aff_id_chars);
+
+  std::vector<std::uint32_t> children;
+  write_snapshot_lists<std::uint32_t>(writer, SNAPSHOT_PUB_CHILD_OFFSETS, SNAPSHOT_PUB_CHILDREN, live_slots,
+                                      [this, &children, &index_of_slot](SlotIndex slot) -> const auto & {
+                                        children.clear();
+                                        for (SlotIndex child : publications[slot].children)
+                                        {
+                                          children.push_back(index_of_slot[child]);
+                                        }
+                                        return children;
+                                      });
+
+  order.resize(pub_count);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&pub_ids](std::uint32_t pub1, std::uint32_t pub2) {
+    return pub_ids[pub1] < pub_ids[pub2];
+  });
+  writer.section(SNAPSHOT_PUB_BY_ID, order);
+
+  // Year index
+  if (with_year_index)
+  {
+    year_index_sort(0, publications_by_year.size());
+    write_snapshot_lists<std::uint64_t>(writer, SNAPSHOT_YEAR_OFFSETS, SNAPSHOT_YEAR_PUBS, publications_by_year,
+                                        [](const auto &bucket) -> const auto & { return bucket; });
+    writer.write_section(SNAPSHOT_YEAR_TREE, publications_year_tree.data(), publications_year_tree.size() * sizeof(std::uint32_t));
+  }
+
+  return writer.finish(flags, aff_count, pub_count, edges.size());
+}
+
+bool Datastructures::load_snapshot(const std::string &filename)
+{
+  std::unique_lock<std::shared_mutex> lock(state_mutex);
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  if (!file)
+  {
+    return false;
+  }
+  std::streamoff size = file.tellg();
+  file.seekg(0);
+
+  // Read into 64-bit words so that the sections are suitably aligned
+  std::vector<std::uint64_t> buffer((static_cast<std::size_t>(size) + 7) / 8);
+  if (!file.read(reinterpret_cast<char *>(buffer.data()), size))
+  {
+    return false;
+  }
+  return load_snapshot(SnapshotReader(reinterpret_cast<char const *>(buffer.data()), static_cast<std::size_t>(size)));
+}
+
+bool Datastructures::load_snapshot(const SnapshotReader &snapshot)
+{
+  static_assert(std::is_trivially_copyable<Edge>::value && sizeof(Edge) == sizeof(SnapshotEdge),
+                "Edges are copied to and from snapshots as a whole");
+  static_assert(sizeof(PublicationID) == sizeof(std::uint64_t) && sizeof(Year) == sizeof(std::uint16_t)
+                && sizeof(Weight) == sizeof(std::int32_t) && sizeof(int) == sizeof(std::int32_t),
+                "Snapshot field sizes");
+
+  // Every section is checked before anything is changed
+  SnapshotView view;
+  if (!snapshot_view(snapshot, view))
+  {
+    return false;
+  }
+
+  clear_state();
+
+  // Affiliations
+  std::size_t aff_count = view.aff_count;
+  affiliations_x.assign(view.aff_x, view.aff_x + aff_count);
+  affiliations_y.assign(view.aff_y, view.aff_y + aff_count);
+  affiliations_degree.resize(aff_count);
+  affiliations_cold.reserve(aff_count);
+  affiliation_handles.reserve(aff_count);
+  for (AffHandle aff = 0; aff < aff_count; ++aff)
+  {
+    AffiliationCold &cold = affiliations_cold.emplace_back();
+    cold.id = view.aff_id(aff);
+    cold.name = view.aff_name(aff);
+    cold.publications.assign(view.aff_pubs + view.aff_pub_offsets[aff], view.aff_pubs + view.aff_pub_offsets[aff + 1]);
+    cold.incident_edges.assign(view.aff_edges + view.aff_edge_offsets[aff], view.aff_edges + view.aff_edge_offsets[aff + 1]);
+    affiliations_degree[aff] = static_cast<std::uint32_t>(cold.incident_edges.size());
+    affiliation_handles.emplace(cold.id, aff);
+    if (!nearest_simd_coord_ok(view.aff_x[aff], view.aff_y[aff]))
+      affiliations_outside_simd_range++;
+  }
+  edges.resize(view.edge_count);
+  if (view.edge_count > 0)
+  {
+    std::memcpy(edges.data(), view.edges, view.edge_count * sizeof(Edge));
+  }
+
+  // The sorted orders are filled in order, so every insertion hint is exact
+  affiliations_id_sorted_name.reserve(aff_count);
+  for (std::size_t i = 0; i < aff_count; ++i)
+  {
+    const AffiliationCold &cold = affiliations_cold[view.aff_by_name[i]];
+    auto it_name = std::prev(affiliations_map_sorted_name.end(), affiliations_map_sorted_name.empty() ? 0 : 1);
+    if (affiliations_map_sorted_name.empty() || it_name->first != cold.name)
     {
-      path_deque.push_front(prenode);
-      auto it_prenode = visited.find(prenode);
-      prenode = it_prenode->second.first;
+      it_name = affiliations_map_sorted_name.try_emplace(affiliations_map_sorted_name.end(), cold.name);
     }
-    if (path_deque.size() > 1)
+    it_name->second.emplace_hint(it_name->second.end(), cold.id);
+    affiliations_id_sorted_name.emplace_back(cold.id);
+  }
+  affiliations_id_sorted_coord.reserve(view.aff_by_coord_count);
+  for (std::size_t i = 0; i < view.aff_by_coord_count; ++i)
+  {
+    AffHandle aff = view.aff_by_coord[i];
+    affiliations_map_sorted_coord.emplace_hint(affiliations_map_sorted_coord.end(), affiliation_coord(aff), affiliations_cold[aff].id);
+    affiliations_id_sorted_coord.emplace_back(affiliations_cold[aff].id);
+  }
+  affiliations_name_sorted = true;
+  affiliations_coord_sorted = true;
+
+  // Publications go to slots 0..p-1 of the empty slot map, so snapshot indices are slots
+  publications.reserve(view.pub_count);
+  publication_handles.reserve(view.pub_count);
+  for (std::uint32_t i = 0; i < view.pub_count; ++i)
+  {
+    Publication pub(&arena);
+    pub.id = view.pub_ids[i];
+    pub.name = view.pub_name(i);
+    pub.year = view.pub_years[i];
+    pub.parent = view.pub_parents[i] != SNAPSHOT_NONE ? view.pub_parents[i] : NO_SLOT;
+    pub.affiliations.reserve(view.pub_aff_offsets[i + 1] - view.pub_aff_offsets[i]);
+    for (std::uint64_t aff = view.pub_aff_offsets[i]; aff < view.pub_aff_offsets[i + 1]; ++aff)
+    {
+      pub.affiliations.emplace_back(view.pub_aff_id(aff));
+    }
+    pub.children.assign(view.pub_children + view.pub_child_offsets[i], view.pub_children + view.pub_child_offsets[i + 1]);
+    publication_handles.emplace(pub.id, publications.insert(std::move(pub)));
+  }
+
+  if (view.year_offsets)
+  {
+    publications_by_year.resize(view.year_count);
+    year_bucket_unsorted.assign(view.year_count, 0);
+    for (std::size_t year = 0; year < view.year_count; ++year)
     {
-      for (auto it = path_deque.begin(); it + 1 != path_deque.end(); ++it)
+      auto &bucket = publications_by_year[year];
+      bucket.assign(view.year_pubs + view.year_offsets[year], view.year_pubs + view.year_offsets[year + 1]);
+      if (!std::is_sorted(bucket.begin(), bucket.end()))
       {
-        AffiliationID first = *it;
-        AffiliationID second = *(it + 1);
-        auto it_aff = affiliations_map.find(first);
-        auto it_connection = it_aff->second.connected_affiliations.find(second);
-        int dist_to_first = visited.find(first)->second.second;
-        int dist_to_second = visited.find(second)->second.second;
-        Distance dist_between = dist_to_second - dist_to_first;
-        pathWithDist.push_back({{first, second, it_connection->second}, dist_between});
+        year_bucket_unsorted[year] = 1;
+        ++year_buckets_unsorted;
       }
-      return pathWithDist;
     }
+    // The counts are taken from the buckets rather than from the stored tree
+    year_index_build_tree(view.year_count + 1);
   }
-  return {};
-}
\ No newline at end of file
+  else
+  {
+    for (std::size_t i = 0; i < view.pub_count; ++i)
+    {
+      year_index_insert(view.pub_years[i], view.pub_ids[i]);
+    }
+  }
+
+  return true;
+}
@@ -19,7 +19,20 @@
 #include <unordered_set>
 #include <queue>
 #include <deque>
+#include <unordered_map>
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <iosfwd>
 
+#include "slotmap.hh"
+
+class SnapshotReader;
+class MappedSnapshot;
 
 // Types for IDs
 using AffiliationID = std::string;
@@ -92,6 +105,19 @@ struct Connection
 };
 const Connection NO_CONNECTION{NO_AFFILIATION, NO_AFFILIATION, NO_WEIGHT};
 
+// Called by Datastructures::visit_all_connections once per connection, smaller id first.
+// The ids are only valid during the call.
+using ConnectionVisitor = std::function<void(std::string_view aff1, std::string_view aff2, Weight weight)>;
+
+// One publication of a batch given to Datastructures::add_publications
+struct PublicationData
+{
+  PublicationID id = NO_PUBLICATION;
+  Name name = NO_NAME;
+  Year year = NO_YEAR;
+  std::vector<AffiliationID> affiliations;
+};
+
 // Return value for cases where Distance is unknown
 Distance const NO_DISTANCE = NO_VALUE;
 
@@ -120,182 +146,381 @@ public:
   Datastructures();
   ~Datastructures();
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  unsigned int get_affiliation_count();
+  // Estimate of performance: O(1)
+  // Short rationale for estimate: The size of the affiliation array
+  unsigned int get_affiliation_count() const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
+  // Estimate of performance: O(n)
+  // Short rationale for estimate: The arena releases its blocks at once, the caches outside it are freed
   void clear_all();
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  std::vector<AffiliationID> get_all_affiliations();
+  // Estimate of performance: O(n)
+  // Short rationale for estimate: One pass over the affiliation array
+  std::vector<AffiliationID> get_all_affiliations() const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
+  // Estimate of performance: O(log n)
+  // Short rationale for estimate: Hash insert of the handle, inserts into the name and coordinate maps
   bool add_affiliation(AffiliationID id, Name const &name, Coord xy);
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  Name get_affiliation_name(AffiliationID id);
+  // Estimate of performance: O(1)
+  // Short rationale for estimate: Hash lookup of the handle (on average)
+  Name get_affiliation_name(AffiliationID id) const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  Coord get_affiliation_coord(AffiliationID id);
+  // Estimate of performance: O(1)
+  // Short rationale for estimate: Hash lookup of the handle (on average)
+  Coord get_affiliation_coord(AffiliationID id) const;
 
   // We recommend you implement the operations below only after implementing the ones above
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  std::vector<AffiliationID> get_affiliations_alphabetically();
+  // Estimate of performance: O(n)
+  // Short rationale for estimate: The cached order is rebuilt from the name map after changes, then copied
+  std::vector<AffiliationID> get_affiliations_alphabetically() const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  std::vector<AffiliationID> get_affiliations_distance_increasing();
+  // Estimate of performance: O(n)
+  // Short rationale for estimate: The cached order is rebuilt from the coordinate map after changes, then copied
+  std::vector<AffiliationID> get_affiliations_distance_increasing() const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  AffiliationID find_affiliation_with_coord(Coord xy);
+  // Estimate of performance: O(log n)
+  // Short rationale for estimate: Lookup in the map ordered by coordinate
+  AffiliationID find_affiliation_with_coord(Coord xy) const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
+  // Estimate of performance: O(log n)
+  // Short rationale for estimate: Erase and insert in the coordinate map
   bool change_affiliation_coord(AffiliationID id, Coord newcoord);
 
   // We recommend you implement the operations below only after implementing the ones above
 
-  // Estimate of performance:
-  // Short rationale for estimate:
+  // Estimate of performance: O(d + log Y), Y = largest year
+  // Short rationale for estimate: Each pair of the few affiliations scans the shorter incident list (degree d) for its edge;
+  // the id is appended to its year bucket and counted in the Fenwick tree (grown by doubling, amortized O(1))
   bool add_publication(PublicationID id, Name const &name, Year year, const std::vector<AffiliationID> &affiliations);
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  std::vector<PublicationID> all_publications();
+  // Estimate of performance: O(P log Y + k log k), k = number of affiliation pairs in the batch
+  // Short rationale for estimate: Pairs of all publications are collected, sorted and each distinct pair is connected once;
+  // each id is appended to its year bucket and counted in the Fenwick tree
+  unsigned int add_publications(const std::vector<PublicationData> &batch);
+
+  // Estimate of performance: O(n)
+  // Short rationale for estimate: One pass over the publication slots
+  std::vector<PublicationID> all_publications() const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  Name get_publication_name(PublicationID id);
+  // Estimate of performance: O(1)
+  // Short rationale for estimate: Hash lookup of the slot (on average)
+  Name get_publication_name(PublicationID id) const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  Year get_publication_year(PublicationID id);
+  // Estimate of performance: O(1)
+  // Short rationale for estimate: Hash lookup of the slot (on average)
+  Year get_publication_year(PublicationID id) const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  std::vector<AffiliationID> get_affiliations(PublicationID id);
+  // Estimate of performance: O(k)
+  // Short rationale for estimate: Hash lookup, then a copy of the k affiliations
+  std::vector<AffiliationID> get_affiliations(PublicationID id) const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
+  // Estimate of performance: O(1)
+  // Short rationale for estimate: Two hash lookups and a push to the children
   bool add_reference(PublicationID id, PublicationID parentid);
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  std::vector<PublicationID> get_direct_references(PublicationID id);
+  // Estimate of performance: O(c)
+  // Short rationale for estimate: Hash lookup, then a copy of the c children
+  std::vector<PublicationID> get_direct_references(PublicationID id) const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
+  // Estimate of performance: O(k d)
+  // Short rationale for estimate: The new affiliation is connected to the k others, each scanning an incident list
   bool add_affiliation_to_publication(AffiliationID affiliationid, PublicationID publicationid);
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  std::vector<PublicationID> get_publications(AffiliationID id);
+  // Estimate of performance: O(m)
+  // Short rationale for estimate: Hash lookup, then a copy of the m publications of the affiliation
+  std::vector<PublicationID> get_publications(AffiliationID id) const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  PublicationID get_parent(PublicationID id);
+  // Estimate of performance: O(1)
+  // Short rationale for estimate: Hash lookup of the slot, the parent is stored
+  PublicationID get_parent(PublicationID id) const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  std::vector<std::pair<Year, PublicationID>> get_publications_after(AffiliationID affiliationid, Year year);
+  // Estimate of performance: O(m log m)
+  // Short rationale for estimate: The m publications of the affiliation are ordered by year and id
+  std::vector<std::pair<Year, PublicationID>> get_publications_after(AffiliationID affiliationid, Year year) const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  std::vector<PublicationID> get_referenced_by_chain(PublicationID id);
+  // Estimate of performance: O(h)
+  // Short rationale for estimate: Follow the parents up the h levels
+  std::vector<PublicationID> get_referenced_by_chain(PublicationID id) const;
 
   // Non-compulsory operations
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  std::vector<PublicationID> get_all_references(PublicationID id);
+  // Estimate of performance: O(s)
+  // Short rationale for estimate: Post-order walk of the s publications below
+  std::vector<PublicationID> get_all_references(PublicationID id) const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  std::vector<AffiliationID> get_affiliations_closest_to(Coord xy);
+  // Estimate of performance: O(n)
+  // Short rationale for estimate: One (SIMD) pass over the coordinate arrays keeping the best three
+  std::vector<AffiliationID> get_affiliations_closest_to(Coord xy) const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
+  // Estimate of performance: O(log n + m k + d^2)
+  // Short rationale for estimate: Map erases, removal from the m publications (k affiliations each), and d edge unlinks
   bool remove_affiliation(AffiliationID id);
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  PublicationID get_closest_common_parent(PublicationID id1, PublicationID id2);
+  // Estimate of performance: O(h)
+  // Short rationale for estimate: The h ancestors of the first into a hash set, then the ancestors of the second are checked
+  PublicationID get_closest_common_parent(PublicationID id1, PublicationID id2) const;
 
-  // Estimate of performance:
-  // Short rationale for estimate:
+  // Estimate of performance: O(c + k m + b)
+  // Short rationale for estimate: Unlink from parent and c children, from the k affiliations (m publications each) and the year bucket b
   bool remove_publication(PublicationID publicationid);
 
   // PRG 2 functions:
 
-  // Estimate of performance: O(n)
-  // Short rationale for estimate: Iterate through unordered_map of adjacent affiliations
-  std::vector<Connection> get_connected_affiliations(AffiliationID id);
+  // Estimate of performance: O(d)
+  // Short rationale for estimate: Iterate through the d incident edges of the affiliation
+  std::vector<Connection> get_connected_affiliations(AffiliationID id) const;
 
-  // Estimate of performance: O(n^2)
-  // Short rationale for estimate: Iterate through all adjacents of all affiliations
-  std::vector<Connection> get_all_connections();
+  // Estimate of performance: O(e)
+  // Short rationale for estimate: One pass over the contiguous edge table
+  std::vector<Connection> get_all_connections() const;
+
+  // Estimate of performance: O(e)
+  // Short rationale for estimate: One pass over the edge table, nothing is copied
+  void visit_all_connections(const ConnectionVisitor &visitor) const;
 
   // Estimate of performance: O(n^2)
   // Short rationale for estimate: depth first search through all possible path is quadratic
-  Path get_any_path(AffiliationID source, AffiliationID target);
+  Path get_any_path(AffiliationID source, AffiliationID target) const;
 
   // PRG2 optional functions
 
-  // Estimate of performance:
-  // Short rationale for estimate:
-  Path get_path_with_least_affiliations(AffiliationID source, AffiliationID target);
-
-  // Estimate of performance:
-  // Short rationale for estimate:
-  Path get_path_of_least_friction(AffiliationID source, AffiliationID target);
-
-  // Estimate of performance:
-  // Short rationale for estimate:
-  PathWithDist get_shortest_path(AffiliationID source, AffiliationID target);
+  // Estimate of performance: O(n + e)
+  // Short rationale for estimate: Breadth first search
+  Path get_path_with_least_affiliations(AffiliationID source, AffiliationID target) const;
+
+  // Estimate of performance: O(n + e)
+  // Short rationale for estimate: Breadth first search, nodes are not revisited
+  Path get_path_of_least_friction(AffiliationID source, AffiliationID target) const;
+
+  // Estimate of performance: O(n + e)
+  // Short rationale for estimate: Breadth first search, nodes are not revisited
+  PathWithDist get_shortest_path(AffiliationID source, AffiliationID target) const;
+
+  // Year range queries
+
+  // Estimate of performance: O(log Y), Y = largest year
+  // Short rationale for estimate: Two prefix sums over a Fenwick tree indexed by year
+  unsigned int count_publications_in_years(Year from, Year to) const;
+
+  // Estimate of performance: O(r + k + u log u), u = ids added out of order to the buckets in range since they were listed
+  // Short rationale for estimate: Walk the r year buckets in range, sorting those that need it by id, copying k results
+  std::vector<std::pair<Year, PublicationID>> get_publications_in_years(Year from, Year to) const;
+
+  // Snapshots
+
+  // Estimate of performance: O(n log n + p log p + e)
+  // Short rationale for estimate: Every array is written once, id orders for read-only use are sorted
+  bool save_snapshot(std::string const &filename, bool with_year_index);
+
+  // Estimate of performance: O(n + p + e)
+  // Short rationale for estimate: Arrays are copied as a whole, sorted maps are filled in order with hints
+  bool load_snapshot(std::string const &filename);
+
+  // Estimate of performance: O(n + p + e)
+  // Short rationale for estimate: The file is mapped without copying; its sections are validated once
+  // Until the next operation that modifies the state (or saves a snapshot), all queries
+  // read the mapped snapshot directly. Such an operation first loads the snapshot into memory.
+  bool map_snapshot(std::string const &filename);
+
+  // Epochs
+
+  // Estimate of performance: O(s + n log n + p log p + e)
+  // Short rationale for estimate: The state is written to a snapshot in memory, as by save_snapshot.
+  // Sections of the previous epoch whose structures did not change since are copied instead (s bytes
+  // in all), so the n log n and p log p sorts and the e edges are only paid for the changed ones.
+  // From then on, until drop_epoch, all queries are answered from that snapshot without waiting
+  // for modifying operations, whose changes become visible at the next publish_epoch. A query
+  // finishes on the epoch it started with; an epoch is freed when its last query returns.
+  // The snapshot is written while holding the state shared: other queries go on, modifying
+  // operations wait for it.
+  bool publish_epoch();
+
+  // Estimate of performance: O(1)
+  // Short rationale for estimate: The epoch is only released, queries see the current state again
+  void drop_epoch();
+
+  // While it exists, whether the queries of the thread that created it read the current state
+  // (live) or the published epoch, so that a modifying operation can show its own change. The
+  // previous setting is restored when it is destroyed.
+  class LiveQueries
+  {
+  public:
+    explicit LiveQueries(bool live = true) : outer_(live_queries) { live_queries = live; }
+    ~LiveQueries() { live_queries = outer_; }
+    LiveQueries(LiveQueries const &) = delete;
+    LiveQueries &operator=(LiveQueries const &) = delete;
+
+  private:
+    bool outer_;
+  };
 
-  // Helper functions
-  void postorder_traversal(PublicationID root_id, std::vector<PublicationID> &store, bool isOriginalRoot);
-  std::vector<AffiliationID> dfs(AffiliationID source, AffiliationID target, std::vector<AffiliationID>& path_nodes, std::unordered_set<AffiliationID>& path_nodes_set);
+  // Diagnostics
 
+  // Estimate of performance: O(n + p)
+  // Short rationale for estimate: Each affiliation, publication and index entry is looked at once
+  // Estimated bytes of each container (by name), from sizes, capacities and element types.
+  // Nodes and buckets are counted with the usual libstdc++ overheads; the arena's own
+  // bookkeeping and the free blocks in its pools are not included.
+  std::vector<std::pair<std::string, std::size_t>> memory_usage() const;
 
 private:
-  struct Affiliation
+  // Queries (the const public operations) hold this shared unless an epoch is published,
+  // operations that modify the state (including detaching a mapped snapshot) hold it
+  // exclusively. Private helpers expect the caller to hold it.
+  mutable std::shared_mutex state_mutex;
+  void clear_state();
+
+  // Every container below allocates from this arena (declared first, so it outlives
+  // them). clear_all releases the arena in one go and re-creates the containers on top
+  // of it, instead of freeing each node, string and vector separately. Because of that,
+  // nothing stored in the containers may own memory from outside the arena: strings are
+  // std::pmr::string and nested containers are pmr containers.
+  mutable std::pmr::unsynchronized_pool_resource arena;
+  std::pmr::string arena_string(std::string const &str) const { return std::pmr::string(str, &arena); }
+
+  // Affiliations are addressed by a dense handle 0..n-1. The fields read by coordinate
+  // scans and graph searches live in separate arrays indexed by handle; the rest of an
+  // affiliation is in affiliations_cold. Removal moves the last affiliation into the hole.
+  using AffHandle = std::uint32_t;
+  static constexpr AffHandle NO_HANDLE = std::numeric_limits<AffHandle>::max();
+
+  // Each connection is stored once in edges; both endpoints list the edge's index in
+  // their incident_edges. Removal moves the last edge into the hole.
+  using EdgeIndex = std::uint32_t;
+  static constexpr EdgeIndex NO_EDGE = std::numeric_limits<EdgeIndex>::max();
+  struct Edge
   {
-    AffiliationID id;
-    Name name;
-    Coord xy;
-    std::vector<PublicationID> publications;
-    std::unordered_map<AffiliationID, Weight> connected_affiliations;
+    AffHandle aff1;
+    AffHandle aff2;
+    Weight weight;
+    AffHandle other_end(AffHandle aff) const { return aff == aff1 ? aff2 : aff1; }
   };
+  std::pmr::vector<Edge> edges{&arena};
+  EdgeIndex find_edge(AffHandle aff1, AffHandle aff2) const;
+  void remove_edge(EdgeIndex edge);
+  struct AffiliationCold
+  {
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    std::pmr::string id;
+    std::pmr::string name;
+    std::pmr::vector<PublicationID> publications;
+    std::pmr::vector<EdgeIndex> incident_edges;
+
+    explicit AffiliationCold(allocator_type alloc = {})
+      : id(alloc), name(alloc), publications(alloc), incident_edges(alloc) {}
+    AffiliationCold(AffiliationCold const &other, allocator_type alloc)
+      : id(other.id, alloc), name(other.name, alloc), publications(other.publications, alloc),
+        incident_edges(other.incident_edges, alloc) {}
+    AffiliationCold(AffiliationCold &&other, allocator_type alloc)
+      : id(std::move(other.id), alloc), name(std::move(other.name), alloc), publications(std::move(other.publications), alloc),
+        incident_edges(std::move(other.incident_edges), alloc) {}
+    AffiliationCold(AffiliationCold const &) = default;
+    AffiliationCold(AffiliationCold &&) = default;
+    AffiliationCold &operator=(AffiliationCold const &) = default;
+    AffiliationCold &operator=(AffiliationCold &&) = default;
+  };
+  std::pmr::vector<int> affiliations_x{&arena};
+  std::pmr::vector<int> affiliations_y{&arena};
+  std::pmr::vector<std::uint32_t> affiliations_degree{&arena};
+  std::pmr::vector<AffiliationCold> affiliations_cold{&arena};
+  std::pmr::unordered_map<std::pmr::string, AffHandle> affiliation_handles{&arena};
+  // Number of affiliations whose coordinates are outside the range of the SIMD distance kernels
+  unsigned int affiliations_outside_simd_range = 0;
+  AffHandle find_affiliation(AffiliationID const &id) const;
+  Coord affiliation_coord(AffHandle aff) const { return {affiliations_x[aff], affiliations_y[aff]}; }
+  void connect_affiliations(AffHandle aff1, AffHandle aff2, Weight increment = 1);
+  void disconnect_affiliation(AffHandle aff);
+
+  // Publications are stored contiguously in a slot map; the reference forest links
+  // publications by slot index, and publication_handles maps ids to their slots.
   struct Publication
   {
-    PublicationID id;
-    Name name;
-    Year year;
-    std::vector<AffiliationID> affiliations;
-    PublicationID parent_id;
-    std::vector<PublicationID> children_ids;
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    PublicationID id = NO_PUBLICATION;
+    std::pmr::string name;
+    Year year = NO_YEAR;
+    std::pmr::vector<std::pmr::string> affiliations;
+    SlotIndex parent = NO_SLOT;
+    std::pmr::vector<SlotIndex> children;
+
+    explicit Publication(allocator_type alloc = {})
+      : name(alloc), affiliations(alloc), children(alloc) {}
+    Publication(Publication const &other, allocator_type alloc)
+      : id(other.id), name(other.name, alloc), year(other.year), affiliations(other.affiliations, alloc),
+        parent(other.parent), children(other.children, alloc) {}
+    Publication(Publication &&other, allocator_type alloc)
+      : id(other.id), name(std::move(other.name), alloc), year(other.year), affiliations(std::move(other.affiliations), alloc),
+        parent(other.parent), children(std::move(other.children), alloc) {}
+    Publication(Publication const &) = default;
+    Publication(Publication &&) = default;
+    Publication &operator=(Publication const &) = default;
+    Publication &operator=(Publication &&) = default;
+  };
+  SlotMap<Publication> publications{&arena};
+  std::pmr::unordered_map<PublicationID, SlotHandle> publication_handles{&arena};
+  Publication *find_publication(PublicationID id);
+  Publication const *find_publication(PublicationID id) const;
+  bool load_snapshot(SnapshotReader const &snapshot);
+
+  // Read-only snapshot opened by map_snapshot, serving queries while set
+  std::unique_ptr<MappedSnapshot> mapped;
+  void detach_snapshot();
+  // What changed since the last publish_epoch, so that the next one copies the other
+  // sections from the epoch. Modifying operations add to it holding state_mutex
+  // exclusively, publish_epoch resets it holding state_mutex shared and publish_mutex.
+  enum EpochChange : unsigned int
+  {
+    EPOCH_AFFILIATIONS = 1, // Ids, names, coordinates and their orders
+    EPOCH_LINKS = 2,        // Publications listed at the affiliations
+    EPOCH_EDGES = 4,        // Edges and the incident edge lists
+    EPOCH_PUBLICATIONS = 8, // Publications and the year index
+    EPOCH_ALL = 15
   };
-  std::unordered_map<AffiliationID, Affiliation> affiliations_map;
-  std::unordered_map<PublicationID, Publication> publications_map;
-  std::vector<AffiliationID> affiliations_id;
-  std::map<Name, std::set<AffiliationID>> affiliations_map_sorted_name;
-  std::vector<AffiliationID> affiliations_id_sorted_name;
-  std::map<Coord, AffiliationID> affiliations_map_sorted_coord;
-  std::vector<AffiliationID> affiliations_id_sorted_coord;
-  bool affiliations_name_sorted = true;
-  bool affiliations_coord_sorted = true;
-
-  std::unordered_map<AffiliationID, std::unordered_map<AffiliationID, Weight>> all_connections;
+  unsigned int epoch_changes = EPOCH_ALL;
+  // Sections outside changes are copied from unchanged, a snapshot of the state before them
+  bool write_snapshot(std::ostream &output, bool with_year_index, SnapshotReader const *unchanged = nullptr,
+                      unsigned int changes = EPOCH_ALL) const;
+
+  // Snapshot published by publish_epoch, serving queries while set. It is not guarded by
+  // state_mutex: queries and publish_epoch swap it with the atomic shared_ptr operations.
+  std::shared_ptr<MappedSnapshot const> epoch;
+  std::shared_ptr<MappedSnapshot const> current_epoch() const { return live_queries ? nullptr : std::atomic_load(&epoch); }
+  std::mutex publish_mutex;
+  static inline thread_local bool live_queries = false; // Set by LiveQueries
+  bool insert_publication(PublicationID id, Name const &name, Year year, const std::vector<AffiliationID> &affiliations);
+
+  std::pmr::map<std::pmr::string, std::pmr::set<std::pmr::string, std::less<>>, std::less<>> affiliations_map_sorted_name{&arena};
+  std::pmr::map<Coord, std::pmr::string> affiliations_map_sorted_coord{&arena};
+  // Result caches are handed out by copy, so they are plain vectors outside the arena.
+  // Writers only clear the flags; the first reader to find a flag cleared rebuilds the
+  // cache under sorted_cache_mutex, later readers see the flag set and copy without locking.
+  mutable std::mutex sorted_cache_mutex;
+  mutable std::vector<AffiliationID> affiliations_id_sorted_name;
+  mutable std::vector<AffiliationID> affiliations_id_sorted_coord;
+  mutable std::atomic<bool> affiliations_name_sorted = true;
+  mutable std::atomic<bool> affiliations_coord_sorted = true;
+
+  // Year index: one bucket of publication ids per year, grown up to the largest year seen,
+  // and a Fenwick tree over the bucket sizes, grown by doubling to cover the same years.
+  // Ids are appended to their bucket; a bucket that got out of id order is sorted by the
+  // first reader listing it, under sorted_cache_mutex like the result caches above.
+  // year_buckets_unsorted counts the flagged buckets, so readers skip the lock when it is 0.
+  mutable std::pmr::vector<std::pmr::vector<PublicationID>> publications_by_year{&arena};
+  mutable std::pmr::vector<std::uint8_t> year_bucket_unsorted{&arena};
+  mutable std::atomic<std::size_t> year_buckets_unsorted = 0;
+  std::pmr::vector<unsigned int> publications_year_tree{&arena};
+  void year_index_insert(Year year, PublicationID id);
+  void year_index_erase(Year year, PublicationID id);
+  void year_index_build_tree(std::size_t size);
+  void year_index_sort(std::size_t first, std::size_t last) const; // Buckets first..last - 1
+  unsigned int year_index_prefix(std::size_t end) const;
+
+  // Helper functions
+  void postorder_traversal(SlotIndex root, std::vector<PublicationID> &store, bool isOriginalRoot) const;
+  void visit_connections(ConnectionVisitor const &visitor) const;
+  struct GraphView;
 };
 
 #endif // DATASTRUCTURES_HH
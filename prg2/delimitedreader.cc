@@ -0,0 +1,193 @@
+// Delimitedreader.cc
+
+#include "delimitedreader.hh"
+
+#include <algorithm>
+#include <cstring>
+
+DelimitedReader::DelimitedReader(std::istream &input, char delimiter)
+  : input_(input), delimiter_(delimiter), buffer_(BLOCK_SIZE)
+{
+}
+
+bool DelimitedReader::next_row(std::vector<std::string_view> &fields)
+{
+  while (true)
+  {
+    if (pos_ == end_ && (eof_ || !refill()))
+    {
+      return false;
+    }
+    char const *first = buffer_.data() + pos_;
+    char const *last = first + (end_ - pos_);
+    if (*first == '#' || *first == '\n' || (*first == '\r' && (last - first == 1 || first[1] == '\n')))
+    {
+      // Comments and empty lines are skipped whole (a comment runs to the end of the line, quotes and all)
+      char const *newline = std::find(first, last, '\n');
+      if (newline == last && !eof_)
+      {
+        refill();
+        continue;
+      }
+      pos_ += newline - first;
+      if (pos_ < end_)
+      {
+        ++pos_;
+        ++line_;
+      }
+      continue;
+    }
+    if (delimiter_ == 0)
+    {
+      // Detect from the first row (or as much of it as fits in the buffer)
+      char const *newline = std::find(first, last, '\n');
+      delimiter_ = std::find(first, newline, '\t') != newline ? '\t' : ',';
+    }
+    if (!parse_row(fields))
+    {
+      // The row continues past the buffer (at the end of input parse_row accepts it as is)
+      refill();
+      continue;
+    }
+    return true;
+  }
+}
+
+bool DelimitedReader::parse_row(std::vector<std::string_view> &fields)
+{
+  // First find where the row ends without changing anything, so that an
+  // incomplete row can be parsed again after a refill
+  std::size_t p = pos_;
+  bool field_start = true;
+  bool in_quotes = false;
+  std::size_t lines = 0;
+  for (; p < end_; ++p)
+  {
+    char c = buffer_[p];
+    if (in_quotes)
+    {
+      if (c == '"')
+      {
+        if (p + 1 == end_ && !eof_)
+        {
+          return false; // Cannot tell an escaped quote from a closing one yet
+        }
+        if (p + 1 < end_ && buffer_[p + 1] == '"')
+        {
+          ++p;
+        }
+        else
+        {
+          in_quotes = false;
+        }
+      }
+      else if (c == '\n')
+      {
+        ++lines;
+      }
+    }
+    else if (c == '\n')
+    {
+      break;
+    }
+    else if (c == '"' && field_start)
+    {
+      in_quotes = true;
+    }
+    field_start = (c == delimiter_);
+  }
+  if (p == end_ && !eof_)
+  {
+    return false;
+  }
+  std::size_t row_end = p;
+
+  // Then split it into fields, unescaping quoted fields in place
+  fields.clear();
+  p = pos_;
+  while (true)
+  {
+    std::size_t start = p;
+    std::size_t out = p;
+    if (p < row_end && buffer_[p] == '"')
+    {
+      ++p;
+      while (p < row_end)
+      {
+        if (buffer_[p] == '"')
+        {
+          if (p + 1 < row_end && buffer_[p + 1] == '"')
+          {
+            buffer_[out++] = '"';
+            p += 2;
+            continue;
+          }
+          ++p;
+          break;
+        }
+        buffer_[out++] = buffer_[p++];
+      }
+      // Anything between the closing quote and the delimiter is ignored
+      while (p < row_end && buffer_[p] != delimiter_)
+      {
+        ++p;
+      }
+    }
+    else
+    {
+      while (p < row_end && buffer_[p] != delimiter_)
+      {
+        ++p;
+      }
+      out = p;
+      if (p == row_end && out > start && buffer_[out - 1] == '\r')
+      {
+        --out;
+      }
+    }
+    fields.emplace_back(buffer_.data() + start, out - start);
+    if (p == row_end)
+    {
+      break;
+    }
+    ++p; // Delimiter
+  }
+
+  row_line_ = line_;
+  line_ += lines;
+  pos_ = row_end;
+  if (pos_ < end_)
+  {
+    ++pos_; // Newline
+    ++line_;
+  }
+  return true;
+}
+
+bool DelimitedReader::refill()
+{
+  if (eof_)
+  {
+    return false;
+  }
+  std::size_t unread = end_ - pos_;
+  if (pos_ > 0)
+  {
+    std::memmove(buffer_.data(), buffer_.data() + pos_, unread);
+  }
+  else if (unread == buffer_.size())
+  {
+    buffer_.resize(buffer_.size() * 2); // A row longer than the buffer
+  }
+  pos_ = 0;
+  end_ = unread;
+
+  input_.read(buffer_.data() + end_, static_cast<std::streamsize>(buffer_.size() - end_));
+  std::size_t got = static_cast<std::size_t>(input_.gcount());
+  end_ += got;
+  if (got == 0 || !input_)
+  {
+    eof_ = true;
+  }
+  return got > 0 || unread > 0;
+}
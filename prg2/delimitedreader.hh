@@ -0,0 +1,49 @@
+// Delimitedreader.hh
+//
+// Reads comma or tab separated rows from a stream in large blocks. Fields are
+// returned as string_views into the block buffer, so nothing is copied per field.
+// Fields may be quoted with "..." (a doubled "" inside quotes is one quote); such
+// a field is unescaped in place in the buffer. Quoted fields may span lines.
+// Empty lines and lines starting with # are skipped.
+
+#ifndef DELIMITEDREADER_HH
+#define DELIMITEDREADER_HH
+
+#include <cstddef>
+#include <istream>
+#include <string_view>
+#include <vector>
+
+class DelimitedReader
+{
+public:
+  // delimiter 0 means detect: tab if the first row contains one, otherwise comma
+  explicit DelimitedReader(std::istream &input, char delimiter = 0);
+
+  // Reads the next non-empty row into fields, returns false at the end of input.
+  // The fields stay valid until the next call.
+  bool next_row(std::vector<std::string_view> &fields);
+
+  // Line number (1-based) where the row last returned by next_row starts
+  std::size_t line_number() const { return row_line_; }
+  char delimiter() const { return delimiter_; }
+
+private:
+  // Parses one row starting at pos_, returns false if the buffer ends before the row does
+  bool parse_row(std::vector<std::string_view> &fields);
+  // Moves unread data to the front of the buffer and reads more, returns false at end of input
+  bool refill();
+
+  static std::size_t const BLOCK_SIZE = 1 << 20;
+
+  std::istream &input_;
+  char delimiter_;
+  std::vector<char> buffer_;
+  std::size_t pos_ = 0;  // Start of unread data
+  std::size_t end_ = 0;  // End of valid data
+  bool eof_ = false;
+  std::size_t line_ = 1; // Line at pos_
+  std::size_t row_line_ = 0;
+};
+
+#endif // DELIMITEDREADER_HH
@@ -0,0 +1,75 @@
+// Latencyhistogram.cc
+
+#include "latencyhistogram.hh"
+
+#include <algorithm>
+#include <cmath>
+
+LatencyHistogram::LatencyHistogram() : counts_(BUCKET_COUNT, 0)
+{
+}
+
+void LatencyHistogram::record(std::uint64_t nanoseconds)
+{
+  ++counts_[bucket_of(nanoseconds)];
+  ++count_;
+  sum_ += nanoseconds;
+  max_ = std::max(max_, nanoseconds);
+}
+
+void LatencyHistogram::clear()
+{
+  std::fill(counts_.begin(), counts_.end(), 0);
+  count_ = 0;
+  sum_ = 0;
+  max_ = 0;
+}
+
+std::uint64_t LatencyHistogram::quantile(double q) const
+{
+  if (count_ == 0)
+  {
+    return 0;
+  }
+  double rank = std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(count_));
+  std::uint64_t wanted = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(rank));
+  std::uint64_t seen = 0;
+  for (std::size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket)
+  {
+    seen += counts_[bucket];
+    if (seen >= wanted)
+    {
+      return std::min(bucket_end(bucket), max_);
+    }
+  }
+  return max_;
+}
+
+std::size_t LatencyHistogram::bucket_of(std::uint64_t value)
+{
+  if (value < LINEAR_COUNT)
+  {
+    return static_cast<std::size_t>(value);
+  }
+  // Shift value so that it has LINEAR_BITS - 1 significant bits below its top bit
+  unsigned int top_bit = 63;
+  while (!(value >> top_bit))
+  {
+    --top_bit;
+  }
+  unsigned int shift = top_bit - (LINEAR_BITS - 1);
+  std::size_t sub_bucket = static_cast<std::size_t>(value >> shift) - SUB_BUCKET_COUNT;
+  return LINEAR_COUNT + (shift - 1) * SUB_BUCKET_COUNT + sub_bucket;
+}
+
+std::uint64_t LatencyHistogram::bucket_end(std::size_t bucket)
+{
+  if (bucket < LINEAR_COUNT)
+  {
+    return bucket;
+  }
+  std::size_t above_linear = bucket - LINEAR_COUNT;
+  unsigned int shift = static_cast<unsigned int>(above_linear / SUB_BUCKET_COUNT) + 1;
+  std::uint64_t sub_bucket = SUB_BUCKET_COUNT + above_linear % SUB_BUCKET_COUNT;
+  return ((sub_bucket + 1) << shift) - 1;
+}
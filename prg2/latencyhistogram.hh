@@ -0,0 +1,46 @@
+// Latencyhistogram.hh
+//
+// HDR-style histogram of latencies in nanoseconds. Values below 128 get a
+// bucket each; above that every power of two is split into 64 buckets, so a
+// reported quantile is within 1/64 (about 1.6 %) of the recorded value while
+// the whole 64-bit range fits in a few thousand counters. Recording is O(1).
+
+#ifndef LATENCYHISTOGRAM_HH
+#define LATENCYHISTOGRAM_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class LatencyHistogram
+{
+public:
+  LatencyHistogram();
+
+  void record(std::uint64_t nanoseconds);
+  void clear();
+
+  std::uint64_t count() const { return count_; }
+  std::uint64_t max() const { return max_; }
+  double mean() const { return count_ > 0 ? static_cast<double>(sum_) / static_cast<double>(count_) : 0.0; }
+
+  // The smallest value such that at least fraction q (0..1) of the recorded values are
+  // not larger, rounded up to the end of its bucket but not above max(). 0 if empty.
+  std::uint64_t quantile(double q) const;
+
+private:
+  static unsigned int const LINEAR_BITS = 7;
+  static std::size_t const LINEAR_COUNT = std::size_t(1) << LINEAR_BITS;
+  static std::size_t const SUB_BUCKET_COUNT = LINEAR_COUNT / 2;
+  static std::size_t const BUCKET_COUNT = LINEAR_COUNT + (64 - LINEAR_BITS) * SUB_BUCKET_COUNT;
+
+  static std::size_t bucket_of(std::uint64_t value);
+  static std::uint64_t bucket_end(std::size_t bucket); // Largest value in the bucket
+
+  std::vector<std::uint64_t> counts_;
+  std::uint64_t count_ = 0;
+  std::uint64_t sum_ = 0;
+  std::uint64_t max_ = 0;
+};
+
+#endif // LATENCYHISTOGRAM_HH
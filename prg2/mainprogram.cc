@@ -30,6 +30,7 @@ using std::ostream;
 
 #include <fstream>
 using std::ifstream;
+using std::ofstream;
 
 #include <sstream>
 using std::istringstream;
@@ -45,13 +46,6 @@ using std::make_tuple;
 using std::get;
 using std::tie;
 
-#include <regex>
-using std::regex_match;
-using std::regex_search;
-using std::smatch;
-using std::regex;
-using std::sregex_token_iterator;
-
 #include <algorithm>
 using std::find_if;
 using std::find;
@@ -78,12 +72,19 @@ using std::vector;
 #include <set>
 using std::set;
 
+#include <map>
+
 #include <array>
 using std::array;
 
 #include <bitset>
 using std::bitset;
 
+#include <cctype>
+#include <charconv>
+#include <limits>
+#include <string_view>
+
 #include <iterator>
 using std::next;
 
@@ -110,17 +111,305 @@ using std::transform;
 using std::back_inserter;
 
 #include <cstddef>
+#include <cstdint>
 #include <cassert>
+#include <atomic>
+#include <exception>
+#include <thread>
 
 
 #include "mainprogram.hh"
 
 #include "datastructures.hh"
 
+#include "nearest.hh"
+
+#include "delimitedreader.hh"
+
+#include "perfresults.hh"
+
+#include "complexityfit.hh"
+
 #ifdef GRAPHICAL_GUI
 #include "mainwindow.hh"
 #endif
 
+namespace
+{
+
+bool is_space(char c) { return std::isspace(static_cast<unsigned char>(c)); }
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+bool is_alnum(char c) { return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+bool is_affiliationid_char(char c) { return is_alnum(c) || c == '-'; }
+bool is_name_char(char c) { return is_affiliationid_char(c) || c == ' '; }
+bool is_filename_char(char c) { return is_name_char(c) || c == '.' || c == '/' || c == ':' || c == '_'; }
+bool is_word_char(char c) { return is_alnum(c) || c == '_'; }
+
+// Position in a command line being matched
+struct Scanner
+{
+    std::string_view input;
+    std::size_t pos = 0;
+
+    bool at_end() const { return pos == input.size(); }
+    std::size_t skip_space()
+    {
+        std::size_t start = pos;
+        while (!at_end() && is_space(input[pos])) { ++pos; }
+        return pos - start;
+    }
+    bool literal(char c)
+    {
+        if (at_end() || input[pos] != c) { return false; }
+        ++pos;
+        return true;
+    }
+    // One or more characters accepted by is_char
+    bool token(bool (*is_char)(char))
+    {
+        std::size_t start = pos;
+        while (!at_end() && is_char(input[pos])) { ++pos; }
+        return pos > start;
+    }
+    // token(is_char) separated by separator, at least one
+    bool token_list(bool (*is_char)(char), char separator)
+    {
+        if (!token(is_char)) { return false; }
+        while (literal(separator))
+        {
+            if (!token(is_char)) { return false; }
+        }
+        return true;
+    }
+};
+
+// Number of values a parameter adds to the matched arguments
+std::size_t arg_count(MainProgram::Param const& param)
+{
+    switch (param.type)
+    {
+        case MainProgram::ParamType::COORD: return 2;
+        case MainProgram::ParamType::OPTIONAL:
+        {
+            std::size_t count = 0;
+            for (auto const& p : param.group) { count += arg_count(p); }
+            return count;
+        }
+        default: return 1;
+    }
+}
+
+bool match_param(Scanner& in, MainProgram::Param const& param, MainProgram::Args& args)
+{
+    using ParamType = MainProgram::ParamType;
+    std::size_t start = in.pos;
+    auto capture = [&in, &args](std::size_t first, std::size_t last) { args.emplace_back(in.input.substr(first, last - first)); };
+
+    switch (param.type)
+    {
+        case ParamType::AFFILIATIONID:
+        case ParamType::NUMBER:
+        {
+            if (!in.token(param.type == ParamType::NUMBER ? is_digit : is_affiliationid_char)) { return false; }
+            capture(start, in.pos);
+            return true;
+        }
+        case ParamType::NAME:
+        case ParamType::FILENAME:
+        {
+            if (!in.literal('"')) { return false; }
+            std::size_t first = in.pos;
+            if (!in.token(param.type == ParamType::NAME ? is_name_char : is_filename_char)) { return false; }
+            std::size_t last = in.pos;
+            if (!in.literal('"')) { return false; }
+            capture(first, last);
+            return true;
+        }
+        case ParamType::COORD:
+        {
+            // (x,y) with optional whitespace inside
+            if (!in.literal('(')) { return false; }
+            in.skip_space();
+            std::size_t x = in.pos;
+            if (!in.token(is_digit)) { return false; }
+            std::size_t xend = in.pos;
+            in.skip_space();
+            if (!in.literal(',')) { return false; }
+            in.skip_space();
+            std::size_t y = in.pos;
+            if (!in.token(is_digit)) { return false; }
+            std::size_t yend = in.pos;
+            in.skip_space();
+            if (!in.literal(')')) { return false; }
+            capture(x, xend);
+            capture(y, yend);
+            return true;
+        }
+        case ParamType::AFFILIATIONLIST:
+        {
+            // Zero or more ids each preceded by whitespace, matched as one string
+            std::size_t end = in.pos;
+            while (in.skip_space() > 0 && in.token(is_affiliationid_char)) { end = in.pos; }
+            in.pos = end;
+            capture(start, end);
+            return true;
+        }
+        case ParamType::WORDLIST:
+        case ParamType::NUMBERLIST:
+        {
+            if (!in.token_list(param.type == ParamType::NUMBERLIST ? is_digit : is_word_char, ';')) { return false; }
+            capture(start, in.pos);
+            return true;
+        }
+        case ParamType::KEYWORD:
+        {
+            for (auto const& keyword : param.keywords)
+            {
+                std::size_t end = start + keyword.size();
+                if (in.input.compare(start, keyword.size(), keyword) == 0 && (end == in.input.size() || is_space(in.input[end])))
+                {
+                    in.pos = end;
+                    capture(start, end);
+                    return true;
+                }
+            }
+            return false;
+        }
+        case ParamType::TEXT:
+        {
+            in.pos = in.input.size();
+            capture(start, in.pos);
+            return true;
+        }
+        case ParamType::OPTIONAL:
+        {
+            // Each parameter of the group is preceded by whitespace (except at the start of the
+            // parameters). If any of them does not match, the whole group is left unmatched and
+            // gives empty arguments.
+            std::size_t args_before = args.size();
+            for (auto const& p : param.group)
+            {
+                if ((in.skip_space() == 0 && in.pos > 0) || !match_param(in, p, args))
+                {
+                    in.pos = start;
+                    args.resize(args_before);
+                    args.resize(args_before + arg_count(param));
+                    return true;
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// The non-empty parts of text between separator characters
+vector<string> split(std::string_view text, bool (*is_separator)(char))
+{
+    vector<string> parts;
+    std::size_t pos = 0;
+    while (pos < text.size())
+    {
+        std::size_t end = pos;
+        while (end < text.size() && !is_separator(text[end])) { ++end; }
+        if (end > pos) { parts.emplace_back(text.substr(pos, end - pos)); }
+        pos = end + 1;
+    }
+    return parts;
+}
+
+bool is_list_separator(char c) { return c == ';'; }
+
+// <whitespace>cmd[<whitespace>params], where cmd is everything up to the first whitespace
+void split_command_line(std::string_view line, std::string_view& cmd, std::string_view& params)
+{
+    std::size_t cmd_start = 0;
+    while (cmd_start < line.size() && is_space(line[cmd_start])) { ++cmd_start; }
+    std::size_t cmd_end = cmd_start;
+    while (cmd_end < line.size() && !is_space(line[cmd_end])) { ++cmd_end; }
+    std::size_t params_start = cmd_end;
+    while (params_start < line.size() && is_space(line[params_start])) { ++params_start; }
+    cmd = line.substr(cmd_start, cmd_end - cmd_start);
+    params = line.substr(params_start);
+}
+
+PerfRecord latency_record(unsigned int n, string const& command, LatencyHistogram const& histogram)
+{
+    auto us = [](double nanoseconds) { return nanoseconds / 1000.0; };
+    return {n, command, histogram.count(), us(histogram.mean()), us(histogram.quantile(0.5)), us(histogram.quantile(0.99)),
+            us(histogram.quantile(0.999)), us(histogram.max())};
+}
+
+PerfRecord phase_record(unsigned int n, string const& phase, double seconds)
+{
+    double us = seconds * 1000000.0;
+    return {n, phase, 1, us, us, us, us, us};
+}
+
+// 64-bit FNV-1a hash, for the command outputs of traces
+std::uint64_t output_hash(std::string_view text)
+{
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (char c : text)
+    {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Percent change from before to after, 0 if before is 0
+double percent_change(double before, double after)
+{
+    return before > 0 ? (after - before) / before * 100.0 : 0.0;
+}
+
+// A pseudo-random permutation of 0..range-1 that needs no memory: a four round Feistel
+// network permutes the numbers of the smallest even number of bits covering range, and
+// values outside range are permuted again until they fall in it (cycle walking). As the
+// bits cover less than four times range, that takes a few rounds at most on average.
+class RandomPermutation
+{
+public:
+    template <typename Engine>
+    RandomPermutation(std::uint64_t range, Engine& engine) : range_(range)
+    {
+        while (half_bits_ < 32 && (std::uint64_t(1) << (2 * half_bits_)) < range) { ++half_bits_; }
+        mask_ = (std::uint64_t(1) << half_bits_) - 1;
+        for (auto& key : keys_) { key = std::uniform_int_distribution<std::uint64_t>()(engine); }
+    }
+
+    // The index'th value (index < range)
+    std::uint64_t operator()(std::uint64_t index) const
+    {
+        do { index = encrypt(index); } while (index >= range_);
+        return index;
+    }
+
+private:
+    std::uint64_t encrypt(std::uint64_t value) const
+    {
+        std::uint64_t left = value >> half_bits_;
+        std::uint64_t right = value & mask_;
+        for (std::uint64_t key : keys_)
+        {
+            // The round function is a 64-bit mix (the finalizer of splitmix64) of the key and the half
+            std::uint64_t mix = (right ^ key) * 0xbf58476d1ce4e5b9ULL;
+            mix = (mix ^ (mix >> 31)) * 0x94d049bb133111ebULL;
+            std::uint64_t next = left ^ ((mix ^ (mix >> 29)) & mask_);
+            left = right;
+            right = next;
+        }
+        return (left << half_bits_) | right;
+    }
+
+    std::uint64_t range_;
+    unsigned int half_bits_ = 0;
+    std::uint64_t mask_ = 0;
+    std::array<std::uint64_t, 4> keys_ = {};
+};
+
+} // namespace
+
 string const MainProgram::PROMPT = "> ";
 
 void MainProgram::test_get_functions(AffiliationID id)
@@ -222,6 +511,56 @@ void MainProgram::test_get_publications_after()
     }
 }
 
+MainProgram::CmdResult MainProgram::cmd_count_publications_in_years(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    Year from = convert_string_to<Year>(*begin++);
+    Year to = convert_string_to<Year>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto count = ds_.count_publications_in_years(from, to);
+    output << "Number of publications in years " << setw(4) << setfill('0') << from << "-" << setw(4) << setfill('0') << to << ": " << setfill(' ') << count << endl;
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_get_publications_in_years(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    Year from = convert_string_to<Year>(*begin++);
+    Year to = convert_string_to<Year>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto publications = ds_.get_publications_in_years(from, to);
+
+    if (!publications.empty())
+    {
+        output << "Publications in years " << setw(4) << setfill('0') << from << "-" << setw(4) << setfill('0') << to << ":" << endl;
+        for (auto& [pubyear, publicationid] : publications)
+        {
+            output << " " << publicationid << " at " << setw(4) << setfill('0') << pubyear << endl;
+        }
+        output << setfill(' ');
+    }
+    else
+    {
+        output << "No publications in years " << setw(4) << setfill('0') << from << "-" << setw(4) << setfill('0') << to << setfill(' ') << endl;
+    }
+
+    return {};
+}
+
+void MainProgram::test_count_publications_in_years()
+{
+    auto from = get_random_year();
+    ds_.count_publications_in_years(from, get_random_year(from));
+}
+
+void MainProgram::test_get_publications_in_years()
+{
+    // Keep the ranges narrow so that the test measures the index, not the copying of all publications
+    auto from = get_random_year();
+    ds_.get_publications_in_years(from, from + 10);
+}
+
 void MainProgram::test_change_affiliation_coord()
 {
     if (random_affiliations_added_ > 0) // Don't do anything if there's no affiliations
@@ -439,7 +778,8 @@ void MainProgram::add_random_affiliations_publications(unsigned int size, Coord
             auto name = n_to_name(random_affiliations_added_);
             AffiliationID id = n_to_affiliationid(random_affiliations_added_);
 
-            ds_.add_affiliation(id, name, get_random_coords(min, max));
+            ds_.add_affiliation(id, name, generator_.coords == CoordPlacement::CLUSTERED ? get_clustered_coords(min, max)
+                                                                                          : get_random_coords(min, max));
 
             ++random_affiliations_added_;
         }
@@ -459,23 +799,117 @@ void MainProgram::add_random_affiliations_publications(unsigned int size, Coord
     for (unsigned int i = 0; i< size; ++i) {
         auto publicationid = n_to_publicationid(random_publications_added_);
 
-        vector<AffiliationID> affiliations;
-        for (int j=0; j<4; ++j)
-        {
-            affiliations.push_back(random_affiliation());
-        }
+        // Publication i comes with affiliation i of this call (for power law growth)
+        vector<AffiliationID> affiliations = pick_publication_affiliations(4, random_affiliations_added_ - size + i + 1);
         ds_.add_publication(publicationid, convert_to_string(publicationid), get_random_year(), std::move(affiliations));
 
-        // Add area as subarea so that we get a binary tree
-        if (random_publications_added_ > 0)
+        PublicationID parentid = NO_PUBLICATION;
+        if (reference_parent(random_publications_added_, parentid))
         {
-            auto parentid = n_to_publicationid(random_publications_added_ / 2);
             ds_.add_reference(publicationid, parentid);
         }
         ++random_publications_added_;
     }
 }
 
+vector<AffiliationID> MainProgram::pick_publication_affiliations(unsigned int count, unsigned long int available)
+{
+    vector<AffiliationID> affiliations;
+    if (generator_.affiliations == AffiliationPick::UNIFORM)
+    {
+        for (unsigned int j = 0; j < count; ++j)
+        {
+            affiliations.push_back(random_affiliation());
+        }
+        return affiliations;
+    }
+
+    // Power law: an affiliation is picked with probability proportional to one plus the
+    // number of its publications, so those with many publications get ever more. The
+    // affiliations become available one by one, each in the publication it came with, so
+    // the older ones have had more chances.
+    available = std::min(available, random_affiliations_added_);
+    for (; attachment_affiliations_ < available; ++attachment_affiliations_)
+    {
+        attachment_.push_back(attachment_affiliations_);
+    }
+    if (attachment_.empty()) { return affiliations; }
+    vector<unsigned long int> picked;
+    if (available > 0) { picked.push_back(available - 1); }
+    for (unsigned int tries = 0; picked.size() < count && tries < 4 * count; ++tries)
+    {
+        auto aff = attachment_[random<std::size_t>(0, attachment_.size())];
+        if (std::find(picked.begin(), picked.end(), aff) == picked.end())
+        {
+            picked.push_back(aff);
+        }
+    }
+    for (auto aff : picked)
+    {
+        attachment_.push_back(aff);
+        affiliations.push_back(n_to_affiliationid(aff));
+    }
+    return affiliations;
+}
+
+Coord MainProgram::get_clustered_coords(Coord min, Coord max)
+{
+    // Cluster centers are uniform; cluster c is picked with weight 1/(c+1), so a few
+    // clusters are big and most are small, and spread normally around their center
+    if (cluster_centers_.size() != generator_.clusters)
+    {
+        cluster_centers_.clear();
+        for (unsigned int c = 0; c < generator_.clusters; ++c)
+        {
+            cluster_centers_.push_back(get_random_coords(min, max));
+        }
+    }
+    vector<double> weights;
+    for (unsigned int c = 0; c < generator_.clusters; ++c)
+    {
+        weights.push_back(1.0 / (c + 1));
+    }
+    Coord center = cluster_centers_[std::discrete_distribution<unsigned int>(weights.begin(), weights.end())(rand_engine_)];
+
+    double spread = std::sqrt(static_cast<double>(generator_.clusters)) * 4;
+    std::normal_distribution<double> dx(center.x, std::max(1.0, (max.x - min.x) / spread));
+    std::normal_distribution<double> dy(center.y, std::max(1.0, (max.y - min.y) / spread));
+    // Like get_random_coords, min is included and max is not
+    int x = std::clamp(static_cast<int>(std::lround(dx(rand_engine_))), min.x, std::max(min.x, max.x - 1));
+    int y = std::clamp(static_cast<int>(std::lround(dy(rand_engine_))), min.y, std::max(min.y, max.y - 1));
+    return {x, y};
+}
+
+bool MainProgram::reference_parent(unsigned long int n, PublicationID& parentid)
+{
+    if (generator_.references == ReferenceShape::BINARY)
+    {
+        if (n == 0) { return false; }
+        parentid = n_to_publicationid(n / 2);
+        return true;
+    }
+
+    // A forest of complete trees with the given branching and depth, filled breadth first:
+    // publication n is at position n % tree_size of its tree, and position p > 0 has the
+    // parent (p - 1) / branching
+    unsigned long int tree_size = std::numeric_limits<unsigned long int>::max();
+    if (generator_.max_depth > 0)
+    {
+        unsigned long int const limit = tree_size;
+        unsigned long int level = 1;
+        tree_size = 1;
+        for (unsigned int depth = 1; depth <= generator_.max_depth && tree_size <= n; ++depth)
+        {
+            level = level > (limit - tree_size) / generator_.branching ? limit - tree_size : level * generator_.branching;
+            tree_size += level;
+        }
+    }
+    unsigned long int position = n % tree_size;
+    if (position == 0) { return false; }
+    parentid = n_to_publicationid(n - position + (position - 1) / generator_.branching);
+    return true;
+}
+
 MainProgram::CmdResult MainProgram::cmd_random_affiliations(ostream& output, MatchIter begin, MatchIter end)
 {
     string sizestr = *begin++;
@@ -536,6 +970,75 @@ MainProgram::CmdResult MainProgram::cmd_random_affiliations(ostream& output, Mat
     return {};
 }
 
+MainProgram::CmdResult MainProgram::cmd_random_generator(ostream& output, MatchIter begin, MatchIter end)
+{
+    string aspect = *begin++;
+    string mode = *begin++;
+    string number1str = *begin++;
+    string number2str = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    unsigned int number1 = number1str.empty() ? 0 : convert_string_to<unsigned int>(number1str);
+    unsigned int number2 = number2str.empty() ? 0 : convert_string_to<unsigned int>(number2str);
+    RandomGenerator generator = generator_;
+    bool valid = true;
+    if (aspect.empty())
+    {
+        valid = number1str.empty();
+    }
+    else if (aspect == "affiliations")
+    {
+        valid = (mode == "uniform" || mode == "powerlaw") && number1str.empty();
+        generator.affiliations = (mode == "powerlaw") ? AffiliationPick::POWERLAW : AffiliationPick::UNIFORM;
+    }
+    else if (aspect == "coords")
+    {
+        // coords clustered [number_of_clusters]
+        valid = (mode == "uniform" && number1str.empty()) || (mode == "clustered" && number2str.empty() && (number1str.empty() || number1 > 0));
+        generator.coords = (mode == "clustered") ? CoordPlacement::CLUSTERED : CoordPlacement::UNIFORM;
+        if (!number1str.empty()) { generator.clusters = number1; }
+    }
+    else if (aspect == "references")
+    {
+        // references tree [branching [max_depth]]
+        valid = (mode == "binary" && number1str.empty()) || (mode == "tree" && (number1str.empty() || number1 > 0));
+        generator.references = (mode == "tree") ? ReferenceShape::TREE : ReferenceShape::BINARY;
+        if (mode == "tree")
+        {
+            generator.branching = number1str.empty() ? 2 : number1;
+            generator.max_depth = number2;
+        }
+    }
+
+    if (!valid)
+    {
+        output << "Invalid random generator setting! Use affiliations uniform|powerlaw, coords uniform|clustered [clusters]"
+               << " or references binary|tree [branching [max_depth]]" << endl;
+        return {};
+    }
+
+    generator_ = generator;
+    print_random_generator(output);
+    return {};
+}
+
+void MainProgram::print_random_generator(std::ostream& output) const
+{
+    output << "Random generator: affiliations " << (generator_.affiliations == AffiliationPick::POWERLAW ? "powerlaw" : "uniform");
+    output << ", coords ";
+    if (generator_.coords == CoordPlacement::CLUSTERED) { output << "clustered (" << generator_.clusters << " clusters)"; }
+    else { output << "uniform"; }
+    output << ", references ";
+    if (generator_.references == ReferenceShape::TREE)
+    {
+        output << "tree (branching " << generator_.branching;
+        if (generator_.max_depth > 0) { output << ", max depth " << generator_.max_depth; }
+        output << ")";
+    }
+    else { output << "binary"; }
+    output << endl;
+}
+
 void MainProgram::test_random_affiliations()
 {
     add_random_affiliations_publications(1);
@@ -613,6 +1116,12 @@ void MainProgram::test_get_all_connections()
     ds_.get_all_connections();
 }
 
+void MainProgram::test_visit_all_connections()
+{
+    unsigned long long int total_weight = 0;
+    ds_.visit_all_connections([&total_weight](std::string_view, std::string_view, Weight weight) { total_weight += weight; });
+}
+
 void MainProgram::test_get_any_path()
 {
     if (random_publications_added_ > 0 ){
@@ -663,43 +1172,56 @@ Year MainProgram::get_random_year(const Year min, const Year max)
 
 std::vector<Coord> MainProgram::get_unique_coords(const unsigned int n, const std::unordered_set<Coord, CoordHash> &exclude_list, const Coord min, const Coord max)
 {
-    const unsigned int max_unique_coords=abs(max.x-min.x)*abs(max.y-min.y)-exclude_list.size();
+    // Coordinates min.x..max.x-1, min.y..max.y-1 are numbered column by column
+    std::uint64_t width = max.x > min.x ? max.x - min.x : 0;
+    std::uint64_t height = max.y > min.y ? max.y - min.y : 0;
+    vector<std::uint64_t> excluded;
+    for (auto const& coord : exclude_list)
+    {
+        if (coord.x >= min.x && coord.x < max.x && coord.y >= min.y && coord.y < max.y)
+        {
+            excluded.push_back(static_cast<std::uint64_t>(coord.x - min.x) * height + static_cast<std::uint64_t>(coord.y - min.y));
+        }
+    }
+    const std::uint64_t max_unique_coords = width * height - excluded.size();
     if(n>max_unique_coords){
         throw NotImplemented("Impossible to create such number of unique coordinates within perimeters");
     }
-    //assert(n<max_unique_coords&&"Impossible to create such number of unique coordinates within perimeters");
-
-    if(n>max_unique_coords/2){
-        // let's not use the lottery in this case, let's list the coordinates not in use
-        std::vector<Coord> retvec;
-        retvec.reserve(max_unique_coords);
-        for(auto x = min.x; x<max.x;++x){
-            for(auto y=min.y;y<max.y;++y){
-                Coord newCoord ={x,y};
-                if(exclude_list.find(newCoord)==exclude_list.end()){
-                    retvec.push_back(newCoord);
-                }
-            }
-        }
-        // and get the required number of random_coordinates
-        std::shuffle(retvec.begin(),retvec.end(),rand_engine_);
-        retvec.erase(std::next(retvec.begin(),n),retvec.end());
-        return retvec;
-    } else {
+
+    if(n<=max_unique_coords/2){
+        // Sparse: draw coordinates until there are enough (the original random sequence)
         std::unordered_set<Coord,CoordHash> coords;
 
         coords.reserve(n);
+        unsigned int misses = 0; // In a row; crowded clusters fall back to uniform coordinates
         while(coords.size()<n){
-            Coord newCoord = get_random_coords(min, max);
-            if(exclude_list.find(newCoord)==exclude_list.end()){
-                coords.insert(newCoord);
+            bool clustered = generator_.coords == CoordPlacement::CLUSTERED && misses < 100;
+            Coord newCoord = clustered ? get_clustered_coords(min, max) : get_random_coords(min, max);
+            if(exclude_list.find(newCoord)==exclude_list.end() && coords.insert(newCoord).second){
+                misses = 0;
+            } else {
+                ++misses;
             }
         }
         std::vector<Coord> retvec(coords.begin(),coords.end());
         return retvec;
     }
 
-
+    // Dense: the first n of a random permutation of the free coordinates, without listing them:
+    // free coordinate f is coordinate f + k, where k is the number of excluded coordinates
+    // before it. The excluded coordinate i (in order) has excluded[i] - i free ones before it.
+    std::sort(excluded.begin(), excluded.end());
+    for (std::size_t i = 0; i < excluded.size(); ++i) { excluded[i] -= i; }
+    RandomPermutation permutation(max_unique_coords, rand_engine_);
+    std::vector<Coord> retvec;
+    retvec.reserve(n);
+    for (std::uint64_t i = 0; i < n; ++i)
+    {
+        std::uint64_t free = permutation(i);
+        std::uint64_t index = free + static_cast<std::uint64_t>(std::upper_bound(excluded.begin(), excluded.end(), free) - excluded.begin());
+        retvec.push_back({min.x + static_cast<int>(index / height), min.y + static_cast<int>(index % height)});
+    }
+    return retvec;
 }
 
 MainProgram::CmdResult MainProgram::cmd_get_affiliation_count(ostream& output, MatchIter begin, MatchIter end)
@@ -734,15 +1256,7 @@ MainProgram::CmdResult MainProgram::cmd_add_publication(std::ostream& /*output*/
 
     assert( begin == end && "Impossible number of parameters!");
 
-    vector<AffiliationID> affiliations;
-
-    smatch affil;
-    auto sbeg = affilsstr.cbegin();
-    auto send = affilsstr.cend();
-    for ( ; regex_search(sbeg, send, affil, affil_regex_); sbeg = affil.suffix().first)
-    {
-        affiliations.push_back(affil[1]);
-    }
+    vector<AffiliationID> affiliations = split(affilsstr, is_space);
     bool success = ds_.add_publication(id, name, year, affiliations);
 
     view_dirty = true;
@@ -984,6 +1498,35 @@ MainProgram::CmdResult MainProgram::cmd_get_all_connections(std::ostream &output
     return {ResultType::CONNECTIONLIST,connections};
 }
 
+MainProgram::CmdResult MainProgram::cmd_write_all_connections(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string filename = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    ofstream file(filename);
+    if (!file)
+    {
+        output << "Cannot open file '" << filename << "'!" << endl;
+        return {};
+    }
+
+    // Connections are streamed straight to the file, one "aff1<TAB>aff2<TAB>weight" line each
+    unsigned long long int count = 0;
+    ds_.visit_all_connections([&file, &count](std::string_view aff1, std::string_view aff2, Weight weight) {
+        file << aff1 << '\t' << aff2 << '\t' << weight << '\n';
+        ++count;
+    });
+    file.close();
+    if (!file)
+    {
+        output << "Error writing file '" << filename << "'!" << endl;
+        return {};
+    }
+
+    output << "Wrote " << count << " connections to '" << filename << "'" << endl;
+    return {};
+}
+
 MainProgram::CmdResult MainProgram::cmd_get_any_path(std::ostream &output, MatchIter begin, MatchIter end)
 {
     auto sourceid = convert_string_to<AffiliationID>(*begin++);
@@ -1140,6 +1683,7 @@ MainProgram::CmdResult MainProgram::cmd_read(std::ostream& output, MatchIter beg
 {
     string filename = *begin++;
     string silentstr =  *begin++;
+    string parallelstr = *begin++;
     assert( begin == end && "Impossible number of parameters!");
 
     bool silent = !silentstr.empty();
@@ -1155,7 +1699,14 @@ MainProgram::CmdResult MainProgram::cmd_read(std::ostream& output, MatchIter beg
     if (input)
     {
         output << "** Commands from '" << filename << "'" << endl;
-        command_parser(input, *new_output, PromptStyle::NORMAL);
+        if (!parallelstr.empty())
+        {
+            command_parser_parallel(input, *new_output);
+        }
+        else
+        {
+            command_parser(input, *new_output, PromptStyle::NORMAL);
+        }
         if (silent) { output << "...(output discarded in silent mode)..." << endl; }
         output << "** End of commands from '" << filename << "'" << endl;
     }
@@ -1281,29 +1832,212 @@ MainProgram::CmdResult MainProgram::cmd_testread(std::ostream& output, MatchIter
     return {};
 }
 
-MainProgram::CmdResult MainProgram::cmd_stopwatch(std::ostream& output, MatchIter begin, MatchIter end)
+bool MainProgram::is_traced(CmdInfo const& cmd)
 {
-    string on = *begin++;
-    string off = *begin++;
-    string next = *begin++;
-    assert(begin == end && "Invalid number of parameters");
+    return cmd.func != &MainProgram::cmd_read && cmd.func != &MainProgram::cmd_testread &&
+           cmd.func != &MainProgram::cmd_record && cmd.func != &MainProgram::cmd_replay;
+}
+
+MainProgram::CmdResult MainProgram::cmd_record(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string filename = *begin++;
+    string offstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
 
-    if (!on.empty())
+    if (filename.empty() == offstr.empty())
     {
-        stopwatch_mode = StopwatchMode::ON;
-        output << "Stopwatch: on" << endl;
+        output << "Give either a trace file name or 'off'!" << endl;
+        return {};
     }
-    else if (!off.empty())
+
+    if (trace_)
     {
-        stopwatch_mode = StopwatchMode::OFF;
-        output << "Stopwatch: off" << endl;
+        trace_->flush();
+        output << "Recorded " << traced_commands_ << " commands to '" << trace_filename_ << "'" << endl;
+        trace_.reset();
     }
-    else if (!next.empty())
+    else if (!offstr.empty())
     {
-        stopwatch_mode = StopwatchMode::NEXT;
-        output << "Stopwatch: on for the next command" << endl;
+        output << "Not recording!" << endl;
     }
-    else
+    if (filename.empty()) { return {}; }
+
+    auto trace = std::make_unique<ofstream>(filename);
+    if (!*trace)
+    {
+        output << "Cannot open file '" << filename << "'!" << endl;
+        return {};
+    }
+
+    // Reseed like random_seed, so that a replay gets the same random data and ids
+    unsigned long int seed = rand_engine_();
+    rand_engine_.seed(seed);
+    init_primes();
+    *trace << "# prg2 trace, seed " << seed << '\n'
+           << "# start_us\tlatency_ns\tresult_hash\tcommand" << '\n';
+
+    trace_ = move(trace);
+    trace_filename_ = filename;
+    trace_start_ = std::chrono::steady_clock::now();
+    traced_commands_ = 0;
+    output << "Recording commands to '" << filename << "' with random seed " << seed << endl;
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_replay(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string filename = *begin++;
+    string silentstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    ifstream input(filename);
+    if (!input)
+    {
+        output << "Cannot open file '" << filename << "'!" << endl;
+        return {};
+    }
+
+    ostringstream dummystr; // Given as output if "silent" is specified, the output is discarded
+    ostream& replay_output = silentstr.empty() ? output : dummystr;
+
+    // Recorded and replayed latencies of each command name
+    std::map<string, std::pair<LatencyHistogram, LatencyHistogram>> latencies;
+    std::uint64_t recorded_ns = 0;
+    std::uint64_t replayed_ns = 0;
+    unsigned long int commands = 0;
+    vector<string> mismatches; // "line: command" of the first ones
+    unsigned long int mismatch_count = 0;
+    unsigned int const MAX_MISMATCHES_SHOWN = 5;
+
+    output << "** Replaying commands from '" << filename << "'" << endl;
+    bool saved_capture = capture_commands_;
+    capture_commands_ = true;
+    string line;
+    unsigned long int lineno = 0;
+    while (getline(input, line))
+    {
+        ++lineno;
+        if (line.empty()) { continue; }
+        if (line.front() == '#')
+        {
+            auto seedpos = line.find("seed ");
+            if (seedpos != string::npos)
+            {
+                rand_engine_.seed(convert_string_to<unsigned long int>(line.substr(seedpos + 5)));
+                init_primes();
+            }
+            continue;
+        }
+
+        // start_us <tab> latency_ns <tab> result_hash <tab> command
+        std::size_t tab1 = line.find('\t');
+        std::size_t tab2 = tab1 == string::npos ? tab1 : line.find('\t', tab1 + 1);
+        std::size_t tab3 = tab2 == string::npos ? tab2 : line.find('\t', tab2 + 1);
+        std::uint64_t recorded_latency = 0;
+        std::uint64_t recorded_hash = 0;
+        try
+        {
+            if (tab3 == string::npos) { throw std::invalid_argument("missing field"); }
+            recorded_latency = std::stoull(line.substr(tab1 + 1, tab2 - tab1 - 1));
+            recorded_hash = std::stoull(line.substr(tab2 + 1, tab3 - tab2 - 1), nullptr, 16);
+        }
+        catch (std::exception const&)
+        {
+            output << "Invalid trace line " << lineno << "!" << endl;
+            continue;
+        }
+        string command = line.substr(tab3 + 1);
+
+        replay_output << PROMPT << command << endl;
+        last_command_ = {};
+        bool cont = command_parse_line(command, replay_output);
+        view_dirty = false; // No need to keep track of individual result changes
+        ++commands;
+
+        if (last_command_.hash != recorded_hash)
+        {
+            if (mismatches.size() < MAX_MISMATCHES_SHOWN) { mismatches.push_back(std::to_string(lineno) + ": " + command); }
+            ++mismatch_count;
+        }
+        std::string_view cmdname, params;
+        split_command_line(command, cmdname, params);
+        auto& [recorded, replayed] = latencies[string(cmdname)];
+        recorded.record(recorded_latency);
+        replayed.record(last_command_.latency_ns);
+        recorded_ns += recorded_latency;
+        replayed_ns += last_command_.latency_ns;
+
+        if (!cont) { break; }
+    }
+    capture_commands_ = saved_capture;
+    view_dirty = true;
+
+    if (!silentstr.empty()) { output << "...(output discarded in silent mode)..." << endl; }
+    output << "** End of commands from '" << filename << "'" << endl;
+
+    if (mismatch_count == 0)
+    {
+        output << "Replayed " << commands << " commands, all results match the trace." << endl;
+    }
+    else
+    {
+        output << "Replayed " << commands << " commands, **" << mismatch_count << " results differ from the trace!** First on trace lines:" << endl;
+        for (auto const& mismatch : mismatches)
+        {
+            output << "  " << mismatch << endl;
+        }
+    }
+
+    auto per_second = [commands](std::uint64_t ns) { return ns > 0 ? static_cast<double>(commands) * 1e9 / static_cast<double>(ns) : 0.0; };
+    output << "Command time: recorded " << recorded_ns / 1e9 << " sec (" << per_second(recorded_ns) << " commands/sec), replay "
+           << replayed_ns / 1e9 << " sec (" << per_second(replayed_ns) << " commands/sec), "
+           << std::showpos << std::fixed << std::setprecision(1) << percent_change(static_cast<double>(recorded_ns), static_cast<double>(replayed_ns))
+           << std::noshowpos << std::defaultfloat << std::setprecision(6) << " %" << endl;
+
+    if (!latencies.empty())
+    {
+        output << setw(30) << std::left << "command" << std::right << " , " << setw(9) << "count" << " , " << setw(12) << "mean (us)"
+               << " , " << setw(12) << "replay" << " , " << setw(9) << "delta %" << " , " << setw(12) << "p99 (us)" << " , "
+               << setw(12) << "replay" << " , " << setw(9) << "delta %" << endl;
+        for (auto const& [name, histograms] : latencies)
+        {
+            auto const& [recorded, replayed] = histograms;
+            auto p99 = [](LatencyHistogram const& histogram) { return static_cast<double>(histogram.quantile(0.99)); };
+            output << setw(30) << std::left << name << std::right << " , " << setw(9) << recorded.count() << " , "
+                   << setw(12) << recorded.mean() / 1000.0 << " , " << setw(12) << replayed.mean() / 1000.0 << " , "
+                   << std::fixed << std::setprecision(1) << setw(9) << percent_change(recorded.mean(), replayed.mean())
+                   << std::defaultfloat << std::setprecision(6) << " , "
+                   << setw(12) << p99(recorded) / 1000.0 << " , " << setw(12) << p99(replayed) / 1000.0 << " , "
+                   << std::fixed << std::setprecision(1) << setw(9) << percent_change(p99(recorded), p99(replayed))
+                   << std::defaultfloat << std::setprecision(6) << endl;
+        }
+    }
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_stopwatch(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string mode = *begin++;
+    assert(begin == end && "Invalid number of parameters");
+
+    if (mode == "on")
+    {
+        stopwatch_mode = StopwatchMode::ON;
+        output << "Stopwatch: on" << endl;
+    }
+    else if (mode == "off")
+    {
+        stopwatch_mode = StopwatchMode::OFF;
+        output << "Stopwatch: off" << endl;
+    }
+    else if (mode == "next")
+    {
+        stopwatch_mode = StopwatchMode::NEXT;
+        output << "Stopwatch: on for the next command" << endl;
+    }
+    else
     {
         assert(!"Impossible stopwatch mode!");
     }
@@ -1365,64 +2099,102 @@ std::string MainProgram::print_coord(Coord coord, std::ostream& output, bool nl)
     }
 }
 
-string const affiliationidx = "([a-zA-Z0-9-]+)";
-string const affiliationlistx = "(?:[a-zA-Z0-9-]+)";
-string const publicationidx = "([0-9]+)";
-string const namex = "([ a-zA-Z0-9-]+)";
-string const timex = "([0-9]+)";
-string const numx = "([0-9]+)";
-string const optcoordx = "\\([[:space:]]*[0-9]+[[:space:]]*,[[:space:]]*[0-9]+[[:space:]]*\\)";
-string const coordx = "\\([[:space:]]*([0-9]+)[[:space:]]*,[[:space:]]*([0-9]+)[[:space:]]*\\)";
-string const wsx = "[[:space:]]+";
+MainProgram::Param const affiliationidx{MainProgram::ParamType::AFFILIATIONID};
+MainProgram::Param const publicationidx{MainProgram::ParamType::NUMBER};
+MainProgram::Param const namex{MainProgram::ParamType::NAME};
+MainProgram::Param const timex{MainProgram::ParamType::NUMBER};
+MainProgram::Param const numx{MainProgram::ParamType::NUMBER};
+MainProgram::Param const coordx{MainProgram::ParamType::COORD};
+MainProgram::Param const filenamex{MainProgram::ParamType::FILENAME};
+MainProgram::Param const affiliationlistx{MainProgram::ParamType::AFFILIATIONLIST};
+MainProgram::Param const cmdlistx{MainProgram::ParamType::WORDLIST};
+MainProgram::Param const numlistx{MainProgram::ParamType::NUMBERLIST};
+MainProgram::Param const textx{MainProgram::ParamType::TEXT};
+
+static MainProgram::Param keywordx(vector<string> alternatives)
+{
+    return {MainProgram::ParamType::KEYWORD, move(alternatives)};
+}
+
+static MainProgram::Param optionalx(vector<MainProgram::Param> group)
+{
+    return {MainProgram::ParamType::OPTIONAL, {}, move(group)};
+}
 
 
 vector<MainProgram::CmdInfo> MainProgram::cmds_ =
 {
-    {"get_affiliation_count", "", "", &MainProgram::cmd_get_affiliation_count, &MainProgram::test_get_affiliation_count },
-    {"clear_all", "", "", &MainProgram::cmd_clear_all, nullptr }, // clear all probably shouldn't be perftested since it will ... clear everything
-    {"get_all_affiliations", "", "", &MainProgram::cmd_get_all_affiliations, &MainProgram::NoParListTestCmd<&Datastructures::get_all_affiliations>},
-    {"add_affiliation", "AffiliationID \"Name\" (x,y)", affiliationidx+wsx+'"'+namex+'"'+wsx+coordx, &MainProgram::cmd_add_affiliation, nullptr }, // tested within each perftest, separate perftesting not necessary
-    {"affiliation_info", "AffiliationID", affiliationidx, &MainProgram::cmd_affiliation_info, &MainProgram::test_affiliation_info },
-    {"get_affiliations_alphabetically", "", "", &MainProgram::NoParListCmd<&Datastructures::get_affiliations_alphabetically>, &MainProgram::NoParListTestCmd<&Datastructures::get_affiliations_alphabetically> },
-    {"get_affiliations_distance_increasing", "", "", &MainProgram::NoParListCmd<&Datastructures::get_affiliations_distance_increasing>,
-     &MainProgram::NoParListTestCmd<&Datastructures::get_affiliations_distance_increasing> },
-    {"find_affiliation_with_coord", "(x,y)", coordx, &MainProgram::cmd_find_affiliation_with_coord, &MainProgram::test_find_affiliation_with_coord },
-    {"change_affiliation_coord", "AffiliationID (x,y)", affiliationidx+wsx+coordx, &MainProgram::cmd_change_affiliation_coord, &MainProgram::test_change_affiliation_coord },
-    {"get_publications_after", "AffiliationID Time", affiliationidx+wsx+timex, &MainProgram::cmd_get_publications_after, &MainProgram::test_get_publications_after },
-    {"add_publication", "PublicationID \"Name\" Year AffiliationID AffiliationID ...", publicationidx+wsx+'"'+namex+'"'+wsx+timex+"((?:"+wsx+affiliationlistx+")*)", &MainProgram::cmd_add_publication, nullptr }, // tested within each perftest, separate perftesting not necessary
-    {"get_all_publications", "", "", &MainProgram::cmd_get_all_publications, &MainProgram::test_get_all_publications},
-    {"publication_info", "PublicationID", publicationidx, &MainProgram::cmd_publication_info, &MainProgram::test_publication_info },
-    {"add_reference", "PublicationID parentPublicationID", publicationidx+wsx+publicationidx, &MainProgram::cmd_add_reference, nullptr },
-    {"add_affiliation_to_publication", "AffiliationID PublicationID", affiliationidx+wsx+publicationidx, &MainProgram::cmd_add_affiliation_to_publication, &MainProgram::test_add_affiliation_to_publication},
-    {"get_publications", "AffiliationID", affiliationidx, &MainProgram::cmd_get_publications, &MainProgram::test_get_publications },
-    {"get_all_references", "PublicationID", publicationidx, &MainProgram::cmd_get_all_references, &MainProgram::test_get_all_references },
-    {"get_affiliations_closest_to", "(x,y)", coordx, &MainProgram::cmd_get_affiliations_closest_to, &MainProgram::test_affiliations_closest_to },
-    {"remove_affiliation", "AffiliationID", affiliationidx, &MainProgram::cmd_remove_affiliation, &MainProgram::test_remove_affiliation },
-    {"get_closest_common_parent", "PublicationID1 PublicationID2", publicationidx+wsx+publicationidx, &MainProgram::cmd_get_closest_common_parent, &MainProgram::test_get_closest_common_parent },
-    {"quit", "", "", nullptr, nullptr },
-    {"help", "", "", &MainProgram::help_command, nullptr },
+    {"get_affiliation_count", "", {}, &MainProgram::cmd_get_affiliation_count, &MainProgram::test_get_affiliation_count, true },
+    {"clear_all", "", {}, &MainProgram::cmd_clear_all, nullptr }, // clear all probably shouldn't be perftested since it will ... clear everything
+    {"get_all_affiliations", "", {}, &MainProgram::cmd_get_all_affiliations, &MainProgram::NoParListTestCmd<&Datastructures::get_all_affiliations>, true },
+    {"add_affiliation", "AffiliationID \"Name\" (x,y)", {affiliationidx, namex, coordx}, &MainProgram::cmd_add_affiliation, nullptr }, // tested within each perftest, separate perftesting not necessary
+    {"affiliation_info", "AffiliationID", {affiliationidx}, &MainProgram::cmd_affiliation_info, &MainProgram::test_affiliation_info, true },
+    {"get_affiliations_alphabetically", "", {}, &MainProgram::NoParListCmd<&Datastructures::get_affiliations_alphabetically>, &MainProgram::NoParListTestCmd<&Datastructures::get_affiliations_alphabetically>, true },
+    {"get_affiliations_distance_increasing", "", {}, &MainProgram::NoParListCmd<&Datastructures::get_affiliations_distance_increasing>,
+     &MainProgram::NoParListTestCmd<&Datastructures::get_affiliations_distance_increasing>, true },
+    {"find_affiliation_with_coord", "(x,y)", {coordx}, &MainProgram::cmd_find_affiliation_with_coord, &MainProgram::test_find_affiliation_with_coord, true },
+    {"change_affiliation_coord", "AffiliationID (x,y)", {affiliationidx, coordx}, &MainProgram::cmd_change_affiliation_coord, &MainProgram::test_change_affiliation_coord },
+    {"get_publications_after", "AffiliationID Time", {affiliationidx, timex}, &MainProgram::cmd_get_publications_after, &MainProgram::test_get_publications_after, true },
+    {"add_publication", "PublicationID \"Name\" Year AffiliationID AffiliationID ...", {publicationidx, namex, timex, affiliationlistx}, &MainProgram::cmd_add_publication, nullptr }, // tested within each perftest, separate perftesting not necessary
+    {"get_all_publications", "", {}, &MainProgram::cmd_get_all_publications, &MainProgram::test_get_all_publications, true },
+    {"publication_info", "PublicationID", {publicationidx}, &MainProgram::cmd_publication_info, &MainProgram::test_publication_info, true },
+    {"add_reference", "PublicationID parentPublicationID", {publicationidx, publicationidx}, &MainProgram::cmd_add_reference, nullptr },
+    {"add_affiliation_to_publication", "AffiliationID PublicationID", {affiliationidx, publicationidx}, &MainProgram::cmd_add_affiliation_to_publication, &MainProgram::test_add_affiliation_to_publication},
+    {"get_publications", "AffiliationID", {affiliationidx}, &MainProgram::cmd_get_publications, &MainProgram::test_get_publications, true },
+    {"get_all_references", "PublicationID", {publicationidx}, &MainProgram::cmd_get_all_references, &MainProgram::test_get_all_references, true },
+    {"get_affiliations_closest_to", "(x,y)", {coordx}, &MainProgram::cmd_get_affiliations_closest_to, &MainProgram::test_affiliations_closest_to, true },
+    {"remove_affiliation", "AffiliationID", {affiliationidx}, &MainProgram::cmd_remove_affiliation, &MainProgram::test_remove_affiliation },
+    {"get_closest_common_parent", "PublicationID1 PublicationID2", {publicationidx, publicationidx}, &MainProgram::cmd_get_closest_common_parent, &MainProgram::test_get_closest_common_parent, true },
+    {"quit", "", {}, nullptr, nullptr },
+    {"help", "", {}, &MainProgram::help_command, nullptr },
     {"random_add", "number_of_affiliations_to_add  (minx,miny) (maxx,maxy) (coordinates optional)",
-     numx+"(?:"+wsx+coordx+wsx+coordx+")?", &MainProgram::cmd_random_affiliations, &MainProgram::test_random_affiliations },
-    {"read", "\"in-filename\" [silent]", "\"([-a-zA-Z0-9 ./:_]+)\"(?:"+wsx+"(silent))?", &MainProgram::cmd_read, nullptr },
-    {"testread", "\"in-filename\" \"out-filename\"", "\"([-a-zA-Z0-9 ./:_]+)\""+wsx+"\"([-a-zA-Z0-9 ./:_]+)\"", &MainProgram::cmd_testread, nullptr },
-    {"perftest", "cmd1[;cmd2...] timeout repeat_count n1[;n2...] (parts in [] are optional, alternatives separated by |)",
-     "([0-9a-zA-Z_]+(?:;[0-9a-zA-Z_]+)*)"+wsx+numx+wsx+numx+wsx+"([0-9]+(?:;[0-9]+)*)", &MainProgram::cmd_perftest, nullptr },
-    {"stopwatch", "on|off|next (alternatives separated by |)", "(?:(on)|(off)|(next))", &MainProgram::cmd_stopwatch, nullptr },
-    {"random_seed", "new-random-seed-integer", numx, &MainProgram::cmd_randseed, nullptr },
-    {"#", "comment text", ".*", &MainProgram::cmd_comment, nullptr },
-    {"remove_publication","PublicationID",publicationidx, &MainProgram::cmd_remove_publication, &MainProgram::test_remove_publication},
-    {"get_parent","PublicationID",publicationidx,&MainProgram::cmd_get_parent, &MainProgram::test_get_parent},
-    {"get_referenced_by_chain","PublicationID",publicationidx,&MainProgram::cmd_get_referenced_by_chain,&MainProgram::test_get_referenced_by_chain},
-    {"get_affiliations", "PublicationID", publicationidx, &MainProgram::cmd_get_affiliations, &MainProgram::test_get_affiliations},
-    {"get_direct_references", "PublicationID", publicationidx, &MainProgram::cmd_get_direct_references, &MainProgram::test_get_direct_references},
+     {numx, optionalx({coordx, coordx})}, &MainProgram::cmd_random_affiliations, &MainProgram::test_random_affiliations },
+    {"random_generator", "[affiliations|coords|references uniform|powerlaw|clustered|binary|tree [number] [number]] (parts in [] are optional, alternatives separated by |)",
+     {optionalx({keywordx({"affiliations", "coords", "references"}), keywordx({"uniform", "powerlaw", "clustered", "binary", "tree"})}),
+      optionalx({numx}), optionalx({numx})}, &MainProgram::cmd_random_generator, nullptr },
+    {"read", "\"in-filename\" [silent] [parallel]", {filenamex, optionalx({keywordx({"silent"})}), optionalx({keywordx({"parallel"})})},
+     &MainProgram::cmd_read, nullptr },
+    {"testread", "\"in-filename\" \"out-filename\"", {filenamex, filenamex}, &MainProgram::cmd_testread, nullptr },
+    {"record", "\"trace-filename\"|off (alternatives separated by |)", {optionalx({filenamex}), optionalx({keywordx({"off"})})},
+     &MainProgram::cmd_record, nullptr },
+    {"replay", "\"trace-filename\" [silent]", {filenamex, optionalx({keywordx({"silent"})})}, &MainProgram::cmd_replay, nullptr },
+    {"perftest", "cmd1[;cmd2...] timeout repeat_count n1[;n2...] [latency] [csv] [fit] [save \"out-filename\"] [compare \"baseline-filename\" [max_slowdown_percent]] (parts in [] are optional, alternatives separated by |)",
+     {cmdlistx, numx, numx, numlistx, optionalx({keywordx({"latency"})}), optionalx({keywordx({"csv"})}),
+      optionalx({keywordx({"fit"})}), optionalx({keywordx({"save"}), filenamex}), optionalx({keywordx({"compare"}), filenamex}), optionalx({numx})},
+     &MainProgram::cmd_perftest, nullptr },
+    {"stopwatch", "on|off|next (alternatives separated by |)", {keywordx({"on", "off", "next"})}, &MainProgram::cmd_stopwatch, nullptr },
+    {"random_seed", "new-random-seed-integer", {numx}, &MainProgram::cmd_randseed, nullptr },
+    {"#", "comment text", {textx}, &MainProgram::cmd_comment, nullptr, true },
+    {"remove_publication","PublicationID",{publicationidx}, &MainProgram::cmd_remove_publication, &MainProgram::test_remove_publication},
+    {"get_parent","PublicationID",{publicationidx},&MainProgram::cmd_get_parent, &MainProgram::test_get_parent, true },
+    {"get_referenced_by_chain","PublicationID",{publicationidx},&MainProgram::cmd_get_referenced_by_chain,&MainProgram::test_get_referenced_by_chain, true },
+    {"get_affiliations", "PublicationID", {publicationidx}, &MainProgram::cmd_get_affiliations, &MainProgram::test_get_affiliations, true },
+    {"get_direct_references", "PublicationID", {publicationidx}, &MainProgram::cmd_get_direct_references, &MainProgram::test_get_direct_references, true },
     // prg2
-    {"get_connected_affiliations","AffiliationID", affiliationidx, &MainProgram::cmd_get_connected_affiliations,&MainProgram::test_get_connected_affiliations},
-    {"get_all_connections","","",&MainProgram::cmd_get_all_connections,&MainProgram::test_get_all_connections},
-    {"get_any_path", "AffiliationID AffiliationID", affiliationidx+wsx+affiliationidx,&MainProgram::cmd_get_any_path,&MainProgram::test_get_any_path},
+    {"get_connected_affiliations","AffiliationID", {affiliationidx}, &MainProgram::cmd_get_connected_affiliations,&MainProgram::test_get_connected_affiliations, true },
+    {"get_all_connections","",{},&MainProgram::cmd_get_all_connections,&MainProgram::test_get_all_connections, true },
+    {"write_all_connections", "\"out-filename\"", {filenamex}, &MainProgram::cmd_write_all_connections, &MainProgram::test_visit_all_connections},
+    {"get_any_path", "AffiliationID AffiliationID", {affiliationidx, affiliationidx},&MainProgram::cmd_get_any_path,&MainProgram::test_get_any_path, true },
     // prg2 optional
-    {"get_path_with_least_affiliations", "AffiliationID AffiliationID", affiliationidx+wsx+affiliationidx,&MainProgram::cmd_get_path_with_least_affiliations,&MainProgram::test_get_path_with_least_affiliations},
-    {"get_path_of_least_friction", "AffiliationID AffiliationID", affiliationidx+wsx+affiliationidx,&MainProgram::cmd_get_path_of_least_friction,&MainProgram::test_get_path_of_least_friction},
-    {"get_shortest_path", "AffiliationID AffiliationID", affiliationidx+wsx+affiliationidx,&MainProgram::cmd_get_shortest_path,&MainProgram::test_get_shortest_path},
+    {"get_path_with_least_affiliations", "AffiliationID AffiliationID", {affiliationidx, affiliationidx},&MainProgram::cmd_get_path_with_least_affiliations,&MainProgram::test_get_path_with_least_affiliations, true },
+    {"get_path_of_least_friction", "AffiliationID AffiliationID", {affiliationidx, affiliationidx},&MainProgram::cmd_get_path_of_least_friction,&MainProgram::test_get_path_of_least_friction, true },
+    {"get_shortest_path", "AffiliationID AffiliationID", {affiliationidx, affiliationidx},&MainProgram::cmd_get_shortest_path,&MainProgram::test_get_shortest_path, true },
+    // year range queries
+    {"count_publications_in_years", "Year Year", {timex, timex}, &MainProgram::cmd_count_publications_in_years, &MainProgram::test_count_publications_in_years, true },
+    {"get_publications_in_years", "Year Year", {timex, timex}, &MainProgram::cmd_get_publications_in_years, &MainProgram::test_get_publications_in_years, true },
+    // snapshots
+    {"save_snapshot", "\"out-filename\" [noindex]", {filenamex, optionalx({keywordx({"noindex"})})}, &MainProgram::cmd_save_snapshot, nullptr},
+    {"load_snapshot", "\"in-filename\"", {filenamex}, &MainProgram::cmd_load_snapshot, nullptr},
+    {"map_snapshot", "\"in-filename\"", {filenamex}, &MainProgram::cmd_map_snapshot, nullptr},
+    {"epoch", "publish|drop (alternatives separated by |)", {keywordx({"publish", "drop"})}, &MainProgram::cmd_epoch, nullptr},
+    // bulk import
+    {"import", "\"in-filename\" affiliations|publications [header]", {filenamex, keywordx({"affiliations", "publications"}), optionalx({keywordx({"header"})})}, &MainProgram::cmd_import, nullptr},
+    // micro-benchmarks
+    {"nearest_benchmark", "number_of_coordinates number_of_queries", {numx, numx}, &MainProgram::cmd_nearest_benchmark, nullptr},
+    // diagnostics
+    {"memory_usage", "", {}, &MainProgram::cmd_memory_usage, nullptr, true},
+    {"stats", "[clear] [folded \"out-filename\"] (parts in [] are optional)", {optionalx({keywordx({"clear"})}), optionalx({keywordx({"folded"}), filenamex})},
+     &MainProgram::cmd_stats, nullptr},
 
 };
 
@@ -1450,40 +2222,66 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
     unsigned int timeout = convert_string_to<unsigned int>(*begin++);
     unsigned int repeat_count = convert_string_to<unsigned int>(*begin++);
     string sizes = *begin++;
+    string latencystr = *begin++;
+    string csvstr = *begin++;
+    string fitstr = *begin++;
+    ++begin; // save
+    string savefile = *begin++;
+    ++begin; // compare
+    string baselinefile = *begin++;
+    string slowdownstr = *begin++;
     assert(begin == end && "Invalid number of parameters");
 
-    vector<string> testcmds;
-    smatch scmd;
-    auto cbeg = commandstr.cbegin();
-    auto cend = commandstr.cend();
-    for ( ; regex_search(cbeg, cend, scmd, commands_regex_); cbeg = scmd.suffix().first)
+    // csv prints the per-command latencies as comma separated values, so it implies latency
+    bool latency_csv = !csvstr.empty();
+    bool latency = !latencystr.empty() || latency_csv;
+    // Fitting needs the per-command times, but does not print them
+    bool fit = !fitstr.empty();
+    bool time_commands = latency || fit;
+
+    // Results of all N, for saving and comparing against the baseline
+    vector<PerfRecord> records;
+    vector<PerfRecord> baseline;
+    double max_slowdown_percent = slowdownstr.empty() ? 10 : convert_string_to<unsigned int>(slowdownstr);
+    if (!baselinefile.empty())
+    {
+        ifstream file(baselinefile);
+        if (!file || !read_perf_results(file, baseline))
+        {
+            output << "Cannot read baseline results from '" << baselinefile << "'!" << endl;
+            return {};
+        }
+    }
+    else if (!slowdownstr.empty())
     {
-        testcmds.push_back(scmd[1]);
+        output << "A maximum slowdown needs a baseline to compare against!" << endl;
+        return {};
     }
 
+    vector<string> testcmds = split(commandstr, is_list_separator);
 
     vector<unsigned int> init_ns;
-    smatch size;
-    auto sbeg = sizes.cbegin();
-    auto send = sizes.cend();
-    for ( ; regex_search(sbeg, send, size, sizes_regex_); sbeg = size.suffix().first)
+    for (auto const& size : split(sizes, is_list_separator))
     {
-        init_ns.push_back(convert_string_to<unsigned int>(size[1]));
+        init_ns.push_back(convert_string_to<unsigned int>(size));
     }
 
     output << "Timeout for each N is " << timeout << " sec. " << endl;
+    print_random_generator(output);
     output << "For each N perform " << repeat_count << " random command(s) from:" << endl;
 
     // Initialize test functions
     vector<void(MainProgram::*)()> testfuncs;
+    vector<string> testnames;
 
     for (auto& i : testcmds)
     {
-        auto pos = find_if(cmds_.begin(), cmds_.end(), [&i](auto const& cmd){ return cmd.cmd == i; });
-        if (pos != cmds_.end() && pos->testfunc)
+        auto pos = find_cmd(i);
+        if (pos && pos->testfunc)
         {
             output << i << " ";
             testfuncs.push_back(pos->testfunc);
+            testnames.push_back(i);
         }
         else
         {
@@ -1506,8 +2304,15 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
     output << setw(7) << "N" << " , " << setw(12) << "add (sec)" << " , " << setw(12) << "cmds (sec)" << " , "
            << setw(12) << "total (sec)" << endl;
 #endif
+    if (latency_csv)
+    {
+        output << "N,command,count,mean_us,p50_us,p99_us,p99.9_us,max_us" << endl;
+    }
     flush_output(output);
 
+    // Latency of each invocation of each test function, for the current N
+    vector<LatencyHistogram> latencies(time_commands ? testfuncs.size() : 0);
+
     auto stop = false;
     for (unsigned int n : init_ns)
     {
@@ -1554,7 +2359,12 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
         }
 
 #ifdef USE_PERF_EVENT
-        auto addcount = stopwatch.count();
+        auto addcounts = stopwatch.counts();
+        auto addcount = addcounts[Stopwatch::INSTRUCTIONS];
+#endif
+#ifdef USE_ALLOC_COUNT
+        auto addallocs = stopwatch.allocations();
+        stopwatch.reset_peak();
 #endif
         auto addsec = stopwatch.elapsed();
 
@@ -1571,12 +2381,27 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
             break;
         }
 
+        for (auto& histogram : latencies)
+        {
+            histogram.clear();
+        }
+
         stopwatch.start();
         for (unsigned int repeat = 0; repeat < repeat_count; ++repeat)
         {
             auto cmdpos = random(testfuncs.begin(), testfuncs.end());
 
-            (this->**cmdpos)();
+            if (time_commands)
+            {
+                auto cmdstart = Stopwatch::Clock::now();
+                (this->**cmdpos)();
+                auto cmdtime = std::chrono::duration_cast<std::chrono::nanoseconds>(Stopwatch::Clock::now() - cmdstart);
+                latencies[cmdpos - testfuncs.begin()].record(static_cast<std::uint64_t>(cmdtime.count()));
+            }
+            else
+            {
+                (this->**cmdpos)();
+            }
 
             if (repeat % 10 == 0)
             {
@@ -1600,7 +2425,8 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
         if (stop) { break; }
 
 #ifdef USE_PERF_EVENT
-        auto totalcount = stopwatch.count();
+        auto totalcounts = stopwatch.counts();
+        auto totalcount = totalcounts[Stopwatch::INSTRUCTIONS];
 #endif
         auto totalsec = stopwatch.elapsed();
 
@@ -1611,12 +2437,76 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
 #endif
 
         output << endl;
+#if defined(USE_PERF_EVENT) || defined(USE_ALLOC_COUNT)
+        // All counters and allocations of the row, one phase per line
+        char const* const phases[] = {"add", "cmds", "total"};
+#ifdef USE_PERF_EVENT
+        Stopwatch::Counts cmdcounts;
+        for (std::size_t i = 0; i < Stopwatch::COUNTER_COUNT; ++i) { cmdcounts[i] = totalcounts[i] - addcounts[i]; }
+        Stopwatch::Counts const phasecounts[] = {addcounts, cmdcounts, totalcounts};
+#endif
+#ifdef USE_ALLOC_COUNT
+        AllocationCounts cmdallocs = stopwatch.allocations(); // Its peak is that of the commands only
+        AllocationCounts totalallocs = cmdallocs;
+        cmdallocs.allocations -= addallocs.allocations;
+        cmdallocs.bytes -= addallocs.bytes;
+        totalallocs.peak_live_bytes = std::max(addallocs.peak_live_bytes, cmdallocs.peak_live_bytes);
+        AllocationCounts const phaseallocs[] = {addallocs, cmdallocs, totalallocs};
+#endif
+        for (std::size_t phase = 0; phase < 3; ++phase)
+        {
+            output << setw(7) << "" << "   " << std::left << setw(5) << phases[phase] << std::right;
+#ifdef USE_PERF_EVENT
+            stopwatch.print_counts(output, phasecounts[phase]);
+#endif
+#ifdef USE_ALLOC_COUNT
+            Stopwatch::print_allocations(output, phaseallocs[phase]);
+#endif
+            output << endl;
+        }
+#endif
+
+        records.push_back(phase_record(n, PERF_PHASE_ADD, addsec));
+        records.push_back(phase_record(n, PERF_PHASE_CMDS, totalsec - addsec));
+        records.push_back(phase_record(n, PERF_PHASE_TOTAL, totalsec));
+        vector<PerfRecord> latency_records;
+        for (std::size_t i = 0; i < latencies.size(); ++i)
+        {
+            if (latencies[i].count() > 0)
+            {
+                latency_records.push_back(latency_record(n, testnames[i], latencies[i]));
+            }
+        }
+        if (latency)
+        {
+            print_latencies(output, latency_records, latency_csv);
+        }
+        records.insert(records.end(), latency_records.begin(), latency_records.end());
         flush_output(output);
     }
 
     ds_.clear_all();
     init_primes();
 
+    if (fit)
+    {
+        print_complexity_fits(output, records);
+    }
+
+    if (!savefile.empty())
+    {
+        ofstream file(savefile);
+        if (perf_results_json_file(savefile)) { write_perf_results_json(file, records); }
+        else { write_perf_results_csv(file, records); }
+        if (file) { output << "Saved results to '" << savefile << "'" << endl; }
+        else { output << "Cannot save results to '" << savefile << "'!" << endl; }
+    }
+
+    if (!baselinefile.empty())
+    {
+        print_regressions(output, baselinefile, find_perf_regressions(baseline, records, max_slowdown_percent), max_slowdown_percent);
+    }
+
     }
     catch (NotImplemented const&)
     {
@@ -1633,190 +2523,708 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
     return {};
 }
 
+void MainProgram::print_latencies(std::ostream& output, vector<PerfRecord> const& records, bool csv)
+{
+    if (!csv)
+    {
+        output << setw(7) << "" << "   " << setw(40) << std::left << "command" << std::right << " , " << setw(9) << "count" << " , "
+               << setw(12) << "mean (us)" << " , " << setw(12) << "p50 (us)" << " , " << setw(12) << "p99 (us)" << " , "
+               << setw(12) << "p99.9 (us)" << " , " << setw(12) << "max (us)" << endl;
+    }
+    for (auto const& record : records)
+    {
+        if (csv)
+        {
+            output << record.n << "," << record.command << "," << record.count << "," << record.mean_us << ","
+                   << record.p50_us << "," << record.p99_us << "," << record.p999_us << "," << record.max_us << endl;
+        }
+        else
+        {
+            output << setw(7) << "" << "   " << setw(40) << std::left << record.command << std::right << " , " << setw(9) << record.count << " , "
+                   << setw(12) << record.mean_us << " , " << setw(12) << record.p50_us << " , " << setw(12) << record.p99_us << " , "
+                   << setw(12) << record.p999_us << " , " << setw(12) << record.max_us << endl;
+        }
+    }
+}
+
+void MainProgram::print_complexity_fits(std::ostream& output, vector<PerfRecord> const& records)
+{
+    // Times of each command (and phase) by N, in the order the commands first appear
+    vector<string> commands;
+    std::map<string, std::pair<vector<double>, vector<double>>> times;
+    for (auto const& record : records)
+    {
+        auto& [ns, us] = times[record.command];
+        if (ns.empty()) { commands.push_back(record.command); }
+        ns.push_back(record.n);
+        us.push_back(record.mean_us);
+    }
+    if (commands.empty() || set<double>(times[commands.front()].first.begin(), times[commands.front()].first.end()).size() < 3)
+    {
+        output << "Complexity fit needs at least 3 values of N!" << endl;
+        return;
+    }
+
+    // The estimates are read from the header at run time: from the working directory, or else
+    // next to this source file as it was compiled (a qmake shadow build runs in the build directory)
+    string headerfile = "datastructures.hh";
+    ifstream header(headerfile);
+    if (!header)
+    {
+        string source = __FILE__;
+        auto slash = source.find_last_of("/\\");
+        if (slash != string::npos)
+        {
+            headerfile = source.substr(0, slash + 1) + "datastructures.hh";
+            header.clear();
+            header.open(headerfile);
+        }
+    }
+    auto declared = read_declared_complexities(header);
+    if (!header.eof())
+    {
+        output << "(Cannot read '" << headerfile << "', declared estimates are not checked)" << endl;
+    }
+
+    output << setw(40) << std::left << "command" << std::right << " , " << setw(10) << "best fit" << " , "
+           << setw(16) << "coefficient (us)" << " , " << setw(10) << "rel. error" << " , " << setw(10) << "declared" << endl;
+    vector<string> warnings;
+    vector<string> undeclared; // Commands that cannot be checked
+    for (auto const& command : commands)
+    {
+        auto& [ns, us] = times[command];
+        auto fits = fit_complexities(ns, us);
+        if (fits.empty()) { continue; }
+        ComplexityFit const& best = fits.front();
+        auto declared_pos = declared.find(command);
+        if (declared_pos == declared.end() && find_cmd(command)) { undeclared.push_back(command); }
+        output << setw(40) << std::left << command << std::right << " , " << setw(10) << complexity_name(best.complexity) << " , "
+               << setw(16) << best.coefficient << " , " << setw(10) << best.error << " , "
+               << setw(10) << (declared_pos != declared.end() ? complexity_name(declared_pos->second) : "") << endl;
+
+        // Only warn if the declared class also fits clearly worse, not when the two are within noise
+        if (declared_pos != declared.end() && best.complexity > declared_pos->second)
+        {
+            auto declared_fit = std::find_if(fits.begin(), fits.end(), [&declared_pos](ComplexityFit const& fit) {
+                return fit.complexity == declared_pos->second;
+            });
+            if (declared_fit != fits.end() && declared_fit->error > 2 * best.error)
+            {
+                warnings.push_back(command + " grows as " + complexity_name(best.complexity) + ", faster than its declared "
+                                   + complexity_name(declared_pos->second) + "!");
+            }
+        }
+    }
+    if (!undeclared.empty() && header.eof())
+    {
+        output << "No declared estimate (not checked):";
+        for (auto const& command : undeclared) { output << " " << command; }
+        output << endl;
+    }
+    for (auto const& warning : warnings)
+    {
+        output << "WARNING: " << warning << endl;
+    }
+}
+
+void MainProgram::print_regressions(std::ostream& output, string const& baselinefile, vector<PerfRegression> const& regressions,
+                                    double max_slowdown_percent)
+{
+    output << "Compared to baseline '" << baselinefile << "' (max slowdown " << max_slowdown_percent << "%):" << endl;
+    for (auto const& regression : regressions)
+    {
+        double change = (regression.current_us / regression.baseline_us - 1.0) * 100.0;
+        output << "REGRESSION N=" << regression.n << " " << regression.command << " " << regression.metric << ": "
+               << regression.baseline_us << " us -> " << regression.current_us << " us (+" << std::fixed << std::setprecision(1)
+               << change << "%)" << std::defaultfloat << std::setprecision(6) << endl;
+    }
+    if (regressions.empty()) { output << "No regressions found." << endl; }
+    else { output << regressions.size() << " regression(s) found!" << endl; }
+}
+
+MainProgram::CmdResult MainProgram::cmd_save_snapshot(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string filename = *begin++;
+    string noindexstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    if (!ds_.save_snapshot(filename, noindexstr.empty()))
+    {
+        output << "Cannot save snapshot to '" << filename << "'!" << endl;
+        return {};
+    }
+    output << "Saved snapshot to '" << filename << "': ";
+    print_snapshot_contents(output);
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_load_snapshot(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string filename = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    bool loaded = ds_.load_snapshot(filename);
+    view_dirty = true;
+    if (!loaded)
+    {
+        output << "Cannot load snapshot from '" << filename << "'!" << endl;
+        return {};
+    }
+    output << "Loaded snapshot from '" << filename << "': ";
+    print_snapshot_contents(output);
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_map_snapshot(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string filename = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    bool loaded = ds_.map_snapshot(filename);
+    view_dirty = true;
+    if (!loaded)
+    {
+        output << "Cannot map snapshot from '" << filename << "'!" << endl;
+        return {};
+    }
+    output << "Mapped snapshot from '" << filename << "' (read-only until modified): ";
+    print_snapshot_contents(output);
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_epoch(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string mode = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    if (mode == "publish")
+    {
+        if (!ds_.publish_epoch())
+        {
+            output << "Cannot publish epoch!" << endl;
+            return {};
+        }
+        output << "Published epoch (queries ignore later changes until the next publish): ";
+    }
+    else if (mode == "drop")
+    {
+        ds_.drop_epoch();
+        output << "Dropped epoch: ";
+    }
+    else
+    {
+        assert(!"Impossible epoch mode!");
+    }
+    print_snapshot_contents(output);
+    return {};
+}
+
+void MainProgram::print_snapshot_contents(std::ostream& output)
+{
+    unsigned long long int connections = 0;
+    ds_.visit_all_connections([&connections](std::string_view, std::string_view, Weight) { ++connections; });
+    output << ds_.get_affiliation_count() << " affiliations, " << ds_.all_publications().size() << " publications, "
+           << connections << " connections" << endl;
+}
+
+MainProgram::CmdResult MainProgram::cmd_import(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string filename = *begin++;
+    string kind = *begin++;
+    string headerstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    ifstream file(filename, std::ios::binary);
+    if (!file)
+    {
+        output << "Cannot open file '" << filename << "'!" << endl;
+        return {};
+    }
+
+    // Numbers are converted straight from the fields, only ids and names become strings
+    auto parse = [](std::string_view field, auto& value)
+    {
+        auto result = std::from_chars(field.data(), field.data() + field.size(), value);
+        return result.ec == std::errc() && result.ptr == field.data() + field.size();
+    };
+
+    bool publications = (kind == "publications");
+    unsigned long long int const BATCH_SIZE = 65536;
+    unsigned long long int const PROGRESS_INTERVAL = 1000000;
+    unsigned long long int rows = 0;
+    unsigned long long int added = 0;
+    unsigned long long int skipped = 0;
+    std::size_t first_skipped_line = 0;
+    vector<PublicationData> batch;
+
+    Stopwatch stopwatch;
+    stopwatch.start();
+    DelimitedReader reader(file);
+    vector<std::string_view> fields;
+    bool skip_header = !headerstr.empty();
+    while (reader.next_row(fields))
+    {
+        if (skip_header)
+        {
+            skip_header = false;
+            continue;
+        }
+        ++rows;
+
+        bool ok = false;
+        if (publications)
+        {
+            // id, name, year, affiliation ids...
+            PublicationData data;
+            int year = 0;
+            if (fields.size() >= 3 && parse(fields[0], data.id) && parse(fields[2], year)
+                && year >= 0 && year <= std::numeric_limits<Year>::max())
+            {
+                data.name = Name(fields[1]);
+                data.year = static_cast<Year>(year);
+                for (auto it = fields.begin() + 3; it != fields.end(); ++it)
+                {
+                    if (!it->empty()) { data.affiliations.emplace_back(*it); }
+                }
+                batch.push_back(std::move(data));
+                ok = true;
+            }
+            if (batch.size() == BATCH_SIZE)
+            {
+                added += ds_.add_publications(batch);
+                batch.clear();
+            }
+        }
+        else
+        {
+            // id, name, x, y
+            Coord xy;
+            if (fields.size() == 4 && !fields[0].empty() && parse(fields[2], xy.x) && parse(fields[3], xy.y))
+            {
+                ok = true;
+                if (ds_.add_affiliation(AffiliationID(fields[0]), Name(fields[1]), xy)) { ++added; }
+            }
+        }
+        if (!ok)
+        {
+            if (skipped++ == 0) { first_skipped_line = reader.line_number(); }
+        }
+
+        if (rows % PROGRESS_INTERVAL == 0)
+        {
+            auto sec = stopwatch.elapsed();
+            output << "... " << rows << " rows (" << static_cast<unsigned long long int>(sec > 0 ? rows / sec : 0) << " rows/sec)" << endl;
+            flush_output(output);
+            if (check_stop())
+            {
+                output << "Stopped!" << endl;
+                break;
+            }
+        }
+    }
+    if (!batch.empty())
+    {
+        added += ds_.add_publications(batch);
+    }
+    stopwatch.stop();
+
+    output << "Imported " << added << " " << kind << " from '" << filename << "': " << rows << " rows, "
+           << skipped << " skipped";
+    if (skipped > 0) { output << " (first on line " << first_skipped_line << ")"; }
+    output << endl;
+    // Timings only with the stopwatch, so that the output of import can be tested
+    if (command_timed_)
+    {
+        auto sec = stopwatch.elapsed();
+        output << "Import rate: " << static_cast<unsigned long long int>(sec > 0 ? rows / sec : 0) << " rows/sec" << endl;
+    }
+
+    view_dirty = true;
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_nearest_benchmark(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    unsigned int n = convert_string_to<unsigned int>(*begin++);
+    unsigned int repeat_count = convert_string_to<unsigned int>(*begin++);
+    assert(begin == end && "Invalid number of parameters");
+
+    std::vector<Coord> coords;
+    try {
+        coords = get_unique_coords(n, {}, RANDOM_MIN_COORD, RANDOM_MAX_COORD);
+    } catch (...) {
+        output << "Impossible to create such number of unique coordinates within perimeters" << endl;
+        return {};
+    }
+    vector<int> xs;
+    vector<int> ys;
+    xs.reserve(n);
+    ys.reserve(n);
+    for (auto const& coord : coords)
+    {
+        xs.push_back(coord.x);
+        ys.push_back(coord.y);
+    }
+    vector<Coord> queries;
+    queries.reserve(repeat_count);
+    for (unsigned int i = 0; i < repeat_count; ++i)
+    {
+        queries.push_back(get_random_coords());
+    }
+
+    auto const& kernels = nearest_kernels();
+    output << "Nearest 3 of " << n << " coordinates, " << repeat_count << " queries, kernel selected at runtime: "
+           << nearest_best_kernel().name << endl;
+    output << setw(8) << "kernel" << " , " << setw(12) << "total (sec)" << " , " << setw(12) << "ns/coord" << " , "
+           << setw(8) << "speedup" << endl;
+
+    double scalar_sec = 0;
+    vector<NearestResult> reference;
+    for (auto const& kernel : kernels)
+    {
+        vector<NearestResult> results(3 * queries.size());
+        Stopwatch stopwatch;
+        stopwatch.start();
+        for (unsigned int i = 0; i < queries.size(); ++i)
+        {
+            kernel.kernel(xs.data(), ys.data(), xs.size(), queries[i].x, queries[i].y, &results[3 * i], 3);
+        }
+        stopwatch.stop();
+
+        auto sec = stopwatch.elapsed();
+        if (reference.empty()) { reference = results; scalar_sec = sec; }
+        bool same = std::equal(results.begin(), results.end(), reference.begin(),
+                               [](auto const& r1, auto const& r2){ return r1.dist == r2.dist && r1.index == r2.index; });
+
+        double coords_scanned = static_cast<double>(std::max(n, 1u)) * std::max(repeat_count, 1u);
+        output << setw(8) << kernel.name << " , " << setw(12) << sec << " , " << setw(12) << sec * 1e9 / coords_scanned << " , "
+               << setw(8) << (sec > 0 ? scalar_sec / sec : 0.0);
+        if (!same) { output << " , RESULTS DIFFER FROM SCALAR!"; }
+        output << endl;
+        flush_output(output);
+    }
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_memory_usage(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto usage = ds_.memory_usage();
+    std::size_t width = 0;
+    std::size_t total = 0;
+    for (auto const& [container, bytes] : usage)
+    {
+        width = std::max(width, container.size());
+        total += bytes;
+    }
+
+    output << "Estimated memory usage (bytes):" << endl;
+    for (auto const& [container, bytes] : usage)
+    {
+        output << "  " << std::left << setw(static_cast<int>(width)) << container << std::right << " : " << setw(12) << bytes << endl;
+    }
+    output << "  " << std::left << setw(static_cast<int>(width)) << "total" << std::right << " : " << setw(12) << total << endl;
+#ifdef USE_ALLOC_COUNT
+    AllocationCounts counts = allocation_counts();
+    output << "Heap since start: " << counts.allocations << " allocations, " << counts.bytes << " bytes allocated, peak live "
+           << counts.peak_live_bytes << " bytes" << endl;
+#endif
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_stats(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string clearstr = *begin++;
+    string foldedstr = *begin++;
+    string filename = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto counters = command_counters();
+
+    if (!foldedstr.empty())
+    {
+        // One "stack self_time_us" line per stack, the input format of flamegraph.pl and similar tools
+        ofstream folded(filename);
+        if (!folded)
+        {
+            output << "Cannot open file '" << filename << "'!" << endl;
+            return {};
+        }
+        for (auto const& [stack, counter] : counters)
+        {
+            folded << stack << ' ' << (counter.self_ns + 500) / 1000 << '\n';
+        }
+        output << "Wrote " << counters.size() << " stacks (self time in us) to '" << filename << "'" << endl;
+    }
+    else if (!clearstr.empty())
+    {
+        clear_command_counters();
+        output << "Cleared command statistics" << endl;
+    }
+    else
+    {
+        // Totals by command, whatever ran it
+        std::map<string, CommandCounter> commands;
+        for (auto const& [stack, counter] : counters)
+        {
+            auto namepos = stack.rfind(';');
+            CommandCounter& sum = commands[stack.substr(namepos == string::npos ? 0 : namepos + 1)];
+            sum.calls += counter.calls;
+            sum.total_ns += counter.total_ns;
+            sum.self_ns += counter.self_ns;
+        }
+        vector<std::pair<string, CommandCounter>> sorted(commands.begin(), commands.end());
+        std::stable_sort(sorted.begin(), sorted.end(), [](auto const& a, auto const& b) { return a.second.total_ns > b.second.total_ns; });
+
+        output << setw(30) << std::left << "command" << std::right << " , " << setw(9) << "calls" << " , " << setw(12) << "total (ms)"
+               << " , " << setw(12) << "self (ms)" << " , " << setw(12) << "mean (us)" << endl;
+        for (auto const& [name, counter] : sorted)
+        {
+            output << setw(30) << std::left << name << std::right << " , " << setw(9) << counter.calls << " , "
+                   << setw(12) << counter.total_ns / 1e6 << " , " << setw(12) << counter.self_ns / 1e6 << " , "
+                   << setw(12) << static_cast<double>(counter.total_ns) / static_cast<double>(counter.calls) / 1000.0 << endl;
+        }
+    }
+
+    return {};
+}
+
 MainProgram::CmdResult MainProgram::cmd_comment(std::ostream& /*output*/, MatchIter /*begin*/, MatchIter /*end*/)
 {
     return {};
 }
 
 
+void MainProgram::print_result(CmdResult& result, std::ostream& output)
+{
+    switch (result.first)
+    {
+        case ResultType::NOTHING:
+        {
+            break;
+        }
+        case ResultType::IDLIST:
+        {
+            auto& [publications, affiliations] = std::get<CmdResultIDs>(result.second);
+            if (affiliations.size() == 1 && affiliations.front() == NO_AFFILIATION)
+            {
+                output << "Failed (NO_AFFILIATION returned)!" << std::endl;
+            }
+            else
+            {
+                if (!affiliations.empty())
+                {
+                    if (affiliations.size() == 1) { output << "Affiliation:" << std::endl; }
+                    else { output << "Affiliations:" << std::endl; }
+
+                    unsigned int num = 0;
+                    for (AffiliationID& id : affiliations)
+                    {
+                        ++num;
+                        if (affiliations.size() > 1) { output << num << ". "; }
+                        else { output << "   "; }
+                        print_affiliation(id, output);
+                    }
+                }
+            }
+
+            if (publications.size() == 1 && publications.front() == NO_PUBLICATION)
+            {
+                output << "Failed (NO_PUBLICATION returned)!" << std::endl;
+            }
+            else
+            {
+                if (!publications.empty())
+                {
+                    if (publications.size() == 1) { output << "Publication:" << std::endl; }
+                    else { output << "Publications:" << std::endl; }
+
+                    unsigned int num = 0;
+                    for (PublicationID id : publications)
+                    {
+                        ++num;
+                        if (publications.size() > 1) { output << num << ". "; }
+                        else { output << "   "; }
+                        print_publication(id, output);
+                    }
+                }
+            }
+            break;
+        }
+        case ResultType::ROUTE:
+        {
+            auto& route = std::get<CmdResultRoute>(result.second);
+            if (!route.empty())
+            {
+                if (route.size() == 1 && get<0>(route.front()) == NO_AFFILIATION)
+                {
+                    output << "Failed (...NO_AFFILIATION... returned)!" << std::endl;
+                }
+                else
+                {
+                    unsigned int num = 1;
+                    for (auto& r : route)
+                    {
+                        auto [affiliationid1, weight, affiliationid2, dist] = r;
+                        output << num << ". ";
+                        if (affiliationid1 != NO_AFFILIATION)
+                        {
+                            print_affiliation_brief(affiliationid1, output, false);
+                        }
+                        if (affiliationid2 != NO_AFFILIATION)
+                        {
+                            output << " -> ";
+                            print_affiliation_brief(affiliationid2, output, false);
+                        }
+                        if (weight != NO_WEIGHT)
+                        {
+                            output << " (weighted " << weight << ")";
+                        }
+                        if (dist != NO_DISTANCE)
+                        {
+                            output << " (distance " << dist << ")";
+                        }
+                        output << endl;
+
+                        ++num;
+                    }
+                }
+            }
+            break;
+        }
+        case ResultType::CONNECTIONLIST:{
+            auto& list = std::get<ConnectionList>(result.second);
+            unsigned int num = 1;
+
+            std::for_each(list.begin(),list.end(),[&output,&num,this](auto& connection){
+                output << num++ << ". ";
+                print_affiliation_brief(connection.aff1 ,output,false);
+                output << " -> ";
+                print_affiliation_brief(connection.aff2, output, false);
+                output <<" (weighted "<<connection.weight<<")"<<endl;
+            });
+            break;
+        }
+        case ResultType::NEIGHBOURLIST:{
+            auto& list = std::get<ConnectionList>(result.second);
+            auto source_id = list.front().aff1;
+            output << "All connected affiliations from ";
+            print_affiliation_brief(source_id,output,false);
+            output << endl;
+            unsigned int num = 1;
+            std::for_each(list.begin(),list.end(),[&output,&num,this](auto& connection){
+                output << num++ << ". ";
+                print_affiliation_brief(connection.aff2, output, false);
+                output <<" (weighted "<<connection.weight<<")"<<endl;
+            });
+            break;
+        }
+        default:
+        {
+            assert(false && "Unsupported result type!");
+        }
+    }
+}
+
 bool MainProgram::command_parse_line(string inputline, ostream& output)
 {
 
     if (inputline.empty()) { return true; }
 
-    smatch match;
-    bool matched = regex_match(inputline, match, cmds_regex_);
+    std::string_view cmdname, params;
+    split_command_line(inputline, cmdname, params);
+
+    auto pos = find_cmd(cmdname);
+    // Line breaks are only allowed as trailing whitespace
+    bool matched = pos && params.find_first_of("\r\n") == std::string_view::npos;
     if (matched)
     {
-        assert(match.size() == 3);
-        string cmd = match[1];
-        string params = match[2];
+        string cmd = pos->cmd;
 
-        auto pos = find_if(cmds_.begin(), cmds_.end(), [cmd](CmdInfo const& ci) { return ci.cmd == cmd; });
-        assert(pos != cmds_.end());
-
-        smatch match2;
-        bool matched2 = regex_match(params, match2, pos->param_regex);
+        Args args;
+        bool matched2 = match_params(params, pos->params, args);
         if (matched2)
         {
             if (pos->func)
             {
-                assert(!match2.empty());
 
                 Stopwatch stopwatch(true);
                 bool use_stopwatch = (stopwatch_mode != StopwatchMode::OFF);
                 // Reset stopwatch mode if only for the next command
                 if (stopwatch_mode == StopwatchMode::NEXT) { stopwatch_mode = StopwatchMode::OFF; }
+                bool outer_timed = command_timed_;
+                command_timed_ = use_stopwatch;
 
                TestStatus initial_status = test_status_;
                test_status_ = TestStatus::NOT_RUN;
 
+                std::size_t stats_stack_size = stats_stack_.size();
+                if (!stats_stack_.empty()) { stats_stack_ += ';'; }
+                stats_stack_ += pos->cmd;
+                stats_children_ns_.push_back(0);
+
+                // A traced command writes its output here first to hash it
+                bool record = trace_ && is_traced(*pos);
+                bool traced = record || capture_commands_;
+                ostringstream traced_output;
+                ostream& cmd_output = traced ? traced_output : output;
+                auto trace_time = std::chrono::steady_clock::now();
+
                 if (use_stopwatch)
                 {
                     stopwatch.start();
                 }
 
+                // A modifying command shows its own change, not the published epoch
+                Datastructures::LiveQueries live(!pos->readonly);
                 CmdResult result;
                 try
                 {
-                    result = (this->*(pos->func))(output, ++(match2.begin()), match2.end());
+                    result = (this->*(pos->func))(cmd_output, args.cbegin(), args.cend());
                 }
                 catch (NotImplemented const& e)
                 {
-                    output << endl << "NotImplemented from cmd " << pos->cmd << " : " << e.what() << endl;
+                    cmd_output << endl << "NotImplemented from cmd " << pos->cmd << " : " << e.what() << endl;
                     std::cerr << endl << "NotImplemented from cmd " << pos->cmd << " : " << e.what() << endl;
                 }
+                catch (...)
+                {
+                    stats_stack_.resize(stats_stack_size);
+                    stats_children_ns_.pop_back();
+                    command_timed_ = outer_timed;
+                    throw;
+                }
+                command_timed_ = outer_timed;
 
                 if (use_stopwatch)
                 {
                     stopwatch.stop();
                 }
+                auto latency = std::chrono::steady_clock::now() - trace_time;
 
-                switch (result.first)
-                {
-                    case ResultType::NOTHING:
-                    {
-                        break;
-                    }
-                    case ResultType::IDLIST:
-                    {
-                        auto& [publications, affiliations] = std::get<CmdResultIDs>(result.second);
-                        if (affiliations.size() == 1 && affiliations.front() == NO_AFFILIATION)
-                        {
-                            output << "Failed (NO_AFFILIATION returned)!" << std::endl;
-                        }
-                        else
-                        {
-                            if (!affiliations.empty())
-                            {
-                                if (affiliations.size() == 1) { output << "Affiliation:" << std::endl; }
-                                else { output << "Affiliations:" << std::endl; }
-
-                                unsigned int num = 0;
-                                for (AffiliationID& id : affiliations)
-                                {
-                                    ++num;
-                                    if (affiliations.size() > 1) { output << num << ". "; }
-                                    else { output << "   "; }
-                                    print_affiliation(id, output);
-                                }
-                            }
-                        }
+                auto total_ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+                auto children_ns = std::min(stats_children_ns_.back(), total_ns);
+                record_command(stats_stack_, total_ns, total_ns - children_ns);
+                stats_stack_.resize(stats_stack_size);
+                stats_children_ns_.pop_back();
+                if (!stats_children_ns_.empty()) { stats_children_ns_.back() += total_ns; }
 
-                        if (publications.size() == 1 && publications.front() == NO_PUBLICATION)
-                        {
-                            output << "Failed (NO_PUBLICATION returned)!" << std::endl;
-                        }
-                        else
-                        {
-                            if (!publications.empty())
-                            {
-                                if (publications.size() == 1) { output << "Publication:" << std::endl; }
-                                else { output << "Publications:" << std::endl; }
-
-                                unsigned int num = 0;
-                                for (PublicationID id : publications)
-                                {
-                                    ++num;
-                                    if (publications.size() > 1) { output << num << ". "; }
-                                    else { output << "   "; }
-                                    print_publication(id, output);
-                                }
-                            }
-                        }
-                        break;
-                    }
-                    case ResultType::ROUTE:
-                    {
-                        auto& route = std::get<CmdResultRoute>(result.second);
-                        if (!route.empty())
-                        {
-                            if (route.size() == 1 && get<0>(route.front()) == NO_AFFILIATION)
-                            {
-                                output << "Failed (...NO_AFFILIATION... returned)!" << std::endl;
-                            }
-                            else
-                            {
-                                unsigned int num = 1;
-                                for (auto& r : route)
-                                {
-                                    auto [affiliationid1, weight, affiliationid2, dist] = r;
-                                    output << num << ". ";
-                                    if (affiliationid1 != NO_AFFILIATION)
-                                    {
-                                        print_affiliation_brief(affiliationid1, output, false);
-                                    }
-                                    if (affiliationid2 != NO_AFFILIATION)
-                                    {
-                                        output << " -> ";
-                                        print_affiliation_brief(affiliationid2, output, false);
-                                    }
-                                    if (weight != NO_WEIGHT)
-                                    {
-                                        output << " (weighted " << weight << ")";
-                                    }
-                                    if (dist != NO_DISTANCE)
-                                    {
-                                        output << " (distance " << dist << ")";
-                                    }
-                                    output << endl;
-
-                                    ++num;
-                                }
-                            }
-                        }
-                        break;
-                    }
-                    case ResultType::CONNECTIONLIST:{
-                        auto& list = std::get<ConnectionList>(result.second);
-                        unsigned int num = 1;
+                print_result(result, cmd_output);
 
-                        std::for_each(list.begin(),list.end(),[&output,&num,this](auto& connection){
-                            output << num++ << ". ";
-                            print_affiliation_brief(connection.aff1 ,output,false);
-                            output << " -> ";
-                            print_affiliation_brief(connection.aff2, output, false);
-                            output <<" (weighted "<<connection.weight<<")"<<endl;
-                        });
-                        break;
-                    }
-                    case ResultType::NEIGHBOURLIST:{
-                        auto& list = std::get<ConnectionList>(result.second);
-                        auto source_id = list.front().aff1;
-                        output << "All connected affiliations from ";
-                        print_affiliation_brief(source_id,output,false);
-                        output << endl;
-                        unsigned int num = 1;
-                        std::for_each(list.begin(),list.end(),[&output,&num,this](auto& connection){
-                            output << num++ << ". ";
-                            print_affiliation_brief(connection.aff2, output, false);
-                            output <<" (weighted "<<connection.weight<<")"<<endl;
-                        });
-                        break;
-                    }
-                    default:
+                if (traced)
+                {
+                    string text = traced_output.str();
+                    output << text;
+                    last_command_ = {output_hash(text), total_ns};
+                    if (record)
                     {
-                        assert(false && "Unsupported result type!");
+                        auto start_us = std::chrono::duration_cast<std::chrono::microseconds>(trace_time - trace_start_).count();
+                        *trace_ << start_us << '\t' << last_command_.latency_ns << '\t' << std::hex << setw(16) << setfill('0')
+                                << last_command_.hash << std::dec << setfill(' ') << '\t'
+                                << inputline.substr(0, inputline.find_last_not_of(" \t\r\n") + 1) << '\n';
+                        ++traced_commands_;
                     }
                 }
 
@@ -1830,8 +3238,10 @@ bool MainProgram::command_parse_line(string inputline, ostream& output)
                 {
                     output << "Command '" << cmd << "': " << stopwatch.elapsed() << " sec";
 #ifdef USE_PERF_EVENT
-                    auto totalcount = stopwatch.count();
-                    output << ", cmds (count): " << totalcount;
+                    stopwatch.print_counts(output, stopwatch.counts());
+#endif
+#ifdef USE_ALLOC_COUNT
+                    Stopwatch::print_allocations(output, stopwatch.allocations());
 #endif
                     output << endl;
                 }
@@ -1887,6 +3297,127 @@ void MainProgram::command_parser(istream& input, ostream& output, PromptStyle pr
     view_dirty = true; // To be safe, assume that results have been changed
 }
 
+void MainProgram::command_parser_parallel(istream& input, ostream& output)
+{
+    // The whole input is read first so that runs of read-only commands can be found
+    vector<string> lines;
+    string line;
+    while (getline(input, line, '\n'))
+    {
+        lines.push_back(line);
+    }
+    // line is now what command_parser would echo when the input runs out
+
+    struct Job
+    {
+        CmdInfo const* cmd;
+        Args args;
+        ostringstream output;
+        CmdResult result;
+        std::exception_ptr error;
+    };
+
+    std::size_t next_line = 0;
+    while (next_line < lines.size())
+    {
+        // Collect the run of read-only commands starting here (none while the stopwatch is on or commands are traced)
+        vector<Job> jobs;
+        while (stopwatch_mode == StopwatchMode::OFF && !trace_ && !capture_commands_ && next_line + jobs.size() < lines.size())
+        {
+            std::string_view cmdname, params;
+            split_command_line(lines[next_line + jobs.size()], cmdname, params);
+            auto pos = find_cmd(cmdname);
+            Args args;
+            if (!pos || !pos->readonly || params.find_first_of("\r\n") != std::string_view::npos ||
+                !match_params(params, pos->params, args))
+            {
+                break;
+            }
+            jobs.push_back({pos, move(args), {}, {}, {}});
+        }
+
+        if (jobs.size() < 2)
+        {
+            output << PROMPT << lines[next_line] << endl;
+            bool cont = command_parse_line(lines[next_line], output);
+            view_dirty = false; // No need to keep track of individual result changes
+            ++next_line;
+            if (!cont) { view_dirty = true; return; }
+            continue;
+        }
+
+        // Workers take the next job until all are done, each job writes to its own buffer
+        std::atomic<std::size_t> next_job = 0;
+        string stats_prefix = stats_stack_.empty() ? "" : stats_stack_ + ";";
+        auto batch_start = std::chrono::steady_clock::now();
+        auto worker = [this, &jobs, &next_job, &stats_prefix]()
+        {
+            // Read-only commands read the published epoch, also on the thread of the script command
+            Datastructures::LiveQueries epoch_queries(false);
+            for (std::size_t i = next_job++; i < jobs.size(); i = next_job++)
+            {
+                Job& job = jobs[i];
+                try
+                {
+                    try
+                    {
+                        auto start = std::chrono::steady_clock::now();
+                        job.result = (this->*(job.cmd->func))(job.output, job.args.cbegin(), job.args.cend());
+                        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                        record_command(stats_prefix + job.cmd->cmd, static_cast<std::uint64_t>(ns), static_cast<std::uint64_t>(ns));
+                    }
+                    catch (NotImplemented const& e)
+                    {
+                        job.output << endl << "NotImplemented from cmd " << job.cmd->cmd << " : " << e.what() << endl;
+                        std::cerr << endl << "NotImplemented from cmd " << job.cmd->cmd << " : " << e.what() << endl;
+                    }
+                    print_result(job.result, job.output);
+                }
+                catch (...)
+                {
+                    job.error = std::current_exception();
+                }
+            }
+        };
+        std::size_t thread_count = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), jobs.size());
+        vector<std::thread> threads;
+        for (std::size_t i = 1; i < thread_count; ++i)
+        {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        // The jobs overlapped, so what they took from the command running them is the time of the batch
+        if (!stats_children_ns_.empty())
+        {
+            stats_children_ns_.back() += static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - batch_start).count());
+        }
+
+        for (auto& job : jobs)
+        {
+            output << PROMPT << lines[next_line++] << endl;
+            output << job.output.str();
+            if (job.error)
+            {
+                view_dirty = true;
+                std::rethrow_exception(job.error);
+            }
+        }
+        if (jobs.back().result != prev_result)
+        {
+            prev_result = move(jobs.back().result);
+        }
+        view_dirty = false;
+    }
+
+    output << PROMPT << line << endl;
+    view_dirty = true; // To be safe, assume that results have been changed
+}
+
 void MainProgram::setui(MainWindow* ui)
 {
     ui_ = ui;
@@ -1930,7 +3461,7 @@ MainProgram::MainProgram()
     rand_engine_.seed(time(nullptr));
 
     init_primes();
-    init_regexs();
+    init_cmds_by_name();
 }
 
 int MainProgram::mainprogram(int argc, char* argv[])
@@ -1981,6 +3512,9 @@ void MainProgram::init_primes()
     prime2_ = primes2[random<int>(0, primes2.size())];
     random_affiliations_added_ = 0;
     random_publications_added_ = 0;
+    attachment_.clear();
+    attachment_affiliations_ = 0;
+    cluster_centers_.clear();
 }
 
 Name MainProgram::n_to_name(unsigned long n)
@@ -2018,23 +3552,29 @@ Coord MainProgram::n_to_coord(unsigned long n)
     return {static_cast<int>(hash % 1000), static_cast<int>((hash/1000) % 1000)};
 }
 
-void MainProgram::init_regexs()
+void MainProgram::init_cmds_by_name()
 {
-    // Create regex <whitespace>(cmd1|cmd2|...)<whitespace>(.*)
-    string cmds_regex_str = "[[:space:]]*(";
-    bool first = true;
-    for (auto& cmd : cmds_)
-    {
-        cmds_regex_str += (first ? "" : "|") + cmd.cmd;
-        first = false;
+    cmds_by_name_ = cmds_;
+    sort(cmds_by_name_.begin(), cmds_by_name_.end(), [](CmdInfo const& l, CmdInfo const& r){ return l.cmd < r.cmd; });
+}
 
-        cmd.param_regex = regex(cmd.param_regex_str+"[[:space:]]*", std::regex_constants::ECMAScript | std::regex_constants::optimize);
+MainProgram::CmdInfo const* MainProgram::find_cmd(std::string_view name) const
+{
+    auto pos = std::lower_bound(cmds_by_name_.begin(), cmds_by_name_.end(), name,
+                                [](CmdInfo const& ci, std::string_view n){ return ci.cmd < n; });
+    return (pos != cmds_by_name_.end() && pos->cmd == name) ? &*pos : nullptr;
+}
+
+bool MainProgram::match_params(std::string_view input, std::vector<Param> const& params, Args& args)
+{
+    Scanner in{input};
+    for (std::size_t i = 0; i < params.size(); ++i)
+    {
+        // Parameters are separated by whitespace, lists and optional parts match their own
+        bool own_space = (params[i].type == ParamType::AFFILIATIONLIST || params[i].type == ParamType::OPTIONAL);
+        if (i > 0 && !own_space && in.skip_space() == 0) { return false; }
+        if (!match_param(in, params[i], args)) { return false; }
     }
-    cmds_regex_str += ")(?:[[:space:]]*$|"+wsx+"(.*))";
-    cmds_regex_ = regex(cmds_regex_str, std::regex_constants::ECMAScript | std::regex_constants::optimize);
-    coords_regex_ = regex(coordx+"[[:space:]]?", std::regex_constants::ECMAScript | std::regex_constants::optimize);
-    affil_regex_ = regex(affiliationidx+"[[:space:]]?", std::regex_constants::ECMAScript | std::regex_constants::optimize); // TODO test this one more intensively
-    times_regex_ = regex(wsx+"([0-9][0-9]):([0-9][0-9]):([0-9][0-9])", std::regex_constants::ECMAScript | std::regex_constants::optimize);
-    commands_regex_ = regex("([0-9a-zA-Z_]+);?", std::regex_constants::ECMAScript | std::regex_constants::optimize);
-    sizes_regex_ = regex(numx+";?", std::regex_constants::ECMAScript | std::regex_constants::optimize);
+    in.skip_space();
+    return in.at_end();
 }
@@ -18,22 +18,28 @@
 
 #include <string>
 #include <random>
-#include <regex>
 #include <chrono>
 #include <sstream>
 #include <stdexcept>
 #include <iostream>
 #include <vector>
 #include <array>
+#include <algorithm>
 #include <functional>
 #include <utility>
 #include <variant>
+#include <string_view>
 #include <bitset>
 #include <cassert>
 #include <cstring>
 #include <unordered_set>
+#include <memory>
 
 #include "datastructures.hh"
+#include "latencyhistogram.hh"
+#include "perfresults.hh"
+#include "allocationcounter.hh"
+#include "commandstats.hh"
 
 // default max and min values for perftesting and random add, may be subject to change
 
@@ -58,8 +64,21 @@ public:
     enum class PromptStyle { NORMAL, NO_ECHO, NO_NESTING };
     enum class TestStatus { NOT_RUN, NO_DIFFS, DIFFS_FOUND };
 
+    // Command parameters are matched by a hand-written parser according to their types
+    enum class ParamType { AFFILIATIONID, NUMBER, NAME, FILENAME, COORD, AFFILIATIONLIST, WORDLIST, NUMBERLIST, KEYWORD, TEXT, OPTIONAL };
+    struct Param
+    {
+        ParamType type;
+        std::vector<std::string> keywords = {}; // Alternatives of a KEYWORD
+        std::vector<Param> group = {}; // Parameters of an OPTIONAL, present all or none
+    };
+    using Args = std::vector<std::string>; // Matched parameters, "" for missing optional ones
+
     bool command_parse_line(std::string input, std::ostream& output);
     void command_parser(std::istream& input, std::ostream& output, PromptStyle promptstyle);
+    // Like command_parser with NORMAL prompts, but runs of consecutive read-only commands
+    // are executed in parallel, their outputs still written in the original order
+    void command_parser_parallel(std::istream& input, std::ostream& output);
 
     void setui(MainWindow* ui);
 
@@ -91,6 +110,7 @@ private:
 
     enum class StopwatchMode { OFF, ON, NEXT };
     StopwatchMode stopwatch_mode = StopwatchMode::OFF;
+    bool command_timed_ = false; // The stopwatch times the command running now (it may add its own timings)
 
     enum class ResultType { NOTHING, IDLIST, ROUTE, CONNECTIONLIST, NEIGHBOURLIST};
     using CmdResultIDs = std::pair<std::vector<PublicationID>, std::vector<AffiliationID>>;
@@ -102,25 +122,44 @@ private:
 
     TestStatus test_status_ = TestStatus::NOT_RUN;
 
-    using MatchIter = std::smatch::const_iterator;
+    using MatchIter = Args::const_iterator;
     struct CmdInfo
     {
         std::string cmd;
         std::string info;
-        std::string param_regex_str;
+        std::vector<Param> params;
         CmdResult(MainProgram::*func)(std::ostream& output, MatchIter begin, MatchIter end);
         void(MainProgram::*testfunc)();
-        std::regex param_regex = {};
+        bool readonly = false; // Only queries ds_ and prints, so can run in parallel with other such commands
     };
     static std::vector<CmdInfo> cmds_;
-    // Regex objects and their initialization
-    std::regex cmds_regex_;
-    std::regex coords_regex_;
-    std::regex affil_regex_;
-    std::regex times_regex_;
-    std::regex commands_regex_;
-    std::regex sizes_regex_;
-    void init_regexs();
+
+    std::vector<CmdInfo> cmds_by_name_; // Copy of cmds_ sorted by name (the GUI reorders cmds_)
+    void init_cmds_by_name();
+    CmdInfo const* find_cmd(std::string_view name) const;
+    static bool match_params(std::string_view input, std::vector<Param> const& params, Args& args);
+
+    // Trace recording (record) and replay (replay). A trace line has the start time and
+    // latency of a command and a hash of its output, so replays are verified without
+    // storing the outputs. Commands that run command lines (read etc.) are not traced
+    // themselves, the commands they run are.
+    struct TracedCommand
+    {
+        std::uint64_t hash = 0;
+        std::uint64_t latency_ns = 0;
+    };
+    std::unique_ptr<std::ostream> trace_; // The trace being recorded, if any
+    std::string trace_filename_;
+    std::chrono::steady_clock::time_point trace_start_;
+    unsigned long int traced_commands_ = 0;
+    bool capture_commands_ = false; // Set by replay: every command stores its hash and latency in last_command_
+    TracedCommand last_command_;
+    static bool is_traced(CmdInfo const& cmd);
+
+    // Always-on command profile (stats): the stack of the commands running now, separated
+    // by ';', and the time taken so far by the commands each of them has run
+    std::string stats_stack_;
+    std::vector<std::uint64_t> stats_children_ns_;
 
 
     CmdResult cmd_get_affiliation_count(std::ostream& output, MatchIter begin, MatchIter end);
@@ -149,20 +188,44 @@ private:
     CmdResult help_command(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_randseed(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_random_affiliations(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_random_generator(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_read(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_testread(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_record(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_replay(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_stopwatch(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_perftest(std::ostream& output, MatchIter begin, MatchIter end);
+    void print_latencies(std::ostream& output, std::vector<PerfRecord> const& records, bool csv);
+    void print_complexity_fits(std::ostream& output, std::vector<PerfRecord> const& records);
+    void print_regressions(std::ostream& output, std::string const& baselinefile, std::vector<PerfRegression> const& regressions,
+                           double max_slowdown_percent);
     CmdResult cmd_comment(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_get_affiliations(std::ostream& output, MatchIter begin, MatchIter end);
     // PRG2 command functions
     CmdResult cmd_get_connected_affiliations(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_get_all_connections(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_write_all_connections(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_get_any_path(std::ostream& output, MatchIter begin, MatchIter end);
     // PRG2 optional
     CmdResult cmd_get_path_with_least_affiliations(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_get_path_of_least_friction(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_get_shortest_path(std::ostream& output, MatchIter begin, MatchIter end);
+    // Year range queries
+    CmdResult cmd_count_publications_in_years(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_get_publications_in_years(std::ostream& output, MatchIter begin, MatchIter end);
+    // Snapshots
+    CmdResult cmd_save_snapshot(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_load_snapshot(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_map_snapshot(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_epoch(std::ostream& output, MatchIter begin, MatchIter end);
+    void print_snapshot_contents(std::ostream& output);
+    // Bulk import
+    CmdResult cmd_import(std::ostream& output, MatchIter begin, MatchIter end);
+    // Micro-benchmarks
+    CmdResult cmd_nearest_benchmark(std::ostream& output, MatchIter begin, MatchIter end);
+    // Diagnostics
+    CmdResult cmd_memory_usage(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_stats(std::ostream& output, MatchIter begin, MatchIter end);
 
     // random ids for perftest
     AffiliationID random_affiliation();
@@ -195,18 +258,49 @@ private:
     // prg2
     void test_get_connected_affiliations();
     void test_get_all_connections();
+    void test_visit_all_connections();
     void test_get_any_path();
     // prg2 optional
     void test_get_path_with_least_affiliations();
     void test_get_path_of_least_friction();
     void test_get_shortest_path();
+    // year range queries
+    void test_count_publications_in_years();
+    void test_get_publications_in_years();
 
 
     inline Coord get_random_coords(const Coord min = RANDOM_MIN_COORD, const Coord max = RANDOM_MAX_COORD);
     inline Year get_random_year(const Year min = RANDOM_MIN_YEAR, const Year max = RANDOM_MAX_YEAR);
     std::vector<Coord> get_unique_coords(const unsigned int n,const std::unordered_set<Coord,CoordHash>& exclude_list,const Coord min=RANDOM_MIN_COORD,const Coord max=RANDOM_MAX_COORD);
     void add_random_affiliations_publications(unsigned int size, Coord min = RANDOM_MIN_COORD, Coord max = RANDOM_MAX_COORD,const std::vector<Coord>& coordinates={});
+
+    // Shape of the random data of random_add and perftest, set with random_generator.
+    // The defaults are the original ones: affiliations of publications picked uniformly,
+    // uniform coordinates, and publication n referencing publication n/2.
+    enum class AffiliationPick { UNIFORM, POWERLAW };
+    enum class CoordPlacement { UNIFORM, CLUSTERED };
+    enum class ReferenceShape { BINARY, TREE };
+    struct RandomGenerator
+    {
+        AffiliationPick affiliations = AffiliationPick::UNIFORM;
+        CoordPlacement coords = CoordPlacement::UNIFORM;
+        unsigned int clusters = 20;
+        ReferenceShape references = ReferenceShape::BINARY;
+        unsigned int branching = 2;
+        unsigned int max_depth = 0; // 0 = unlimited
+    };
+    RandomGenerator generator_;
+    // Preferential attachment: each random affiliation once, plus once for every publication
+    // added with powerlaw that it is in (picking from this favors the well connected ones)
+    std::vector<unsigned long int> attachment_;
+    unsigned long int attachment_affiliations_ = 0; // Affiliations 0..this-1 are in attachment_
+    std::vector<Coord> cluster_centers_;
+    std::vector<AffiliationID> pick_publication_affiliations(unsigned int count, unsigned long int available);
+    Coord get_clustered_coords(Coord min, Coord max);
+    bool reference_parent(unsigned long int n, PublicationID& parentid);
+    void print_random_generator(std::ostream& output) const;
     Distance calc_distance(Coord c1, Coord c2);
+    void print_result(CmdResult& result, std::ostream& output);
     std::string print_affiliation(AffiliationID id, std::ostream& output, bool nl = true);
     std::string print_affiliation_brief(AffiliationID id, std::ostream& output, bool nl = true);
     std::string print_publication(PublicationID id, std::ostream& output, bool nl = true);
@@ -220,16 +314,16 @@ private:
     template <typename From>
     static std::string convert_to_string(From from);
 
-    template<AffiliationID(Datastructures::*MFUNC)()>
+    template<AffiliationID(Datastructures::*MFUNC)() const>
     CmdResult NoParAffiliationCmd(std::ostream& output, MatchIter begin, MatchIter end);
 
-    template<std::vector<AffiliationID>(Datastructures::*MFUNC)()>
+    template<std::vector<AffiliationID>(Datastructures::*MFUNC)() const>
     CmdResult NoParListCmd(std::ostream& output, MatchIter begin, MatchIter end);
 
-    template<AffiliationID(Datastructures::*MFUNC)()>
+    template<AffiliationID(Datastructures::*MFUNC)() const>
     void NoParAffiliationTestCmd();
 
-    template<std::vector<AffiliationID>(Datastructures::*MFUNC)()>
+    template<std::vector<AffiliationID>(Datastructures::*MFUNC)() const>
     void NoParListTestCmd();
 
     friend class MainWindow;
@@ -271,27 +365,27 @@ std::string MainProgram::convert_to_string(From from)
     return ostr.str();
 }
 
-template<AffiliationID(Datastructures::*MFUNC)()>
+template<AffiliationID(Datastructures::*MFUNC)() const>
 MainProgram::CmdResult MainProgram::NoParAffiliationCmd(std::ostream& /*output*/, MatchIter /*begin*/, MatchIter /*end*/)
 {
     auto result = (ds_.*MFUNC)();
     return {ResultType::IDLIST, CmdResultIDs{{}, {result}}};
 }
 
-template<std::vector<AffiliationID>(Datastructures::*MFUNC)()>
+template<std::vector<AffiliationID>(Datastructures::*MFUNC)() const>
 MainProgram::CmdResult MainProgram::NoParListCmd(std::ostream& /*output*/, MatchIter /*begin*/, MatchIter /*end*/)
 {
     auto result = (ds_.*MFUNC)();
     return {ResultType::IDLIST, CmdResultIDs{{}, result}};
 }
 
-template<AffiliationID(Datastructures::*MFUNC)()>
+template<AffiliationID(Datastructures::*MFUNC)() const>
 void MainProgram::NoParAffiliationTestCmd()
 {
     (ds_.*MFUNC)();
 }
 
-template<std::vector<AffiliationID>(Datastructures::*MFUNC)()>
+template<std::vector<AffiliationID>(Datastructures::*MFUNC)() const>
 void MainProgram::NoParListTestCmd()
 {
     (ds_.*MFUNC)();
@@ -324,22 +418,44 @@ class MainProgram::Stopwatch
 public:
     using Clock = std::chrono::high_resolution_clock;
 
+    // Hardware events counted with use_counter (and USE_PERF_EVENT), read together as one group.
+    // Events that cannot be opened (e.g. in containers or virtual machines) are left out,
+    // and if the first one cannot be opened, nothing is counted.
+    static std::size_t const COUNTER_COUNT = 5;
+    enum Counter { INSTRUCTIONS, CYCLES, CACHE_MISSES, BRANCH_MISSES, LLC_LOADS };
+    using Counts = std::array<long long, COUNTER_COUNT>;
+
     Stopwatch(bool use_counter = false) : use_counter_(use_counter)
     {
 #ifdef USE_PERF_EVENT
         if (use_counter_)
         {
-            memset(&pe_, 0, sizeof(pe_));
-            pe_.type = PERF_TYPE_HARDWARE;
-            pe_.size = sizeof(pe_);
-            pe_.config = PERF_COUNT_HW_INSTRUCTIONS;
-            pe_.disabled = 1;
-            pe_.exclude_kernel = 1;
-            pe_.exclude_hv = 1;
-
-            fd_ = perf_event_open(&pe_, 0, -1, -1, 0);
-            if (fd_ == -1) {
-                throw "Couldn't open perf events!";
+            struct { std::uint32_t type; std::uint64_t config; } const events[COUNTER_COUNT] =
+            {
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+                {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16)},
+            };
+            for (std::size_t i = 0; i < COUNTER_COUNT; ++i)
+            {
+                memset(&pe_, 0, sizeof(pe_));
+                pe_.type = events[i].type;
+                pe_.size = sizeof(pe_);
+                pe_.config = events[i].config;
+                pe_.disabled = (i == 0); // The group follows its leader
+                pe_.exclude_kernel = 1;
+                pe_.exclude_hv = 1;
+                pe_.read_format = PERF_FORMAT_GROUP;
+
+                fds_[i] = perf_event_open(&pe_, 0, -1, i == 0 ? -1 : fds_[0], 0);
+                if (fds_[i] == -1)
+                {
+                    if (i == 0) { break; }
+                    continue;
+                }
+                group_index_[i] = group_size_++;
             }
         }
 #endif
@@ -349,9 +465,9 @@ public:
     ~Stopwatch()
     {
 #ifdef USE_PERF_EVENT
-        if (use_counter_)
+        for (int fd : fds_)
         {
-            close(fd_);
+            if (fd != -1) { close(fd); }
         }
 #endif
     }
@@ -359,26 +475,34 @@ public:
     void start()
     {
         running_ = true;
+#ifdef USE_ALLOC_COUNT
+        savedpeak_ = begin_peak_interval();
+        startallocs_ = allocation_counts();
+#endif
         starttime_ = Clock::now();
 #ifdef USE_PERF_EVENT
-        if (use_counter_)
+        if (counting())
         {
-            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
-            read(fd_, &startcount_, sizeof(startcount_));
-            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+            ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            startcounts_ = read_group();
+            ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
         }
 #endif
     }
 
     void stop()
     {
+#ifdef USE_ALLOC_COUNT
+        allocs_ = allocations();
+        end_peak_interval(savedpeak_);
+#endif
         running_ = false;
 #ifdef USE_PERF_EVENT
-        if (use_counter_)
+        if (counting())
         {
-            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
-            long long c; read(fd_, &c, sizeof(c));
-            counter_ += (c - startcount_);
+            ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            Counts c = read_group();
+            for (std::size_t i = 0; i < COUNTER_COUNT; ++i) { counters_[i] += (c[i] - startcounts_[i]); }
         }
 #endif
         elapsed_ += (Clock::now() - starttime_);
@@ -388,12 +512,15 @@ public:
     {
         running_ = false;
 #ifdef USE_PERF_EVENT
-        if (use_counter_)
+        if (counting())
         {
-            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
-            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
-            counter_ = 0;
+            ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
         }
+        counters_.fill(0);
+#endif
+#ifdef USE_ALLOC_COUNT
+        allocs_ = {};
 #endif
         elapsed_ = elapsed_.zero();
     }
@@ -412,24 +539,71 @@ public:
     }
 
 #ifdef USE_PERF_EVENT
-    long long count()
+    bool counter_available(std::size_t counter) const { return group_index_[counter] != NOT_COUNTED; }
+
+    // All counters (0 for the unavailable ones)
+    Counts counts()
     {
-        if (use_counter_)
+        if (!running_ || !counting())
         {
-            if (!running_)
-            {
-                return counter_;
-            }
-            else
+            return counters_;
+        }
+        Counts c = read_group();
+        Counts total = counters_;
+        for (std::size_t i = 0; i < COUNTER_COUNT; ++i) { total[i] += (c[i] - startcounts_[i]); }
+        return total;
+    }
+
+    // Instructions, as counted before there were several counters
+    long long count() { return counts()[INSTRUCTIONS]; }
+
+    // Writes the available counters (and instructions per cycle) of counts as ", name: value" pairs
+    void print_counts(std::ostream& output, Counts const& counts) const
+    {
+        static char const* const names[COUNTER_COUNT] = {"instructions", "cycles", "cache-misses", "branch-misses", "LLC loads"};
+        if (!counting())
+        {
+            output << ", counters unavailable";
+            return;
+        }
+        for (std::size_t i = 0; i < COUNTER_COUNT; ++i)
+        {
+            if (!counter_available(i)) { continue; }
+            output << ", " << names[i] << ": " << counts[i];
+            if (i == CYCLES && counter_available(INSTRUCTIONS) && counts[CYCLES] > 0)
             {
-                long long c;
-                read(fd_, &c, sizeof(c));
-                return counter_ + (c - startcount_);
+                output << " (IPC " << static_cast<double>(counts[INSTRUCTIONS]) / static_cast<double>(counts[CYCLES]) << ")";
             }
         }
-        else
+    }
+#endif
+
+#ifdef USE_ALLOC_COUNT
+    // Heap allocations while the stopwatch ran, and the highest live heap size meanwhile
+    AllocationCounts allocations() const
+    {
+        if (!running_)
         {
-            assert(!"perf_event not enabled during StopWatch creation!");
+            return allocs_;
+        }
+        AllocationCounts now = allocation_counts();
+        AllocationCounts total = allocs_;
+        total.allocations += now.allocations - startallocs_.allocations;
+        total.bytes += now.bytes - startallocs_.bytes;
+        total.peak_live_bytes = std::max(total.peak_live_bytes, now.peak_live_bytes);
+        return total;
+    }
+
+    // Starts the peak over from the next start (allocations and bytes keep accumulating)
+    void reset_peak() { allocs_.peak_live_bytes = 0; }
+
+    // Writes the counts as ", name: value" pairs, the peak only if it is set
+    static void print_allocations(std::ostream& output, AllocationCounts const& counts)
+    {
+        output << ", allocations: " << counts.allocations << ", allocated: " << counts.bytes << " bytes";
+        if (counts.peak_live_bytes > 0)
+        {
+            output << ", peak live: " << counts.peak_live_bytes << " bytes";
         }
     }
 #endif
@@ -441,10 +615,35 @@ private:
 
     bool use_counter_;
 #ifdef USE_PERF_EVENT
+    static std::size_t const NOT_COUNTED = COUNTER_COUNT;
+    bool counting() const { return group_size_ > 0; }
+
+    // The group read gives the number of events followed by their values in the order they were opened
+    Counts read_group() const
+    {
+        std::uint64_t values[1 + COUNTER_COUNT] = {};
+        Counts c{};
+        if (read(fds_[0], values, sizeof(values)) > 0)
+        {
+            for (std::size_t i = 0; i < COUNTER_COUNT; ++i)
+            {
+                if (counter_available(i)) { c[i] = static_cast<long long>(values[1 + group_index_[i]]); }
+            }
+        }
+        return c;
+    }
+
     struct perf_event_attr pe_;
-    long long startcount_ = 0;
-    long long counter_ = 0;
-    int fd_ = 0;
+    std::array<int, COUNTER_COUNT> fds_ = {-1, -1, -1, -1, -1};
+    std::array<std::size_t, COUNTER_COUNT> group_index_ = {NOT_COUNTED, NOT_COUNTED, NOT_COUNTED, NOT_COUNTED, NOT_COUNTED};
+    std::size_t group_size_ = 0;
+    Counts startcounts_ = {};
+    Counts counters_ = {};
+#endif
+#ifdef USE_ALLOC_COUNT
+    std::uint64_t savedpeak_ = 0;
+    AllocationCounts startallocs_;
+    AllocationCounts allocs_;
 #endif
 };
 
@@ -0,0 +1,508 @@
+// Mappedsnapshot.cc
+
+#include "mappedsnapshot.hh"
+#include "nearest.hh"
+#include "pathsearch.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <unordered_set>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SNAPSHOT_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The mapped graph as seen by the path searches
+struct MappedSnapshot::GraphView
+{
+  SnapshotView const &view;
+
+  struct EdgeRange
+  {
+    std::uint32_t const *first;
+    std::uint32_t const *last;
+    std::uint32_t const *begin() const { return first; }
+    std::uint32_t const *end() const { return last; }
+  };
+
+  std::size_t node_count() const { return view.aff_count; }
+  EdgeRange incident_edges(std::uint32_t aff) const
+  {
+    return {view.aff_edges + view.aff_edge_offsets[aff], view.aff_edges + view.aff_edge_offsets[aff + 1]};
+  }
+  std::uint32_t other_end(std::uint32_t edge, std::uint32_t aff) const
+  {
+    return view.edges[edge].aff1 == aff ? view.edges[edge].aff2 : view.edges[edge].aff1;
+  }
+  Weight weight(std::uint32_t edge) const { return view.edges[edge].weight; }
+  Coord coord(std::uint32_t aff) const { return {view.aff_x[aff], view.aff_y[aff]}; }
+  std::string_view id(std::uint32_t aff) const { return view.aff_id(aff); }
+};
+
+std::unique_ptr<MappedSnapshot> MappedSnapshot::open(const std::string &filename)
+{
+  std::unique_ptr<MappedSnapshot> snapshot(new MappedSnapshot());
+
+#ifdef SNAPSHOT_MMAP
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return nullptr;
+  }
+  struct stat status;
+  if (::fstat(fd, &status) == 0 && status.st_size > 0)
+  {
+    void *data = ::mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    if (data != MAP_FAILED)
+    {
+      snapshot->data_ = static_cast<char const *>(data);
+      snapshot->size_ = static_cast<std::size_t>(status.st_size);
+      snapshot->mapped_ = true;
+    }
+  }
+  ::close(fd);
+#endif
+
+  if (!snapshot->mapped_)
+  {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+      return nullptr;
+    }
+    std::streamoff size = file.tellg();
+    file.seekg(0);
+    snapshot->buffer_.resize((static_cast<std::size_t>(size) + 7) / 8);
+    if (!file.read(reinterpret_cast<char *>(snapshot->buffer_.data()), size))
+    {
+      return nullptr;
+    }
+    snapshot->data_ = reinterpret_cast<char const *>(snapshot->buffer_.data());
+    snapshot->size_ = static_cast<std::size_t>(size);
+  }
+
+  if (!snapshot->validate())
+  {
+    return nullptr;
+  }
+  return snapshot;
+}
+
+std::unique_ptr<MappedSnapshot> MappedSnapshot::from_buffer(std::vector<std::uint64_t> buffer, std::size_t size,
+                                                            bool check_structure)
+{
+  std::unique_ptr<MappedSnapshot> snapshot(new MappedSnapshot());
+  snapshot->buffer_ = std::move(buffer);
+  snapshot->data_ = reinterpret_cast<char const *>(snapshot->buffer_.data());
+  snapshot->size_ = size;
+  if (!snapshot->validate(check_structure))
+  {
+    return nullptr;
+  }
+  return snapshot;
+}
+
+bool MappedSnapshot::validate(bool check_structure)
+{
+  reader_ = SnapshotReader(data_, size_);
+  if (!snapshot_view(reader_, view_, check_structure))
+  {
+    return false;
+  }
+  for (std::size_t aff = 0; aff < view_.aff_count; ++aff)
+  {
+    if (!nearest_simd_coord_ok(view_.aff_x[aff], view_.aff_y[aff]))
+    {
+      coords_in_simd_range_ = false;
+      break;
+    }
+  }
+  return true;
+}
+
+MappedSnapshot::~MappedSnapshot()
+{
+#ifdef SNAPSHOT_MMAP
+  if (mapped_)
+  {
+    ::munmap(const_cast<char *>(data_), size_);
+  }
+#endif
+}
+
+unsigned int MappedSnapshot::get_affiliation_count() const
+{
+  return static_cast<unsigned int>(view_.aff_count);
+}
+
+std::vector<AffiliationID> MappedSnapshot::get_all_affiliations() const
+{
+  std::vector<AffiliationID> affiliations;
+  affiliations.reserve(view_.aff_count);
+  for (std::uint32_t aff = 0; aff < view_.aff_count; ++aff)
+  {
+    affiliations.emplace_back(view_.aff_id(aff));
+  }
+  return affiliations;
+}
+
+Name MappedSnapshot::get_affiliation_name(const AffiliationID &id) const
+{
+  std::uint32_t aff = find_affiliation(id);
+  return aff != SNAPSHOT_NONE ? Name(view_.aff_name(aff)) : NO_NAME;
+}
+
+Coord MappedSnapshot::get_affiliation_coord(const AffiliationID &id) const
+{
+  std::uint32_t aff = find_affiliation(id);
+  return aff != SNAPSHOT_NONE ? Coord{view_.aff_x[aff], view_.aff_y[aff]} : NO_COORD;
+}
+
+std::vector<AffiliationID> MappedSnapshot::get_affiliations_alphabetically() const
+{
+  std::vector<AffiliationID> affiliations;
+  affiliations.reserve(view_.aff_count);
+  for (std::size_t i = 0; i < view_.aff_count; ++i)
+  {
+    affiliations.emplace_back(view_.aff_id(view_.aff_by_name[i]));
+  }
+  return affiliations;
+}
+
+std::vector<AffiliationID> MappedSnapshot::get_affiliations_distance_increasing() const
+{
+  std::vector<AffiliationID> affiliations;
+  affiliations.reserve(view_.aff_by_coord_count);
+  for (std::size_t i = 0; i < view_.aff_by_coord_count; ++i)
+  {
+    affiliations.emplace_back(view_.aff_id(view_.aff_by_coord[i]));
+  }
+  return affiliations;
+}
+
+AffiliationID MappedSnapshot::find_affiliation_with_coord(Coord xy) const
+{
+  // The coordinate order is that of Coord::operator<, where equivalent coordinates are a match
+  auto coord_of = [this](std::uint32_t aff) { return Coord{view_.aff_x[aff], view_.aff_y[aff]}; };
+  auto end = view_.aff_by_coord + view_.aff_by_coord_count;
+  auto it = std::lower_bound(view_.aff_by_coord, end, xy, [&coord_of](std::uint32_t aff, Coord const &xy) {
+    return coord_of(aff) < xy;
+  });
+  return (it != end && !(xy < coord_of(*it))) ? AffiliationID(view_.aff_id(*it)) : NO_AFFILIATION;
+}
+
+std::vector<AffiliationID> MappedSnapshot::get_affiliations_closest_to(Coord xy) const
+{
+  NearestKernel kernel = nearest_best_kernel().kernel;
+  if (!coords_in_simd_range_ || !nearest_simd_coord_ok(xy.x, xy.y))
+  {
+    kernel = &nearest_scalar;
+  }
+
+  NearestResult best[3];
+  std::size_t found = kernel(view_.aff_x, view_.aff_y, view_.aff_count, xy.x, xy.y, best, 3);
+
+  std::vector<AffiliationID> closest_affs;
+  closest_affs.reserve(found);
+  for (std::size_t i = 0; i < found; ++i)
+  {
+    closest_affs.emplace_back(view_.aff_id(best[i].index));
+  }
+  return closest_affs;
+}
+
+std::vector<PublicationID> MappedSnapshot::all_publications() const
+{
+  return std::vector<PublicationID>(view_.pub_ids, view_.pub_ids + view_.pub_count);
+}
+
+Name MappedSnapshot::get_publication_name(PublicationID id) const
+{
+  std::uint32_t pub = find_publication(id);
+  return pub != SNAPSHOT_NONE ? Name(view_.pub_name(pub)) : NO_NAME;
+}
+
+Year MappedSnapshot::get_publication_year(PublicationID id) const
+{
+  std::uint32_t pub = find_publication(id);
+  return pub != SNAPSHOT_NONE ? view_.pub_years[pub] : NO_YEAR;
+}
+
+std::vector<AffiliationID> MappedSnapshot::get_affiliations(PublicationID id) const
+{
+  std::uint32_t pub = find_publication(id);
+  if (pub == SNAPSHOT_NONE)
+  {
+    return {NO_AFFILIATION};
+  }
+  std::vector<AffiliationID> affiliations;
+  affiliations.reserve(view_.pub_aff_offsets[pub + 1] - view_.pub_aff_offsets[pub]);
+  for (std::uint64_t aff = view_.pub_aff_offsets[pub]; aff < view_.pub_aff_offsets[pub + 1]; ++aff)
+  {
+    affiliations.emplace_back(view_.pub_aff_id(aff));
+  }
+  return affiliations;
+}
+
+std::vector<PublicationID> MappedSnapshot::get_direct_references(PublicationID id) const
+{
+  std::uint32_t pub = find_publication(id);
+  if (pub == SNAPSHOT_NONE)
+  {
+    return {NO_PUBLICATION};
+  }
+  std::vector<PublicationID> children;
+  children.reserve(view_.pub_child_offsets[pub + 1] - view_.pub_child_offsets[pub]);
+  for (std::uint64_t child = view_.pub_child_offsets[pub]; child < view_.pub_child_offsets[pub + 1]; ++child)
+  {
+    children.push_back(view_.pub_ids[view_.pub_children[child]]);
+  }
+  return children;
+}
+
+std::vector<PublicationID> MappedSnapshot::get_publications(const AffiliationID &id) const
+{
+  std::uint32_t aff = find_affiliation(id);
+  if (aff == SNAPSHOT_NONE)
+  {
+    return {NO_PUBLICATION};
+  }
+  return std::vector<PublicationID>(view_.aff_pubs + view_.aff_pub_offsets[aff], view_.aff_pubs + view_.aff_pub_offsets[aff + 1]);
+}
+
+PublicationID MappedSnapshot::get_parent(PublicationID id) const
+{
+  std::uint32_t pub = find_publication(id);
+  return (pub != SNAPSHOT_NONE && view_.pub_parents[pub] != SNAPSHOT_NONE) ? view_.pub_ids[view_.pub_parents[pub]] : NO_PUBLICATION;
+}
+
+std::vector<PublicationID> MappedSnapshot::get_referenced_by_chain(PublicationID id) const
+{
+  std::uint32_t pub = find_publication(id);
+  if (pub == SNAPSHOT_NONE)
+  {
+    return {NO_PUBLICATION};
+  }
+  std::vector<PublicationID> parents_chain;
+  for (std::uint32_t parent = view_.pub_parents[pub]; parent != SNAPSHOT_NONE; parent = view_.pub_parents[parent])
+  {
+    parents_chain.push_back(view_.pub_ids[parent]);
+  }
+  return parents_chain;
+}
+
+std::vector<std::pair<Year, PublicationID>> MappedSnapshot::get_publications_after(const AffiliationID &id, Year year) const
+{
+  std::uint32_t aff = find_affiliation(id);
+  if (aff == SNAPSHOT_NONE)
+  {
+    return {{NO_YEAR, NO_PUBLICATION}};
+  }
+  std::vector<std::pair<Year, PublicationID>> years;
+  for (std::uint64_t i = view_.aff_pub_offsets[aff]; i < view_.aff_pub_offsets[aff + 1]; ++i)
+  {
+    std::uint32_t pub = find_publication(view_.aff_pubs[i]);
+    if (pub != SNAPSHOT_NONE && view_.pub_years[pub] >= year)
+    {
+      years.push_back({view_.pub_years[pub], view_.aff_pubs[i]});
+    }
+  }
+  std::sort(years.begin(), years.end());
+  years.erase(std::unique(years.begin(), years.end()), years.end());
+  return years;
+}
+
+std::vector<PublicationID> MappedSnapshot::get_all_references(PublicationID id) const
+{
+  std::uint32_t pub = find_publication(id);
+  if (pub == SNAPSHOT_NONE)
+  {
+    return {NO_PUBLICATION};
+  }
+  std::vector<PublicationID> store;
+  for (std::uint64_t child = view_.pub_child_offsets[pub]; child < view_.pub_child_offsets[pub + 1]; ++child)
+  {
+    postorder_traversal(view_.pub_children[child], store);
+  }
+  return store;
+}
+
+void MappedSnapshot::postorder_traversal(std::uint32_t root, std::vector<PublicationID> &store) const
+{
+  for (std::uint64_t child = view_.pub_child_offsets[root]; child < view_.pub_child_offsets[root + 1]; ++child)
+  {
+    postorder_traversal(view_.pub_children[child], store);
+  }
+  store.push_back(view_.pub_ids[root]);
+}
+
+PublicationID MappedSnapshot::get_closest_common_parent(PublicationID id1, PublicationID id2) const
+{
+  std::uint32_t pub1 = find_publication(id1);
+  std::uint32_t pub2 = find_publication(id2);
+  if (pub1 == SNAPSHOT_NONE || pub2 == SNAPSHOT_NONE)
+  {
+    return NO_PUBLICATION;
+  }
+  std::unordered_set<std::uint32_t> parents_chain_id1;
+  for (std::uint32_t parent = view_.pub_parents[pub1]; parent != SNAPSHOT_NONE; parent = view_.pub_parents[parent])
+  {
+    parents_chain_id1.insert(parent);
+  }
+  for (std::uint32_t parent = view_.pub_parents[pub2]; parent != SNAPSHOT_NONE; parent = view_.pub_parents[parent])
+  {
+    if (parents_chain_id1.count(parent))
+    {
+      return view_.pub_ids[parent];
+    }
+  }
+  return NO_PUBLICATION;
+}
+
+unsigned int MappedSnapshot::count_publications_in_years(Year from, Year to) const
+{
+  if (from > to)
+  {
+    return 0;
+  }
+  if (view_.year_offsets)
+  {
+    // The bucket offsets are prefix counts
+    std::size_t first = std::min<std::size_t>(from, view_.year_count);
+    std::size_t last = std::min<std::size_t>(std::size_t(to) + 1, view_.year_count);
+    return static_cast<unsigned int>(view_.year_offsets[last] - view_.year_offsets[first]);
+  }
+  return static_cast<unsigned int>(std::count_if(view_.pub_years, view_.pub_years + view_.pub_count,
+                                                 [from, to](Year year) { return from <= year && year <= to; }));
+}
+
+std::vector<std::pair<Year, PublicationID>> MappedSnapshot::get_publications_in_years(Year from, Year to) const
+{
+  std::vector<std::pair<Year, PublicationID>> publications;
+  if (from > to)
+  {
+    return publications;
+  }
+  if (view_.year_offsets)
+  {
+    std::size_t last = std::min<std::size_t>(std::size_t(to) + 1, view_.year_count);
+    for (std::size_t year = from; year < last; ++year)
+    {
+      for (std::uint64_t i = view_.year_offsets[year]; i < view_.year_offsets[year + 1]; ++i)
+      {
+        publications.push_back({static_cast<Year>(year), view_.year_pubs[i]});
+      }
+    }
+    return publications;
+  }
+  // Without the index, scan all publications and order them as the index would
+  for (std::size_t pub = 0; pub < view_.pub_count; ++pub)
+  {
+    if (from <= view_.pub_years[pub] && view_.pub_years[pub] <= to)
+    {
+      publications.push_back({view_.pub_years[pub], view_.pub_ids[pub]});
+    }
+  }
+  std::sort(publications.begin(), publications.end());
+  return publications;
+}
+
+std::vector<Connection> MappedSnapshot::get_connected_affiliations(const AffiliationID &id) const
+{
+  std::uint32_t aff = find_affiliation(id);
+  if (aff == SNAPSHOT_NONE)
+  {
+    return {};
+  }
+  GraphView graph{view_};
+  std::vector<Connection> connections;
+  connections.reserve(view_.aff_edge_offsets[aff + 1] - view_.aff_edge_offsets[aff]);
+  for (std::uint32_t edge : graph.incident_edges(aff))
+  {
+    connections.push_back({id, AffiliationID(view_.aff_id(graph.other_end(edge, aff))), graph.weight(edge)});
+  }
+  return connections;
+}
+
+void MappedSnapshot::visit_all_connections(const ConnectionVisitor &visitor) const
+{
+  for (std::size_t edge = 0; edge < view_.edge_count; ++edge)
+  {
+    std::string_view id1 = view_.aff_id(view_.edges[edge].aff1);
+    std::string_view id2 = view_.aff_id(view_.edges[edge].aff2);
+    if (id1 < id2)
+    {
+      visitor(id1, id2, view_.edges[edge].weight);
+    }
+    else
+    {
+      visitor(id2, id1, view_.edges[edge].weight);
+    }
+  }
+}
+
+Path MappedSnapshot::get_any_path(const AffiliationID &source, const AffiliationID &target) const
+{
+  std::uint32_t source_aff = find_affiliation(source);
+  std::uint32_t target_aff = find_affiliation(target);
+  if (source_aff == SNAPSHOT_NONE || target_aff == SNAPSHOT_NONE)
+  {
+    return {};
+  }
+  return pathsearch::any_path(GraphView{view_}, source_aff, target_aff);
+}
+
+Path MappedSnapshot::get_path_with_least_affiliations(const AffiliationID &source, const AffiliationID &target) const
+{
+  std::uint32_t source_aff = find_affiliation(source);
+  std::uint32_t target_aff = find_affiliation(target);
+  if (source_aff == SNAPSHOT_NONE || target_aff == SNAPSHOT_NONE)
+  {
+    return {};
+  }
+  return pathsearch::path_with_least_nodes(GraphView{view_}, source_aff, target_aff);
+}
+
+Path MappedSnapshot::get_path_of_least_friction(const AffiliationID &source, const AffiliationID &target) const
+{
+  std::uint32_t source_aff = find_affiliation(source);
+  std::uint32_t target_aff = find_affiliation(target);
+  if (source_aff == SNAPSHOT_NONE || target_aff == SNAPSHOT_NONE)
+  {
+    return {};
+  }
+  return pathsearch::path_of_least_friction(GraphView{view_}, source_aff, target_aff);
+}
+
+PathWithDist MappedSnapshot::get_shortest_path(const AffiliationID &source, const AffiliationID &target) const
+{
+  std::uint32_t source_aff = find_affiliation(source);
+  std::uint32_t target_aff = find_affiliation(target);
+  if (source_aff == SNAPSHOT_NONE || target_aff == SNAPSHOT_NONE)
+  {
+    return {};
+  }
+  return pathsearch::shortest_path(GraphView{view_}, source_aff, target_aff);
+}
+
+std::uint32_t MappedSnapshot::find_affiliation(std::string_view id) const
+{
+  auto end = view_.aff_by_id + view_.aff_count;
+  auto it = std::lower_bound(view_.aff_by_id, end, id, [this](std::uint32_t aff, std::string_view id) {
+    return view_.aff_id(aff) < id;
+  });
+  return (it != end && view_.aff_id(*it) == id) ? *it : SNAPSHOT_NONE;
+}
+
+std::uint32_t MappedSnapshot::find_publication(PublicationID id) const
+{
+  auto end = view_.pub_by_id + view_.pub_count;
+  auto it = std::lower_bound(view_.pub_by_id, end, id, [this](std::uint32_t pub, PublicationID id) {
+    return view_.pub_ids[pub] < id;
+  });
+  return (it != end && view_.pub_ids[*it] == id) ? *it : SNAPSHOT_NONE;
+}
@@ -0,0 +1,88 @@
+// Mappedsnapshot.hh
+//
+// Read-only access to a snapshot file mapped into memory. Queries are answered
+// from the mapped arrays directly, without building the in-memory containers,
+// so opening is fast and processes mapping the same file share its pages.
+// Where memory mapping is not available the file is read into a buffer instead.
+
+#ifndef MAPPEDSNAPSHOT_HH
+#define MAPPEDSNAPSHOT_HH
+
+#include "datastructures.hh"
+#include "snapshot.hh"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class MappedSnapshot
+{
+public:
+  // Returns nullptr if the file cannot be mapped or is not a valid snapshot
+  static std::unique_ptr<MappedSnapshot> open(std::string const &filename);
+  // Takes over a snapshot already in memory (size bytes of buffer); nullptr if it is not valid.
+  // One written by this process from a consistent state needs no check_structure (see snapshot_view).
+  static std::unique_ptr<MappedSnapshot> from_buffer(std::vector<std::uint64_t> buffer, std::size_t size,
+                                                     bool check_structure = true);
+  ~MappedSnapshot();
+
+  MappedSnapshot(MappedSnapshot const &) = delete;
+  MappedSnapshot &operator=(MappedSnapshot const &) = delete;
+
+  SnapshotReader const &reader() const { return reader_; }
+  std::size_t size() const { return size_; } // Bytes of the snapshot
+  bool is_mapped() const { return mapped_; } // Whether the file is mapped rather than read into memory
+
+  unsigned int get_affiliation_count() const;
+  std::vector<AffiliationID> get_all_affiliations() const;
+  Name get_affiliation_name(AffiliationID const &id) const;
+  Coord get_affiliation_coord(AffiliationID const &id) const;
+  std::vector<AffiliationID> get_affiliations_alphabetically() const;
+  std::vector<AffiliationID> get_affiliations_distance_increasing() const;
+  AffiliationID find_affiliation_with_coord(Coord xy) const;
+  std::vector<AffiliationID> get_affiliations_closest_to(Coord xy) const;
+
+  std::vector<PublicationID> all_publications() const;
+  Name get_publication_name(PublicationID id) const;
+  Year get_publication_year(PublicationID id) const;
+  std::vector<AffiliationID> get_affiliations(PublicationID id) const;
+  std::vector<PublicationID> get_direct_references(PublicationID id) const;
+  std::vector<PublicationID> get_publications(AffiliationID const &id) const;
+  PublicationID get_parent(PublicationID id) const;
+  std::vector<PublicationID> get_referenced_by_chain(PublicationID id) const;
+  std::vector<std::pair<Year, PublicationID>> get_publications_after(AffiliationID const &id, Year year) const;
+  std::vector<PublicationID> get_all_references(PublicationID id) const;
+  PublicationID get_closest_common_parent(PublicationID id1, PublicationID id2) const;
+  unsigned int count_publications_in_years(Year from, Year to) const;
+  std::vector<std::pair<Year, PublicationID>> get_publications_in_years(Year from, Year to) const;
+
+  std::vector<Connection> get_connected_affiliations(AffiliationID const &id) const;
+  void visit_all_connections(ConnectionVisitor const &visitor) const;
+  Path get_any_path(AffiliationID const &source, AffiliationID const &target) const;
+  Path get_path_with_least_affiliations(AffiliationID const &source, AffiliationID const &target) const;
+  Path get_path_of_least_friction(AffiliationID const &source, AffiliationID const &target) const;
+  PathWithDist get_shortest_path(AffiliationID const &source, AffiliationID const &target) const;
+
+private:
+  MappedSnapshot() : reader_(nullptr, 0) {}
+  // Sets up reader_ and view_ for data_, returns false if the snapshot is not valid
+  bool validate(bool check_structure = true);
+
+  // Binary searches over the id orders, SNAPSHOT_NONE if not found
+  std::uint32_t find_affiliation(std::string_view id) const;
+  std::uint32_t find_publication(PublicationID id) const;
+  void postorder_traversal(std::uint32_t root, std::vector<PublicationID> &store) const;
+
+  struct GraphView;
+
+  char const *data_ = nullptr;
+  std::size_t size_ = 0;
+  bool mapped_ = false;
+  std::vector<std::uint64_t> buffer_; // The file contents when it could not be mapped
+  SnapshotReader reader_;
+  SnapshotView view_;
+  bool coords_in_simd_range_ = true;
+};
+
+#endif // MAPPEDSNAPSHOT_HH
@@ -0,0 +1,190 @@
+// Nearest.cc
+
+#include "nearest.hh"
+
+#include <climits>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define NEAREST_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+// Inserts a candidate into the sorted top-k array. The caller has checked that
+// dist is smaller than the current k:th distance (or that fewer than k are found).
+inline void insert_candidate(NearestResult *best, std::size_t &found, std::size_t k, long long int dist, std::uint32_t index)
+{
+  std::size_t pos = found < k ? found : k - 1;
+  while (pos > 0 && best[pos - 1].dist > dist)
+  {
+    best[pos] = best[pos - 1];
+    --pos;
+  }
+  best[pos] = {dist, index};
+  if (found < k)
+  {
+    ++found;
+  }
+}
+
+inline long long int threshold_of(NearestResult const *best, std::size_t found, std::size_t k)
+{
+  return found < k ? LLONG_MAX : best[k - 1].dist;
+}
+
+// Scalar processing of the elements [begin, n), shared by all kernels for their tails
+inline void scan_scalar(int const *xs, int const *ys, std::size_t begin, std::size_t n, int qx, int qy,
+                        NearestResult *best, std::size_t &found, std::size_t k)
+{
+  long long int threshold = threshold_of(best, found, k);
+  for (std::size_t i = begin; i < n; ++i)
+  {
+    long long int dx = static_cast<long long int>(xs[i]) - qx;
+    long long int dy = static_cast<long long int>(ys[i]) - qy;
+    long long int dist = dx * dx + dy * dy;
+    if (dist < threshold)
+    {
+      insert_candidate(best, found, k, dist, static_cast<std::uint32_t>(i));
+      threshold = threshold_of(best, found, k);
+    }
+  }
+}
+
+#ifdef NEAREST_X86_KERNELS
+
+// Inserts the lanes of dists whose bit is set in mask, in lane order
+inline void insert_lanes(long long int const *dists, int lanes, int mask, std::size_t base,
+                         NearestResult *best, std::size_t &found, std::size_t k)
+{
+  for (int lane = 0; lane < lanes; ++lane)
+  {
+    // The threshold may have dropped since the vector comparison, so recheck
+    if ((mask & (1 << lane)) && dists[lane] < threshold_of(best, found, k))
+    {
+      insert_candidate(best, found, k, dists[lane], static_cast<std::uint32_t>(base + lane));
+    }
+  }
+}
+
+__attribute__((target("sse4.2")))
+std::size_t nearest_sse42(int const *xs, int const *ys, std::size_t n, int qx, int qy, NearestResult *best, std::size_t k)
+{
+  std::size_t found = 0;
+  if (k == 0)
+  {
+    return 0;
+  }
+
+  __m128i const vqx = _mm_set1_epi32(qx);
+  __m128i const vqy = _mm_set1_epi32(qy);
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128i dx = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const *>(xs + i)), vqx);
+    __m128i dy = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const *>(ys + i)), vqy);
+
+    // _mm_mul_epi32 multiplies the (sign-extended) low 32 bits of each 64-bit lane
+    __m128i dx_lo = _mm_cvtepi32_epi64(dx);
+    __m128i dy_lo = _mm_cvtepi32_epi64(dy);
+    __m128i dx_hi = _mm_cvtepi32_epi64(_mm_srli_si128(dx, 8));
+    __m128i dy_hi = _mm_cvtepi32_epi64(_mm_srli_si128(dy, 8));
+    __m128i dist_lo = _mm_add_epi64(_mm_mul_epi32(dx_lo, dx_lo), _mm_mul_epi32(dy_lo, dy_lo));
+    __m128i dist_hi = _mm_add_epi64(_mm_mul_epi32(dx_hi, dx_hi), _mm_mul_epi32(dy_hi, dy_hi));
+
+    __m128i threshold = _mm_set1_epi64x(threshold_of(best, found, k));
+    int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(threshold, dist_lo)))
+             | (_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(threshold, dist_hi))) << 2);
+    if (mask)
+    {
+      alignas(16) long long int dists[4];
+      _mm_store_si128(reinterpret_cast<__m128i *>(dists), dist_lo);
+      _mm_store_si128(reinterpret_cast<__m128i *>(dists + 2), dist_hi);
+      insert_lanes(dists, 4, mask, i, best, found, k);
+    }
+  }
+  scan_scalar(xs, ys, i, n, qx, qy, best, found, k);
+  return found;
+}
+
+__attribute__((target("avx2")))
+std::size_t nearest_avx2(int const *xs, int const *ys, std::size_t n, int qx, int qy, NearestResult *best, std::size_t k)
+{
+  std::size_t found = 0;
+  if (k == 0)
+  {
+    return 0;
+  }
+
+  __m256i const vqx = _mm256_set1_epi32(qx);
+  __m256i const vqy = _mm256_set1_epi32(qy);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256i dx = _mm256_sub_epi32(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(xs + i)), vqx);
+    __m256i dy = _mm256_sub_epi32(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(ys + i)), vqy);
+
+    __m256i dx_lo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(dx));
+    __m256i dy_lo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(dy));
+    __m256i dx_hi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(dx, 1));
+    __m256i dy_hi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(dy, 1));
+    __m256i dist_lo = _mm256_add_epi64(_mm256_mul_epi32(dx_lo, dx_lo), _mm256_mul_epi32(dy_lo, dy_lo));
+    __m256i dist_hi = _mm256_add_epi64(_mm256_mul_epi32(dx_hi, dx_hi), _mm256_mul_epi32(dy_hi, dy_hi));
+
+    __m256i threshold = _mm256_set1_epi64x(threshold_of(best, found, k));
+    int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(threshold, dist_lo)))
+             | (_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(threshold, dist_hi))) << 4);
+    if (mask)
+    {
+      alignas(32) long long int dists[8];
+      _mm256_store_si256(reinterpret_cast<__m256i *>(dists), dist_lo);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(dists + 4), dist_hi);
+      insert_lanes(dists, 8, mask, i, best, found, k);
+    }
+  }
+  scan_scalar(xs, ys, i, n, qx, qy, best, found, k);
+  return found;
+}
+
+#endif // NEAREST_X86_KERNELS
+
+std::vector<NearestKernelInfo> detect_kernels()
+{
+  std::vector<NearestKernelInfo> kernels = {{"scalar", &nearest_scalar, false}};
+#ifdef NEAREST_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2"))
+  {
+    kernels.push_back({"sse4.2", &nearest_sse42, true});
+  }
+  if (__builtin_cpu_supports("avx2"))
+  {
+    kernels.push_back({"avx2", &nearest_avx2, true});
+  }
+#endif
+  return kernels;
+}
+
+} // namespace
+
+std::size_t nearest_scalar(int const *xs, int const *ys, std::size_t n, int qx, int qy, NearestResult *best, std::size_t k)
+{
+  std::size_t found = 0;
+  if (k > 0)
+  {
+    scan_scalar(xs, ys, 0, n, qx, qy, best, found, k);
+  }
+  return found;
+}
+
+std::vector<NearestKernelInfo> const &nearest_kernels()
+{
+  static std::vector<NearestKernelInfo> const kernels = detect_kernels();
+  return kernels;
+}
+
+NearestKernelInfo const &nearest_best_kernel()
+{
+  return nearest_kernels().back();
+}
@@ -0,0 +1,53 @@
+// Nearest.hh
+//
+// Brute-force k-nearest-neighbour kernels over packed coordinate arrays
+// (x and y in separate arrays). A scalar kernel is always available; on x86
+// SSE4.2 and AVX2 variants are compiled in as well and the fastest one the
+// CPU supports is selected at runtime.
+
+#ifndef NEAREST_HH
+#define NEAREST_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The SIMD kernels compute differences in 32 bits, so they require every
+// coordinate (including the query point) to lie in [-2^30, 2^30)
+int const NEAREST_SIMD_MIN_COORD = -(1 << 30);
+int const NEAREST_SIMD_MAX_COORD = (1 << 30) - 1;
+
+inline bool nearest_simd_coord_ok(int x, int y)
+{
+  return x >= NEAREST_SIMD_MIN_COORD && x <= NEAREST_SIMD_MAX_COORD
+      && y >= NEAREST_SIMD_MIN_COORD && y <= NEAREST_SIMD_MAX_COORD;
+}
+
+struct NearestResult
+{
+  long long int dist = 0; // Squared distance
+  std::uint32_t index = 0;
+};
+
+// Finds the k points nearest to (qx, qy) among xs[0..n), ys[0..n). The results are
+// written to best[0..k) sorted by distance (ties: smaller index first), and the
+// number of results found (min(n, k)) is returned.
+using NearestKernel = std::size_t (*)(int const *xs, int const *ys, std::size_t n,
+                                      int qx, int qy, NearestResult *best, std::size_t k);
+
+struct NearestKernelInfo
+{
+  char const *name;
+  NearestKernel kernel;
+  bool needs_simd_range; // Whether the kernel requires nearest_simd_coord_ok coordinates
+};
+
+std::size_t nearest_scalar(int const *xs, int const *ys, std::size_t n, int qx, int qy, NearestResult *best, std::size_t k);
+
+// All kernels usable on this CPU, scalar first and the preferred one last
+std::vector<NearestKernelInfo> const &nearest_kernels();
+
+// The fastest kernel usable on this CPU
+NearestKernelInfo const &nearest_best_kernel();
+
+#endif // NEAREST_HH
@@ -0,0 +1,249 @@
+// Pathsearch.hh
+//
+// Path searches over an affiliation graph. The graph is given as a type with
+//
+//   std::size_t node_count() const;
+//   Range incident_edges(std::uint32_t node) const; // iterable of edge indices
+//   std::uint32_t other_end(std::uint32_t edge, std::uint32_t node) const;
+//   Weight weight(std::uint32_t edge) const;
+//   Coord coord(std::uint32_t node) const;
+//   std::string_view id(std::uint32_t node) const;
+//
+// so that the in-memory state and a mapped snapshot are searched by the same
+// code and give the same paths. Nodes are handles 0..node_count()-1.
+
+#ifndef PATHSEARCH_HH
+#define PATHSEARCH_HH
+
+#include "datastructures.hh"
+
+#include <cmath>
+#include <climits>
+#include <cstdint>
+#include <deque>
+#include <queue>
+#include <vector>
+
+namespace pathsearch
+{
+
+using Node = std::uint32_t;
+Node const NO_NODE = std::numeric_limits<Node>::max();
+std::uint32_t const NO_EDGE_USED = std::numeric_limits<std::uint32_t>::max();
+
+// How a node was reached: the previous node and the edge from it
+struct Step
+{
+  Node previous = NO_NODE;
+  std::uint32_t edge = NO_EDGE_USED;
+};
+
+template <typename Graph>
+Connection step_connection(Graph const &graph, Node node, Step step)
+{
+  return {AffiliationID(graph.id(step.previous)), AffiliationID(graph.id(node)), graph.weight(step.edge)};
+}
+
+// Nodes from source to target following the steps backwards from target
+inline std::deque<Node> steps_to(std::vector<Step> const &steps, Node target)
+{
+  std::deque<Node> nodes;
+  for (Node node = target; node != NO_NODE; node = steps[node].previous)
+  {
+    nodes.push_front(node);
+  }
+  return nodes;
+}
+
+// Depth first search, neighbours in incident edge order
+template <typename Graph>
+Path any_path(Graph const &graph, Node source, Node target)
+{
+  if (source == target)
+  {
+    return {};
+  }
+
+  std::vector<bool> on_path(graph.node_count(), false);
+  // The path so far, and for each node on it the edge that led there and how far its edges are scanned
+  struct Frame
+  {
+    Node node;
+    std::uint32_t edge;
+    std::size_t next_edge;
+  };
+  std::vector<Frame> stack{{source, NO_EDGE_USED, 0}};
+  on_path[source] = true;
+  while (!stack.empty() && stack.back().node != target)
+  {
+    Frame &top = stack.back();
+    auto incident = graph.incident_edges(top.node);
+    if (top.next_edge == std::size_t(incident.end() - incident.begin()))
+    {
+      // A dead end stays marked so that it is not explored again
+      stack.pop_back();
+      continue;
+    }
+    std::uint32_t edge = incident.begin()[top.next_edge++];
+    Node next = graph.other_end(edge, top.node);
+    if (!on_path[next])
+    {
+      on_path[next] = true;
+      stack.push_back({next, edge, 0});
+    }
+  }
+
+  Path path;
+  for (std::size_t i = 1; i < stack.size(); ++i)
+  {
+    path.push_back(step_connection(graph, stack[i].node, {stack[i - 1].node, stack[i].edge}));
+  }
+  return path;
+}
+
+// Breadth first search, stopping as soon as target is reached
+template <typename Graph>
+Path path_with_least_nodes(Graph const &graph, Node source, Node target)
+{
+  std::vector<Step> steps(graph.node_count());
+  std::vector<bool> reached(graph.node_count(), false);
+  std::queue<Node> queue;
+
+  reached[source] = true;
+  queue.push(source);
+  while (!queue.empty() && !reached[target])
+  {
+    Node queue_front = queue.front();
+    queue.pop();
+    for (std::uint32_t edge : graph.incident_edges(queue_front))
+    {
+      Node next = graph.other_end(edge, queue_front);
+      if (!reached[next])
+      {
+        queue.push(next);
+        reached[next] = true;
+        steps[next] = {queue_front, edge};
+      }
+    }
+  }
+  if (!reached[target] || source == target)
+  {
+    return {};
+  }
+
+  std::deque<Node> nodes = steps_to(steps, target);
+  Path path;
+  path.reserve(nodes.size() - 1);
+  for (auto it = nodes.begin() + 1; it != nodes.end(); ++it)
+  {
+    path.push_back(step_connection(graph, *it, steps[*it]));
+  }
+  return path;
+}
+
+// Breadth first search keeping, for each node, the step with the largest smallest weight seen.
+// Nodes are not revisited when a better step is found.
+template <typename Graph>
+Path path_of_least_friction(Graph const &graph, Node source, Node target)
+{
+  std::vector<Step> steps(graph.node_count());
+  std::vector<Weight> min_weights(graph.node_count(), 0);
+  std::vector<bool> reached(graph.node_count(), false);
+  std::queue<Node> queue;
+
+  queue.push(source);
+  reached[source] = true;
+  min_weights[source] = INT_MAX;
+  while (!queue.empty())
+  {
+    Node queue_front = queue.front();
+    queue.pop();
+    Weight weight_from_origin = min_weights[queue_front];
+    for (std::uint32_t edge : graph.incident_edges(queue_front))
+    {
+      Node next = graph.other_end(edge, queue_front);
+      Weight min_weight = weight_from_origin > graph.weight(edge) ? graph.weight(edge) : weight_from_origin;
+      if (!reached[next])
+      {
+        queue.push(next);
+        reached[next] = true;
+        steps[next] = {queue_front, edge};
+        min_weights[next] = min_weight;
+      }
+      else if (min_weights[next] < min_weight)
+      {
+        steps[next] = {queue_front, edge};
+        min_weights[next] = min_weight;
+      }
+    }
+  }
+  if (!reached[target])
+  {
+    return {};
+  }
+
+  std::deque<Node> nodes = steps_to(steps, target);
+  Path path;
+  for (auto it = nodes.begin() + 1; it != nodes.end(); ++it)
+  {
+    path.push_back(step_connection(graph, *it, steps[*it]));
+  }
+  return path;
+}
+
+// Breadth first search keeping, for each node, the step with the shortest distance seen.
+// Nodes are not revisited when a shorter step is found.
+template <typename Graph>
+PathWithDist shortest_path(Graph const &graph, Node source, Node target)
+{
+  std::vector<Step> steps(graph.node_count());
+  std::vector<Distance> distances(graph.node_count(), 0);
+  std::vector<bool> reached(graph.node_count(), false);
+  std::queue<Node> queue;
+
+  queue.push(source);
+  reached[source] = true;
+  while (!queue.empty())
+  {
+    Node queue_front = queue.front();
+    queue.pop();
+    Distance dist_from_origin = distances[queue_front];
+    Coord start = graph.coord(queue_front);
+    for (std::uint32_t edge : graph.incident_edges(queue_front))
+    {
+      Node next = graph.other_end(edge, queue_front);
+      Coord end = graph.coord(next);
+      long long int dist_x = static_cast<long long int>(start.x) - end.x;
+      long long int dist_y = static_cast<long long int>(start.y) - end.y;
+      Distance distance = dist_from_origin + static_cast<Distance>(std::floor(std::sqrt(dist_x * dist_x + dist_y * dist_y)));
+      if (!reached[next])
+      {
+        queue.push(next);
+        reached[next] = true;
+        steps[next] = {queue_front, edge};
+        distances[next] = distance;
+      }
+      else if (distances[next] > distance)
+      {
+        steps[next] = {queue_front, edge};
+        distances[next] = distance;
+      }
+    }
+  }
+  if (!reached[target])
+  {
+    return {};
+  }
+
+  std::deque<Node> nodes = steps_to(steps, target);
+  PathWithDist path;
+  for (auto it = nodes.begin() + 1; it != nodes.end(); ++it)
+  {
+    path.push_back({step_connection(graph, *it, steps[*it]), distances[*it] - distances[*(it - 1)]});
+  }
+  return path;
+}
+
+} // namespace pathsearch
+
+#endif // PATHSEARCH_HH
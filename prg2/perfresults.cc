@@ -0,0 +1,240 @@
+// Perfresults.cc
+
+#include "perfresults.hh"
+#include "delimitedreader.hh"
+
+#include <charconv>
+#include <iomanip>
+#include <istream>
+#include <iterator>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string_view>
+#include <utility>
+
+char const *const PERF_PHASE_ADD = "(add)";
+char const *const PERF_PHASE_CMDS = "(cmds)";
+char const *const PERF_PHASE_TOTAL = "(total)";
+
+namespace
+{
+
+char const *const CSV_HEADER = "N,command,count,mean_us,p50_us,p99_us,p99.9_us,max_us";
+int const PRECISION = 9;
+
+template <typename Number>
+bool parse_number(std::string_view text, Number &value)
+{
+  auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+  return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+// Sets the record field named key from its text, returns false for unknown keys or bad values
+bool set_field(PerfRecord &record, std::string_view key, std::string_view value)
+{
+  if (key == "N" || key == "n") { return parse_number(value, record.n); }
+  if (key == "command") { record.command = std::string(value); return !value.empty(); }
+  if (key == "count") { return parse_number(value, record.count); }
+  if (key == "mean_us") { return parse_number(value, record.mean_us); }
+  if (key == "p50_us") { return parse_number(value, record.p50_us); }
+  if (key == "p99_us") { return parse_number(value, record.p99_us); }
+  if (key == "p99.9_us") { return parse_number(value, record.p999_us); }
+  if (key == "max_us") { return parse_number(value, record.max_us); }
+  return false;
+}
+
+// Just enough JSON to read back what write_perf_results_json writes: an object whose
+// "results" is an array of flat objects with string and number values
+class JsonScanner
+{
+public:
+  explicit JsonScanner(std::string_view text) : text_(text) {}
+
+  bool parse(std::vector<PerfRecord> &records)
+  {
+    if (!take('{')) { return false; }
+    if (take('}')) { return true; }
+    do
+    {
+      std::string_view key;
+      if (!string(key) || !take(':')) { return false; }
+      if (key != "results" || !results(records)) { return false; }
+    } while (take(','));
+    return take('}') && (skip_space(), pos_ == text_.size());
+  }
+
+private:
+  bool results(std::vector<PerfRecord> &records)
+  {
+    if (!take('[')) { return false; }
+    if (take(']')) { return true; }
+    do
+    {
+      PerfRecord record;
+      if (!object(record)) { return false; }
+      records.push_back(std::move(record));
+    } while (take(','));
+    return take(']');
+  }
+
+  bool object(PerfRecord &record)
+  {
+    if (!take('{')) { return false; }
+    if (take('}')) { return true; }
+    do
+    {
+      std::string_view key, value;
+      if (!string(key) || !take(':')) { return false; }
+      skip_space();
+      if (pos_ < text_.size() && text_[pos_] == '"' ? !string(value) : !number(value)) { return false; }
+      if (!set_field(record, key, value)) { return false; }
+    } while (take(','));
+    return take('}');
+  }
+
+  // Strings written by us contain no escapes
+  bool string(std::string_view &value)
+  {
+    if (!take('"')) { return false; }
+    std::size_t end = text_.find('"', pos_);
+    if (end == std::string_view::npos) { return false; }
+    value = text_.substr(pos_, end - pos_);
+    pos_ = end + 1;
+    return value.find('\\') == std::string_view::npos;
+  }
+
+  bool number(std::string_view &value)
+  {
+    std::size_t start = pos_;
+    while (pos_ < text_.size() && std::string_view("+-.0123456789eE").find(text_[pos_]) != std::string_view::npos)
+    {
+      ++pos_;
+    }
+    value = text_.substr(start, pos_ - start);
+    return !value.empty();
+  }
+
+  bool take(char c)
+  {
+    skip_space();
+    if (pos_ < text_.size() && text_[pos_] == c)
+    {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+
+  void skip_space()
+  {
+    while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r'))
+    {
+      ++pos_;
+    }
+  }
+
+  std::string_view text_;
+  std::size_t pos_ = 0;
+};
+
+} // namespace
+
+bool perf_results_json_file(const std::string &filename)
+{
+  std::string_view const extension = ".json";
+  return filename.size() >= extension.size() && filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+void write_perf_results_csv(std::ostream &output, const std::vector<PerfRecord> &records)
+{
+  output << CSV_HEADER << '\n' << std::setprecision(PRECISION);
+  for (const PerfRecord &record : records)
+  {
+    output << record.n << ',' << record.command << ',' << record.count << ',' << record.mean_us << ','
+           << record.p50_us << ',' << record.p99_us << ',' << record.p999_us << ',' << record.max_us << '\n';
+  }
+}
+
+void write_perf_results_json(std::ostream &output, const std::vector<PerfRecord> &records)
+{
+  output << "{\n  \"results\": [" << std::setprecision(PRECISION);
+  char const *separator = "\n";
+  for (const PerfRecord &record : records)
+  {
+    output << separator << "    {\"n\": " << record.n << ", \"command\": \"" << record.command << "\", \"count\": " << record.count
+           << ", \"mean_us\": " << record.mean_us << ", \"p50_us\": " << record.p50_us << ", \"p99_us\": " << record.p99_us
+           << ", \"p99.9_us\": " << record.p999_us << ", \"max_us\": " << record.max_us << "}";
+    separator = ",\n";
+  }
+  output << "\n  ]\n}\n";
+}
+
+bool read_perf_results(std::istream &input, std::vector<PerfRecord> &records)
+{
+  std::string text((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+  std::size_t first = text.find_first_not_of(" \t\r\n");
+  if (first != std::string::npos && text[first] == '{')
+  {
+    return JsonScanner(text).parse(records);
+  }
+
+  std::istringstream lines(text);
+  DelimitedReader reader(lines, ',');
+  std::vector<std::string_view> fields;
+  std::vector<std::string> header;
+  while (reader.next_row(fields))
+  {
+    if (header.empty())
+    {
+      header.assign(fields.begin(), fields.end());
+      continue;
+    }
+    if (fields.size() != header.size())
+    {
+      return false;
+    }
+    PerfRecord record;
+    for (std::size_t i = 0; i < fields.size(); ++i)
+    {
+      if (!set_field(record, header[i], fields[i]))
+      {
+        return false;
+      }
+    }
+    records.push_back(std::move(record));
+  }
+  return !header.empty();
+}
+
+std::vector<PerfRegression> find_perf_regressions(const std::vector<PerfRecord> &baseline,
+                                                  const std::vector<PerfRecord> &current,
+                                                  double max_slowdown_percent)
+{
+  std::map<std::pair<unsigned int, std::string_view>, PerfRecord const *> baseline_of;
+  for (const PerfRecord &record : baseline)
+  {
+    baseline_of[{record.n, record.command}] = &record;
+  }
+
+  double const limit = 1.0 + max_slowdown_percent / 100.0;
+  std::vector<PerfRegression> regressions;
+  for (const PerfRecord &record : current)
+  {
+    auto it = baseline_of.find({record.n, record.command});
+    if (it == baseline_of.end())
+    {
+      continue;
+    }
+    PerfRecord const &base = *it->second;
+    if (record.mean_us > base.mean_us * limit)
+    {
+      regressions.push_back({record.n, record.command, "mean", base.mean_us, record.mean_us});
+    }
+    else if (record.count > 1 && base.count > 1 && record.p99_us > base.p99_us * limit)
+    {
+      regressions.push_back({record.n, record.command, "p99", base.p99_us, record.p99_us});
+    }
+  }
+  return regressions;
+}
@@ -0,0 +1,61 @@
+// Perfresults.hh
+//
+// Results of a perftest run in machine-readable form. Each record is the
+// timing of one command (or phase) for one N. Records are saved as CSV, or as
+// JSON when the file name ends in .json, and a saved run can be read back to
+// compare a new run against it.
+//
+// The phases of perftest (adding the data, running the commands, and both)
+// are recorded as a single invocation each, under the names PERF_PHASE_*.
+
+#ifndef PERFRESULTS_HH
+#define PERFRESULTS_HH
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+extern char const *const PERF_PHASE_ADD;
+extern char const *const PERF_PHASE_CMDS;
+extern char const *const PERF_PHASE_TOTAL;
+
+struct PerfRecord
+{
+  unsigned int n = 0;
+  std::string command;
+  std::uint64_t count = 0;
+  double mean_us = 0;
+  double p50_us = 0;
+  double p99_us = 0;
+  double p999_us = 0;
+  double max_us = 0;
+};
+
+// A record that got slower than its baseline by more than the allowed slowdown
+struct PerfRegression
+{
+  unsigned int n = 0;
+  std::string command;
+  std::string metric; // "mean" or "p99"
+  double baseline_us = 0;
+  double current_us = 0;
+};
+
+bool perf_results_json_file(std::string const &filename);
+
+void write_perf_results_csv(std::ostream &output, std::vector<PerfRecord> const &records);
+void write_perf_results_json(std::ostream &output, std::vector<PerfRecord> const &records);
+
+// Reads records written by either of the above (the format is detected from the
+// contents). Returns false if the input is not such a file.
+bool read_perf_results(std::istream &input, std::vector<PerfRecord> &records);
+
+// Records of current that have a baseline record with the same N and command, and whose
+// mean (or for commands run more than once, p99) exceeds the baseline's by more than
+// max_slowdown_percent
+std::vector<PerfRegression> find_perf_regressions(std::vector<PerfRecord> const &baseline,
+                                                  std::vector<PerfRecord> const &current,
+                                                  double max_slowdown_percent);
+
+#endif // PERFRESULTS_HH
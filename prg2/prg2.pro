@@ -17,9 +17,15 @@
 # "Rebuild all" from the Build menu
 #  QMAKE_CXXFLAGS += -DUSE_PERF_EVENT
 
+# Uncomment the line below to count heap allocations (shown with the stopwatch and by perftest)
+# NOTE: This replaces the global operator new and delete, which makes every allocation a bit
+# slower. If you uncomment or recomment the line, remember to recompile EVERYTHING by selecting
+# "Rebuild all" from the Build menu
+#  QMAKE_CXXFLAGS += -DUSE_ALLOC_COUNT
+
 QT       += core gui
 
-CONFIG += c++17 warn_on
+CONFIG += c++17 warn_on thread
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -41,12 +47,32 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += \
     datastructures.cc \
     mainwindow.cc \
-    mainprogram.cc
+    mainprogram.cc \
+    nearest.cc \
+    snapshot.cc \
+    mappedsnapshot.cc \
+    delimitedreader.cc \
+    latencyhistogram.cc \
+    perfresults.cc \
+    complexityfit.cc \
+    allocationcounter.cc \
+    commandstats.cc
 
 HEADERS += \
     datastructures.hh \
     mainwindow.hh \
-    mainprogram.hh
+    mainprogram.hh \
+    nearest.hh \
+    slotmap.hh \
+    snapshot.hh \
+    mappedsnapshot.hh \
+    pathsearch.hh \
+    delimitedreader.hh \
+    latencyhistogram.hh \
+    perfresults.hh \
+    complexityfit.hh \
+    allocationcounter.hh \
+    commandstats.hh
 
 exists(worldmap/worldmap.hh) {
     HEADERS += worldmap/worldmap.hh
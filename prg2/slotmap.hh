@@ -0,0 +1,141 @@
+// Slotmap.hh
+//
+// A slot map keeps its values contiguously in one vector. Removed slots are
+// recycled through a free list, and every slot carries a generation counter so
+// that a handle to a removed value is detected instead of silently aliasing
+// whatever was stored in the slot afterwards.
+//
+// All storage comes from the memory resource given on construction, and T must be
+// allocator-aware (constructible from a std::pmr::polymorphic_allocator) so that
+// the values allocate from the same resource.
+
+#ifndef SLOTMAP_HH
+#define SLOTMAP_HH
+
+#include <vector>
+#include <memory_resource>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+using SlotIndex = std::uint32_t;
+SlotIndex const NO_SLOT = std::numeric_limits<SlotIndex>::max();
+
+struct SlotHandle
+{
+  SlotIndex slot = NO_SLOT;
+  std::uint32_t generation = 0;
+};
+
+template <typename T>
+class SlotMap
+{
+public:
+  explicit SlotMap(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+    : values_(resource), generations_(resource), free_slots_(resource) {}
+
+  // Stores value in a free slot (or a new one) and returns a handle to it
+  SlotHandle insert(T value);
+
+  // Releases the slot of handle, returns false if handle was stale
+  bool erase(SlotHandle handle);
+
+  // Returns the value of handle, or nullptr if handle is stale
+  T *get(SlotHandle handle);
+  T const *get(SlotHandle handle) const;
+
+  // Unchecked access by slot index, for links that are kept valid by the owner
+  T &operator[](SlotIndex slot) { return values_[slot]; }
+  T const &operator[](SlotIndex slot) const { return values_[slot]; }
+
+  bool is_live(SlotIndex slot) const { return generations_[slot] & 1u; }
+  SlotHandle handle_of(SlotIndex slot) const { return {slot, generations_[slot]}; }
+
+  // Number of slots (live or free), i.e. the bound for iterating by slot index
+  SlotIndex slot_count() const { return static_cast<SlotIndex>(values_.size()); }
+  std::size_t size() const { return size_; }
+  // Bytes of the slot arrays, not counting what the values own
+  std::size_t memory_bytes() const
+  {
+    return values_.capacity() * sizeof(T) + generations_.capacity() * sizeof(std::uint32_t) +
+           free_slots_.capacity() * sizeof(SlotIndex);
+  }
+
+  void reserve(std::size_t n);
+  void clear();
+
+private:
+  std::pmr::vector<T> values_;
+  std::pmr::vector<std::uint32_t> generations_; // Odd generation = slot is live
+  std::pmr::vector<SlotIndex> free_slots_;
+  std::size_t size_ = 0;
+};
+
+template <typename T>
+SlotHandle SlotMap<T>::insert(T value)
+{
+  SlotIndex slot;
+  if (!free_slots_.empty())
+  {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+    values_[slot] = std::move(value);
+    ++generations_[slot];
+  }
+  else
+  {
+    slot = static_cast<SlotIndex>(values_.size());
+    values_.push_back(std::move(value));
+    generations_.push_back(1);
+  }
+  ++size_;
+  return {slot, generations_[slot]};
+}
+
+template <typename T>
+bool SlotMap<T>::erase(SlotHandle handle)
+{
+  if (get(handle) == nullptr)
+  {
+    return false;
+  }
+  values_[handle.slot] = T(values_.get_allocator()); // Release whatever the value owns right away
+  ++generations_[handle.slot];
+  free_slots_.push_back(handle.slot);
+  --size_;
+  return true;
+}
+
+template <typename T>
+T *SlotMap<T>::get(SlotHandle handle)
+{
+  return const_cast<T *>(static_cast<SlotMap const &>(*this).get(handle));
+}
+
+template <typename T>
+T const *SlotMap<T>::get(SlotHandle handle) const
+{
+  if (handle.slot >= values_.size() || generations_[handle.slot] != handle.generation || !is_live(handle.slot))
+  {
+    return nullptr;
+  }
+  return &values_[handle.slot];
+}
+
+template <typename T>
+void SlotMap<T>::reserve(std::size_t n)
+{
+  values_.reserve(n);
+  generations_.reserve(n);
+}
+
+template <typename T>
+void SlotMap<T>::clear()
+{
+  values_.clear();
+  generations_.clear();
+  free_slots_.clear();
+  size_ = 0;
+}
+
+#endif // SLOTMAP_HH
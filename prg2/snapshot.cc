@@ -0,0 +1,374 @@
+// Snapshot.cc
+
+#include "snapshot.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace
+{
+
+std::uint64_t const SNAPSHOT_ALIGNMENT = 8;
+
+std::uint64_t aligned(std::uint64_t position)
+{
+  return (position + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+} // namespace
+
+SnapshotWriter::SnapshotWriter(std::ostream &output)
+  : output_(output), header_{}, position_(aligned(sizeof(SnapshotHeader)))
+{
+  // Room for the header, which is filled in by finish
+  char const zeros[SNAPSHOT_ALIGNMENT] = {};
+  for (std::uint64_t i = 0; i < position_; i += SNAPSHOT_ALIGNMENT)
+  {
+    output_.write(zeros, SNAPSHOT_ALIGNMENT);
+  }
+}
+
+void SnapshotWriter::write_section(SnapshotSection section, void const *data, std::size_t bytes)
+{
+  header_.section_offset[section] = position_;
+  header_.section_size[section] = bytes;
+  if (bytes > 0)
+  {
+    output_.write(static_cast<char const *>(data), static_cast<std::streamsize>(bytes));
+  }
+  position_ += bytes;
+
+  char const zeros[SNAPSHOT_ALIGNMENT] = {};
+  std::uint64_t padding = aligned(position_) - position_;
+  output_.write(zeros, static_cast<std::streamsize>(padding));
+  position_ += padding;
+}
+
+bool SnapshotWriter::finish(std::uint32_t flags, std::uint64_t affiliation_count, std::uint64_t publication_count, std::uint64_t edge_count)
+{
+  std::memcpy(header_.magic, SNAPSHOT_MAGIC, sizeof(header_.magic));
+  header_.version = SNAPSHOT_VERSION;
+  header_.byte_order = SNAPSHOT_BYTE_ORDER;
+  header_.flags = flags;
+  header_.section_count = SNAPSHOT_SECTION_COUNT;
+  header_.affiliation_count = affiliation_count;
+  header_.publication_count = publication_count;
+  header_.edge_count = edge_count;
+
+  output_.seekp(0);
+  output_.write(reinterpret_cast<char const *>(&header_), sizeof(header_));
+  output_.flush();
+  return static_cast<bool>(output_);
+}
+
+SnapshotReader::SnapshotReader(char const *data, std::size_t size)
+  : data_(data), header_{}
+{
+  if (size < sizeof(SnapshotHeader))
+  {
+    return;
+  }
+  std::memcpy(&header_, data, sizeof(header_));
+  if (std::memcmp(header_.magic, SNAPSHOT_MAGIC, sizeof(header_.magic)) != 0
+      || header_.version != SNAPSHOT_VERSION || header_.byte_order != SNAPSHOT_BYTE_ORDER
+      || header_.section_count != SNAPSHOT_SECTION_COUNT)
+  {
+    return;
+  }
+  for (std::uint32_t section = 0; section < SNAPSHOT_SECTION_COUNT; ++section)
+  {
+    std::uint64_t offset = header_.section_offset[section];
+    std::uint64_t bytes = header_.section_size[section];
+    if (offset % SNAPSHOT_ALIGNMENT != 0 || offset > size || bytes > size - offset)
+    {
+      return;
+    }
+  }
+  valid_ = true;
+}
+
+bool snapshot_offsets_ok(std::uint64_t const *offsets, std::size_t count, std::uint64_t item_count)
+{
+  if (offsets == nullptr || count == 0 || offsets[0] != 0 || offsets[count - 1] != item_count)
+  {
+    return false;
+  }
+  for (std::size_t i = 1; i < count; ++i)
+  {
+    if (offsets[i] < offsets[i - 1])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+namespace
+{
+
+bool all_below(std::uint32_t const *values, std::size_t count, std::size_t limit)
+{
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    if (values[i] >= limit)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Every edge is listed exactly once at each of its two affiliations, and nowhere else
+bool incident_edges_ok(SnapshotView const &v)
+{
+  std::vector<std::uint8_t> seen(v.edge_count, 0); // Bit 1: listed at aff1, bit 2: at aff2
+  for (std::uint32_t aff = 0; aff < v.aff_count; ++aff)
+  {
+    for (std::uint64_t i = v.aff_edge_offsets[aff]; i < v.aff_edge_offsets[aff + 1]; ++i)
+    {
+      SnapshotEdge const &edge = v.edges[v.aff_edges[i]];
+      std::uint8_t end = edge.aff1 == aff ? 1 : edge.aff2 == aff ? 2 : 0;
+      if (end == 0 || (seen[v.aff_edges[i]] & end))
+      {
+        return false;
+      }
+      seen[v.aff_edges[i]] |= end;
+    }
+  }
+  for (std::uint8_t ends : seen)
+  {
+    if (ends != 3)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The parents form a forest (no cycles), and the children lists are exactly its inverse
+bool reference_forest_ok(SnapshotView const &v)
+{
+  // Colouring pass: 0 = not visited, 1 = on the chain being followed, 2 = leads to a root
+  std::vector<std::uint8_t> colour(v.pub_count, 0);
+  std::vector<std::uint32_t> chain;
+  for (std::uint32_t pub = 0; pub < v.pub_count; ++pub)
+  {
+    std::uint32_t next = pub;
+    while (next != SNAPSHOT_NONE && colour[next] == 0)
+    {
+      colour[next] = 1;
+      chain.push_back(next);
+      next = v.pub_parents[next];
+    }
+    if (next != SNAPSHOT_NONE && colour[next] == 1)
+    {
+      return false;
+    }
+    for (std::uint32_t done : chain) { colour[done] = 2; }
+    chain.clear();
+  }
+
+  std::uint64_t with_parent = 0;
+  std::vector<bool> listed(v.pub_count, false);
+  for (std::uint32_t pub = 0; pub < v.pub_count; ++pub)
+  {
+    if (v.pub_parents[pub] != SNAPSHOT_NONE) { ++with_parent; }
+    for (std::uint64_t i = v.pub_child_offsets[pub]; i < v.pub_child_offsets[pub + 1]; ++i)
+    {
+      std::uint32_t child = v.pub_children[i];
+      if (v.pub_parents[child] != pub || listed[child])
+      {
+        return false;
+      }
+      listed[child] = true;
+    }
+  }
+  return with_parent == v.pub_child_offsets[v.pub_count];
+}
+
+// The by-id orders are strictly increasing, as the lookups binary search them
+bool id_orders_ok(SnapshotView const &v)
+{
+  for (std::size_t i = 1; i < v.aff_count; ++i)
+  {
+    if (!(v.aff_id(v.aff_by_id[i - 1]) < v.aff_id(v.aff_by_id[i])))
+    {
+      return false;
+    }
+  }
+  for (std::size_t i = 1; i < v.pub_count; ++i)
+  {
+    if (!(v.pub_ids[v.pub_by_id[i - 1]] < v.pub_ids[v.pub_by_id[i]]))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Every publication listed at an affiliation exists and lists the affiliation
+// back, each listing at the affiliation matched by its own listing at the
+// publication. The converse does not hold for a live state: publications
+// added with an affiliation list are not listed at those affiliations, and
+// removing an affiliation leaves its id in such lists, so those ids may also
+// be unknown. Only the short per-publication lists are scanned, so apart from
+// the id lookups this is linear.
+bool affiliation_links_ok(SnapshotView const &v)
+{
+  std::uint64_t const link_count = v.pub_aff_offsets[v.pub_count];
+  std::vector<std::uint32_t> link_affs(link_count, SNAPSHOT_NONE);
+  for (std::uint64_t i = 0; i < link_count; ++i)
+  {
+    std::string_view id = v.pub_aff_id(i);
+    auto found = std::lower_bound(v.aff_by_id, v.aff_by_id + v.aff_count, id,
+                                  [&v](std::uint32_t aff, std::string_view key) { return v.aff_id(aff) < key; });
+    if (found != v.aff_by_id + v.aff_count && v.aff_id(*found) == id)
+    {
+      link_affs[i] = *found;
+    }
+  }
+
+  std::vector<bool> matched(link_count, false);
+  for (std::uint32_t aff = 0; aff < v.aff_count; ++aff)
+  {
+    for (std::uint64_t i = v.aff_pub_offsets[aff]; i < v.aff_pub_offsets[aff + 1]; ++i)
+    {
+      std::uint64_t id = v.aff_pubs[i];
+      auto found = std::lower_bound(v.pub_by_id, v.pub_by_id + v.pub_count, id,
+                                    [&v](std::uint32_t pub, std::uint64_t key) { return v.pub_ids[pub] < key; });
+      if (found == v.pub_by_id + v.pub_count || v.pub_ids[*found] != id)
+      {
+        return false;
+      }
+      // Adding an affiliation to a publication twice lists it twice on both sides
+      std::uint64_t link = v.pub_aff_offsets[*found];
+      while (link < v.pub_aff_offsets[*found + 1] && (link_affs[link] != aff || matched[link])) { ++link; }
+      if (link == v.pub_aff_offsets[*found + 1])
+      {
+        return false;
+      }
+      matched[link] = true;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+bool snapshot_view(SnapshotReader const &snapshot, SnapshotView &view, bool check_structure)
+{
+  if (!snapshot.valid())
+  {
+    return false;
+  }
+
+  SnapshotHeader const &header = snapshot.header();
+  // Handles and indices are 32-bit, with SNAPSHOT_NONE reserved
+  if (header.affiliation_count >= SNAPSHOT_NONE || header.publication_count >= SNAPSHOT_NONE || header.edge_count >= SNAPSHOT_NONE)
+  {
+    return false;
+  }
+  SnapshotView v;
+  v.aff_count = header.affiliation_count;
+  v.pub_count = header.publication_count;
+  v.edge_count = header.edge_count;
+
+  std::size_t aff_id_chars = snapshot.count(SNAPSHOT_AFF_ID_CHARS, 1);
+  std::size_t aff_name_chars = snapshot.count(SNAPSHOT_AFF_NAME_CHARS, 1);
+  std::size_t aff_pubs = snapshot.count(SNAPSHOT_AFF_PUBS, sizeof(std::uint64_t));
+  std::size_t aff_edges = snapshot.count(SNAPSHOT_AFF_EDGES, sizeof(std::uint32_t));
+  v.aff_x = snapshot.section<std::int32_t>(SNAPSHOT_AFF_X, v.aff_count);
+  v.aff_y = snapshot.section<std::int32_t>(SNAPSHOT_AFF_Y, v.aff_count);
+  v.aff_id_offsets = snapshot.section<std::uint64_t>(SNAPSHOT_AFF_ID_OFFSETS, v.aff_count + 1);
+  v.aff_id_chars = snapshot.section<char>(SNAPSHOT_AFF_ID_CHARS, aff_id_chars);
+  v.aff_name_offsets = snapshot.section<std::uint64_t>(SNAPSHOT_AFF_NAME_OFFSETS, v.aff_count + 1);
+  v.aff_name_chars = snapshot.section<char>(SNAPSHOT_AFF_NAME_CHARS, aff_name_chars);
+  v.aff_pub_offsets = snapshot.section<std::uint64_t>(SNAPSHOT_AFF_PUB_OFFSETS, v.aff_count + 1);
+  v.aff_pubs = snapshot.section<std::uint64_t>(SNAPSHOT_AFF_PUBS, aff_pubs);
+  v.aff_edge_offsets = snapshot.section<std::uint64_t>(SNAPSHOT_AFF_EDGE_OFFSETS, v.aff_count + 1);
+  v.aff_edges = snapshot.section<std::uint32_t>(SNAPSHOT_AFF_EDGES, aff_edges);
+  v.edges = snapshot.section<SnapshotEdge>(SNAPSHOT_EDGES, v.edge_count);
+  v.aff_by_name = snapshot.section<std::uint32_t>(SNAPSHOT_AFF_BY_NAME, v.aff_count);
+  v.aff_by_coord_count = snapshot.count(SNAPSHOT_AFF_BY_COORD, sizeof(std::uint32_t));
+  v.aff_by_coord = snapshot.section<std::uint32_t>(SNAPSHOT_AFF_BY_COORD, v.aff_by_coord_count);
+  v.aff_by_id = snapshot.section<std::uint32_t>(SNAPSHOT_AFF_BY_ID, v.aff_count);
+
+  std::size_t pub_name_chars = snapshot.count(SNAPSHOT_PUB_NAME_CHARS, 1);
+  std::size_t pub_aff_id_offsets = snapshot.count(SNAPSHOT_PUB_AFF_ID_OFFSETS, sizeof(std::uint64_t));
+  std::size_t pub_aff_id_chars = snapshot.count(SNAPSHOT_PUB_AFF_ID_CHARS, 1);
+  std::size_t pub_children = snapshot.count(SNAPSHOT_PUB_CHILDREN, sizeof(std::uint32_t));
+  v.pub_ids = snapshot.section<std::uint64_t>(SNAPSHOT_PUB_IDS, v.pub_count);
+  v.pub_years = snapshot.section<std::uint16_t>(SNAPSHOT_PUB_YEARS, v.pub_count);
+  v.pub_parents = snapshot.section<std::uint32_t>(SNAPSHOT_PUB_PARENTS, v.pub_count);
+  v.pub_name_offsets = snapshot.section<std::uint64_t>(SNAPSHOT_PUB_NAME_OFFSETS, v.pub_count + 1);
+  v.pub_name_chars = snapshot.section<char>(SNAPSHOT_PUB_NAME_CHARS, pub_name_chars);
+  v.pub_aff_offsets = snapshot.section<std::uint64_t>(SNAPSHOT_PUB_AFF_OFFSETS, v.pub_count + 1);
+  v.pub_aff_id_offsets = snapshot.section<std::uint64_t>(SNAPSHOT_PUB_AFF_ID_OFFSETS, pub_aff_id_offsets);
+  v.pub_aff_id_chars = snapshot.section<char>(SNAPSHOT_PUB_AFF_ID_CHARS, pub_aff_id_chars);
+  v.pub_child_offsets = snapshot.section<std::uint64_t>(SNAPSHOT_PUB_CHILD_OFFSETS, v.pub_count + 1);
+  v.pub_children = snapshot.section<std::uint32_t>(SNAPSHOT_PUB_CHILDREN, pub_children);
+  v.pub_by_id = snapshot.section<std::uint32_t>(SNAPSHOT_PUB_BY_ID, v.pub_count);
+
+  if (!v.aff_x || !v.aff_y || !v.aff_id_chars || !v.aff_name_chars || !v.aff_pubs || !v.aff_edges || !v.edges
+      || !v.aff_by_name || !v.aff_by_coord || !v.aff_by_id || !v.pub_ids || !v.pub_years || !v.pub_parents
+      || !v.pub_name_chars || !v.pub_aff_id_chars || !v.pub_children || !v.pub_by_id || pub_aff_id_offsets == 0
+      || !snapshot_offsets_ok(v.aff_id_offsets, v.aff_count + 1, aff_id_chars)
+      || !snapshot_offsets_ok(v.aff_name_offsets, v.aff_count + 1, aff_name_chars)
+      || !snapshot_offsets_ok(v.aff_pub_offsets, v.aff_count + 1, aff_pubs)
+      || !snapshot_offsets_ok(v.aff_edge_offsets, v.aff_count + 1, aff_edges)
+      || !snapshot_offsets_ok(v.pub_name_offsets, v.pub_count + 1, pub_name_chars)
+      || !snapshot_offsets_ok(v.pub_aff_offsets, v.pub_count + 1, pub_aff_id_offsets - 1)
+      || !snapshot_offsets_ok(v.pub_aff_id_offsets, pub_aff_id_offsets, pub_aff_id_chars)
+      || !snapshot_offsets_ok(v.pub_child_offsets, v.pub_count + 1, pub_children))
+  {
+    return false;
+  }
+
+  for (std::size_t edge = 0; edge < v.edge_count; ++edge)
+  {
+    if (v.edges[edge].aff1 >= v.aff_count || v.edges[edge].aff2 >= v.aff_count || v.edges[edge].aff1 == v.edges[edge].aff2)
+    {
+      return false;
+    }
+  }
+  for (std::size_t pub = 0; pub < v.pub_count; ++pub)
+  {
+    if (v.pub_parents[pub] != SNAPSHOT_NONE && v.pub_parents[pub] >= v.pub_count)
+    {
+      return false;
+    }
+  }
+  if (!all_below(v.aff_edges, aff_edges, v.edge_count) || !all_below(v.aff_by_name, v.aff_count, v.aff_count)
+      || !all_below(v.aff_by_coord, v.aff_by_coord_count, v.aff_count) || !all_below(v.aff_by_id, v.aff_count, v.aff_count)
+      || !all_below(v.pub_children, pub_children, v.pub_count) || !all_below(v.pub_by_id, v.pub_count, v.pub_count))
+  {
+    return false;
+  }
+  if (check_structure && (!incident_edges_ok(v) || !reference_forest_ok(v) || !id_orders_ok(v)
+                          || !affiliation_links_ok(v)))
+  {
+    return false;
+  }
+
+  if (header.flags & SNAPSHOT_HAS_YEAR_INDEX)
+  {
+    std::size_t const year_limit = std::size_t(std::numeric_limits<std::uint16_t>::max()) + 1;
+    std::size_t year_offsets = snapshot.count(SNAPSHOT_YEAR_OFFSETS, sizeof(std::uint64_t));
+    v.year_offsets = snapshot.section<std::uint64_t>(SNAPSHOT_YEAR_OFFSETS, year_offsets);
+    v.year_pubs = snapshot.section<std::uint64_t>(SNAPSHOT_YEAR_PUBS, v.pub_count);
+    v.year_tree_size = snapshot.count(SNAPSHOT_YEAR_TREE, sizeof(std::uint32_t));
+    v.year_tree = snapshot.section<std::uint32_t>(SNAPSHOT_YEAR_TREE, v.year_tree_size);
+    if (year_offsets == 0 || year_offsets - 1 > year_limit || !v.year_pubs || !v.year_tree
+        || !snapshot_offsets_ok(v.year_offsets, year_offsets, v.pub_count)
+        || ((v.year_tree_size != 0 || year_offsets != 1) && (v.year_tree_size < year_offsets || v.year_tree_size > year_limit + 1)))
+    {
+      return false;
+    }
+    v.year_count = year_offsets - 1;
+  }
+
+  view = v;
+  return true;
+}
@@ -0,0 +1,219 @@
+// Snapshot.hh
+//
+// Binary snapshot format of the Datastructures state. A snapshot is a header
+// followed by sections, each a flat array of fixed-size elements starting at an
+// 8-byte aligned offset. Variable-length data (strings, per-affiliation lists)
+// is stored CSR style: an offsets array with one entry more than there are
+// items, and one array holding the concatenated items. This lets a loader copy
+// whole arrays at once, and a reader use a mapped file in place.
+//
+// All integers are stored in the byte order of the machine that wrote the
+// snapshot; the header records it so that a foreign snapshot is rejected.
+// Loading checks that sizes, offsets and indices are in range, and that the
+// structure is consistent: the incident edge lists match the edges, the
+// references form a forest whose children lists are its inverse, the
+// by-id orders are sorted, and every publication listed at an affiliation
+// exists and lists the affiliation back.
+
+#ifndef SNAPSHOT_HH
+#define SNAPSHOT_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+char const SNAPSHOT_MAGIC[8] = {'P', 'R', 'G', '2', 'S', 'N', 'A', 'P'};
+std::uint32_t const SNAPSHOT_VERSION = 1;
+std::uint32_t const SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+// Header flags
+std::uint32_t const SNAPSHOT_HAS_YEAR_INDEX = 1;
+
+enum SnapshotSection : std::uint32_t
+{
+  // Affiliations, by handle
+  SNAPSHOT_AFF_X,            // int32[a]
+  SNAPSHOT_AFF_Y,            // int32[a]
+  SNAPSHOT_AFF_ID_OFFSETS,   // uint64[a + 1] into SNAPSHOT_AFF_ID_CHARS
+  SNAPSHOT_AFF_ID_CHARS,     // char[]
+  SNAPSHOT_AFF_NAME_OFFSETS, // uint64[a + 1] into SNAPSHOT_AFF_NAME_CHARS
+  SNAPSHOT_AFF_NAME_CHARS,   // char[]
+  SNAPSHOT_AFF_PUB_OFFSETS,  // uint64[a + 1] into SNAPSHOT_AFF_PUBS
+  SNAPSHOT_AFF_PUBS,         // uint64[] publication ids
+  SNAPSHOT_AFF_EDGE_OFFSETS, // uint64[a + 1] into SNAPSHOT_AFF_EDGES
+  SNAPSHOT_AFF_EDGES,        // uint32[] indices to SNAPSHOT_EDGES
+  SNAPSHOT_EDGES,            // SnapshotEdge[e]
+  SNAPSHOT_AFF_BY_NAME,      // uint32[a] handles in alphabetical order (ties by id)
+  SNAPSHOT_AFF_BY_COORD,     // uint32[] handles in coordinate order
+  SNAPSHOT_AFF_BY_ID,        // uint32[a] handles in id order
+
+  // Publications, by snapshot index (live slots in slot order)
+  SNAPSHOT_PUB_IDS,              // uint64[p]
+  SNAPSHOT_PUB_YEARS,            // uint16[p]
+  SNAPSHOT_PUB_PARENTS,          // uint32[p] snapshot index of the parent or SNAPSHOT_NONE
+  SNAPSHOT_PUB_NAME_OFFSETS,     // uint64[p + 1] into SNAPSHOT_PUB_NAME_CHARS
+  SNAPSHOT_PUB_NAME_CHARS,       // char[]
+  SNAPSHOT_PUB_AFF_OFFSETS,      // uint64[p + 1] into SNAPSHOT_PUB_AFF_ID_OFFSETS
+  SNAPSHOT_PUB_AFF_ID_OFFSETS,   // uint64[] into SNAPSHOT_PUB_AFF_ID_CHARS, one more than the ids
+  SNAPSHOT_PUB_AFF_ID_CHARS,     // char[]
+  SNAPSHOT_PUB_CHILD_OFFSETS,    // uint64[p + 1] into SNAPSHOT_PUB_CHILDREN
+  SNAPSHOT_PUB_CHILDREN,         // uint32[] snapshot indices
+  SNAPSHOT_PUB_BY_ID,            // uint32[p] snapshot indices in id order
+
+  // Year index, only with SNAPSHOT_HAS_YEAR_INDEX
+  SNAPSHOT_YEAR_OFFSETS, // uint64[y + 1] into SNAPSHOT_YEAR_PUBS
+  SNAPSHOT_YEAR_PUBS,    // uint64[] publication ids, sorted within a year
+  SNAPSHOT_YEAR_TREE,    // uint32[] Fenwick tree over the year bucket sizes, covering at least y years
+
+  SNAPSHOT_SECTION_COUNT
+};
+
+std::uint32_t const SNAPSHOT_NONE = 0xffffffff;
+
+struct SnapshotEdge
+{
+  std::uint32_t aff1;
+  std::uint32_t aff2;
+  std::int32_t weight;
+};
+
+struct SnapshotHeader
+{
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint32_t flags;
+  std::uint32_t section_count;
+  std::uint64_t affiliation_count;
+  std::uint64_t publication_count;
+  std::uint64_t edge_count;
+  std::uint64_t section_offset[SNAPSHOT_SECTION_COUNT];
+  std::uint64_t section_size[SNAPSHOT_SECTION_COUNT]; // In bytes
+};
+
+// Writes a snapshot section by section. The header is written last, when
+// all section offsets are known.
+class SnapshotWriter
+{
+public:
+  explicit SnapshotWriter(std::ostream &output);
+
+  template <typename T>
+  void section(SnapshotSection section, std::vector<T> const &items)
+  {
+    write_section(section, items.data(), items.size() * sizeof(T));
+  }
+  void write_section(SnapshotSection section, void const *data, std::size_t bytes);
+
+  // Writes the header, returns false if any write failed
+  bool finish(std::uint32_t flags, std::uint64_t affiliation_count, std::uint64_t publication_count, std::uint64_t edge_count);
+
+private:
+  std::ostream &output_;
+  SnapshotHeader header_;
+  std::uint64_t position_;
+};
+
+// Validates and gives access to a snapshot held in memory (read from a file or mapped)
+class SnapshotReader
+{
+public:
+  // data must be 8-byte aligned and stay valid while the reader is used
+  SnapshotReader(char const *data, std::size_t size);
+
+  // Whether the header and the section table are consistent with the data
+  bool valid() const { return valid_; }
+  SnapshotHeader const &header() const { return header_; }
+
+  // Returns the section as an array of count items, or nullptr if its size is not exactly that
+  template <typename T>
+  T const *section(SnapshotSection section, std::size_t count) const
+  {
+    if (!valid_ || header_.section_size[section] != count * sizeof(T))
+    {
+      return nullptr;
+    }
+    return reinterpret_cast<T const *>(data_ + header_.section_offset[section]);
+  }
+
+  // The section as it is stored, header().section_size[section] bytes, for copying it to another snapshot
+  char const *section_bytes(SnapshotSection section) const { return data_ + header_.section_offset[section]; }
+
+  // Number of whole items of size item_size in the section
+  std::size_t count(SnapshotSection section, std::size_t item_size) const
+  {
+    return valid_ ? header_.section_size[section] / item_size : 0;
+  }
+
+private:
+  char const *data_;
+  SnapshotHeader header_;
+  bool valid_ = false;
+};
+
+// Checks that a CSR offsets array starts at 0, is non-decreasing and ends at item_count
+bool snapshot_offsets_ok(std::uint64_t const *offsets, std::size_t count, std::uint64_t item_count);
+
+// Every section of a snapshot, located and checked: all offsets, handles and
+// indices are within their arrays, and the structure is consistent (see above)
+struct SnapshotView
+{
+  std::size_t aff_count = 0;
+  std::size_t pub_count = 0;
+  std::size_t edge_count = 0;
+
+  std::int32_t const *aff_x = nullptr;
+  std::int32_t const *aff_y = nullptr;
+  std::uint64_t const *aff_id_offsets = nullptr;
+  char const *aff_id_chars = nullptr;
+  std::uint64_t const *aff_name_offsets = nullptr;
+  char const *aff_name_chars = nullptr;
+  std::uint64_t const *aff_pub_offsets = nullptr;
+  std::uint64_t const *aff_pubs = nullptr;
+  std::uint64_t const *aff_edge_offsets = nullptr;
+  std::uint32_t const *aff_edges = nullptr;
+  SnapshotEdge const *edges = nullptr;
+  std::uint32_t const *aff_by_name = nullptr; // aff_count items
+  std::size_t aff_by_coord_count = 0;
+  std::uint32_t const *aff_by_coord = nullptr;
+  std::uint32_t const *aff_by_id = nullptr; // aff_count items
+
+  std::uint64_t const *pub_ids = nullptr;
+  std::uint16_t const *pub_years = nullptr;
+  std::uint32_t const *pub_parents = nullptr;
+  std::uint64_t const *pub_name_offsets = nullptr;
+  char const *pub_name_chars = nullptr;
+  std::uint64_t const *pub_aff_offsets = nullptr;
+  std::uint64_t const *pub_aff_id_offsets = nullptr;
+  char const *pub_aff_id_chars = nullptr;
+  std::uint64_t const *pub_child_offsets = nullptr;
+  std::uint32_t const *pub_children = nullptr;
+  std::uint32_t const *pub_by_id = nullptr; // pub_count items
+
+  // Year index, null without SNAPSHOT_HAS_YEAR_INDEX
+  std::size_t year_count = 0; // Number of year buckets
+  std::uint64_t const *year_offsets = nullptr;
+  std::uint64_t const *year_pubs = nullptr;
+  std::size_t year_tree_size = 0;
+  std::uint32_t const *year_tree = nullptr;
+
+  std::string_view aff_id(std::uint32_t aff) const { return csr_string(aff_id_offsets, aff_id_chars, aff); }
+  std::string_view aff_name(std::uint32_t aff) const { return csr_string(aff_name_offsets, aff_name_chars, aff); }
+  std::string_view pub_name(std::uint32_t pub) const { return csr_string(pub_name_offsets, pub_name_chars, pub); }
+  // The i:th affiliation id of all publications, see SNAPSHOT_PUB_AFF_OFFSETS
+  std::string_view pub_aff_id(std::uint64_t i) const { return csr_string(pub_aff_id_offsets, pub_aff_id_chars, i); }
+
+  static std::string_view csr_string(std::uint64_t const *offsets, char const *chars, std::uint64_t i)
+  {
+    return std::string_view(chars + offsets[i], offsets[i + 1] - offsets[i]);
+  }
+};
+
+// Fills view from snapshot, returns false if the snapshot is not valid. Without
+// check_structure, only sizes, offsets and indices are checked, for a snapshot this
+// process has just written.
+bool snapshot_view(SnapshotReader const &snapshot, SnapshotView &view, bool check_structure = true);
+
+#endif // SNAPSHOT_HH